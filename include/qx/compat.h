@@ -6,6 +6,28 @@
 #define QX_ALIGNED(x) __attribute__ ((aligned(x)))
 #endif
 
+// Instruction set selection for individual functions, used by the kernels that
+// are dispatched at runtime based on what the host CPU supports. MSVC accepts
+// AVX intrinsics anywhere, so it doesn't need (or have) an equivalent.
+#if defined(_MSC_VER)
+#define QX_TARGET_AVX2
+#define QX_TARGET_AVX512
+#else
+#define QX_TARGET_AVX2 __attribute__ ((target("avx2,fma")))
+#define QX_TARGET_AVX512 __attribute__ ((target("avx512f")))
+#endif
+
+// GCC implements the plain AVX-512 permute, shuffle, insert and extract
+// intrinsics with an undefined merge source, reported as uninitialized by
+// -Wall. Their zero-masking forms with a full mask compile to the same
+// instructions.
+#define QX_MM512_PERMUTE_PD(x, c)       _mm512_maskz_permute_pd((__mmask8) 0xFF, (x), (c))
+#define QX_MM512_SHUFFLE_F64X2(x, y, c) _mm512_maskz_shuffle_f64x2((__mmask8) 0xFF, (x), (y), (c))
+#define QX_MM512_INSERTF64X4(x, y, i)   _mm512_maskz_insertf64x4((__mmask8) 0xFF, (x), (y), (i))
+#define QX_MM512_EXTRACTF64X4_PD(x, i)  _mm512_maskz_extractf64x4_pd((__mmask8) 0x0F, (x), (i))
+#define QX_MM512_PERMUTE_PS(x, c)       _mm512_maskz_permute_ps((__mmask16) 0xFFFF, (x), (c))
+#define QX_MM512_PERMUTEXVAR_PS(i, x)   _mm512_maskz_permutexvar_ps((__mmask16) 0xFFFF, (i), (x))
+
 // MSVC doesn't define __SSE__, so just assume it is available...
 #if defined(_MSC_VER)
 #define __SSE__
@@ -25,6 +47,14 @@
 #endif
 #endif
 
+// Population count of a 64-bit word.
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define QX_POPCOUNT(x) __popcnt64(x)
+#else
+#define QX_POPCOUNT(x) __builtin_popcountll(x)
+#endif
+
 // srand48 doesn't exist on Windows.
 #ifdef _MSC_VER
 #define QX_SRAND srand
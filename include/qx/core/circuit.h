@@ -10,6 +10,7 @@
 
 #include <iostream>
 #include <vector>
+#include <map>
 #include <string>
 #include <cstdint>
 
@@ -17,6 +18,7 @@
 #define print(x) std::cout << x 
 
 #include "qx/core/gate.h"
+#include "qx/core/sp_register.h"
 
 // #ifndef XPU_TIMER
 // #define XPU_TIMER
@@ -39,12 +41,569 @@ namespace qx
          size_t              iteration;
          double              time;
 
+         size_t              fusion;       // max qubits of a fused gate (0: no fusion)
+         std::vector<gate *> fused;        // cached fused circuit
+         std::vector<gate *> fused_gates;  // gates created by the fusion or the diagonal accumulation (owned)
+         bool                fused_valid;
+         bool                fused_diag;   // diagonal runs of the cached circuit are accumulated
+         bool                diag_acc;     // accumulate runs of diagonal gates
+
+         size_t              block_qubits; // cache block size in qubits (0: no blocking)
+         size_t              remap_qubits; // low physical qubits hot qubits are moved to (0: no remapping)
+
+         /**
+          * \brief drop the cached fused circuit
+          */
+         void clear_fused()
+         {
+            for (std::vector<gate*>::iterator it= fused_gates.begin(); it != fused_gates.end(); it++)
+               delete (*it);
+            fused_gates.clear();
+            fused.clear();
+            fused_valid = false;
+         }
+
+         /**
+          * \brief append the pending window of unitary gates to the fused
+          *  circuit, as a single fused gate if it holds more than one gate
+          */
+         void flush_window(std::vector<gate *>& window, std::vector<uint64_t>& wq)
+         {
+            if ((window.size() == 1) || (wq.size() > 6))
+               fused.insert(fused.end(), window.begin(), window.end());
+            else if (window.size() > 1)
+            {
+               std::sort(wq.begin(), wq.end());
+               fused_gate * fg = new fused_gate(wq);
+               for (size_t i=0; i<window.size(); ++i)
+                  fg->merge(window[i]);
+               fused.push_back(fg);
+               fused_gates.push_back(fg);
+            }
+            window.clear();
+            wq.clear();
+         }
+
+         /**
+          * \brief build the fused circuit from <in> : consecutive unitary
+          *  gates are greedily grouped as long as they act on at most
+          *  'fusion' qubits in total, each group becoming one dense operator
+          */
+         void fuse(std::vector<gate *>& in)
+         {
+            std::vector<gate *>   window;
+            std::vector<uint64_t> wq;
+            cvector_t             m;
+            for (size_t i=0; i<in.size(); ++i)
+            {
+               gate *                g = in[i];
+               std::vector<uint64_t> q = g->qubits();
+               // wider gates are kept as is, without building their matrix
+               if ((q.size() > fusion) || !g->get_matrix(m))
+               {
+                  flush_window(window, wq);
+                  fused.push_back(g);
+                  continue;
+               }
+               std::vector<uint64_t> u(wq);
+               for (size_t j=0; j<q.size(); ++j)
+                  if (std::find(u.begin(), u.end(), q[j]) == u.end())
+                     u.push_back(q[j]);
+               if (u.size() > fusion)
+               {
+                  flush_window(window, wq);
+                  u = q;
+               }
+               window.push_back(g);
+               wq = u;
+            }
+            flush_window(window, wq);
+         }
+
+         /**
+          * \brief a diagonal gate, or a cnot ; diagonal ; cnot sequence, with
+          *  its diagonal d over the qubits q (bit i of the index of d being
+          *  q[i]) and the estimated cost of its native kernels, in passes
+          *  over the state
+          */
+         struct diag_item
+         {
+            std::vector<gate *>   g;
+            std::vector<uint64_t> q;
+            cvector_t             d;
+            double                cost;
+         };
+
+         /**
+          * \brief diagonal of g if g is a diagonal unitary on at most 6 qubits
+          */
+         static bool get_diagonal(gate * g, std::vector<uint64_t>& q, cvector_t& d)
+         {
+            cvector_t m;
+            q = g->qubits();
+            if ((q.size() > 6) || !g->get_matrix(m))
+               return false;
+            size_t n = (1UL << q.size());
+            d.resize(n);
+            for (size_t r=0; r<n; ++r)
+            {
+               for (size_t c=0; c<n; ++c)
+                  if ((r != c) && ((m[r*n+c].re != 0.0) || (m[r*n+c].im != 0.0)))
+                     return false;
+               d[r] = m[r*n+r];
+            }
+            return true;
+         }
+
+         /**
+          * \brief fraction of the state vector touched by the native kernel
+          *  of a diagonal gate
+          */
+         static double diagonal_cost(gate * g)
+         {
+            switch (g->type())
+            {
+               case __identity_gate__ :
+                  return 0;
+               case __pauli_z_gate__ :
+               case __phase_gate__ :
+               case __sdag_gate__ :
+               case __t_gate__ :
+               case __tdag_gate__ :
+               case __rz_gate__ :
+               case __cnot_gate__ :
+                  return 0.5;
+               case __cphase_gate__ :
+               case __ctrl_phase_shift_gate__ :
+                  return 0.25;
+               default :
+                  return 1;
+            }
+         }
+
+         /**
+          * \brief match a diagonal item at in[i]. cnot c,t ; D(t) ; cnot c,t
+          *  (the usual ZZ rotation of QAOA circuits) is diagonal as a whole :
+          *  the phase of |c,t> is D[c xor t].
+          */
+         static bool diagonal_item(std::vector<gate *>& in, size_t i, diag_item& it)
+         {
+            if ((in[i]->type() == __cnot_gate__) && (i+2 < in.size()) && (in[i+2]->type() == __cnot_gate__))
+            {
+               std::vector<uint64_t> a = in[i]->qubits();
+               std::vector<uint64_t> q;
+               cvector_t             d;
+               if ((a == in[i+2]->qubits()) && get_diagonal(in[i+1], q, d) && (q.size() == 1) && (q[0] == a[1]))
+               {
+                  it.g    = std::vector<gate *>(in.begin()+i, in.begin()+i+3);
+                  it.q    = a;
+                  it.d    = { d[0], d[1], d[1], d[0] };
+                  it.cost = 1 + diagonal_cost(in[i+1]);
+                  return true;
+               }
+            }
+            it.g.assign(1, in[i]);
+            it.cost = diagonal_cost(in[i]);
+            return get_diagonal(in[i], it.q, it.d);
+         }
+
+         /**
+          * \brief diagonal operators commute : the items of a run are packed
+          *  (first fit) into groups on at most 10 qubits, a group being
+          *  appended to <out> as a single diagonal_gate when that saves
+          *  passes over the state, as its original gates otherwise
+          */
+         void pack_diagonals(std::vector<diag_item>& run, std::vector<gate *>& out)
+         {
+            std::vector<std::vector<uint64_t> > gq;
+            std::vector<std::vector<size_t> >   gi;
+            std::vector<double>                 gc;
+            for (size_t i=0; i<run.size(); ++i)
+            {
+               size_t k = 0;
+               for (; k<gq.size(); ++k)
+               {
+                  std::vector<uint64_t> u(gq[k]);
+                  for (size_t j=0; j<run[i].q.size(); ++j)
+                     if (std::find(u.begin(), u.end(), run[i].q[j]) == u.end())
+                        u.push_back(run[i].q[j]);
+                  if (u.size() <= 10)
+                  {
+                     gq[k] = u;
+                     break;
+                  }
+               }
+               if (k == gq.size())
+               {
+                  gq.push_back(run[i].q);
+                  gi.push_back(std::vector<size_t>());
+                  gc.push_back(0);
+               }
+               gi[k].push_back(i);
+               gc[k] += run[i].cost;
+            }
+            for (size_t k=0; k<gq.size(); ++k)
+            {
+               if ((gi[k].size() > 1) && (gc[k] > 1))
+               {
+                  std::sort(gq[k].begin(), gq[k].end());
+                  diagonal_gate * dg = new diagonal_gate(gq[k]);
+                  for (size_t j=0; j<gi[k].size(); ++j)
+                     dg->merge(run[gi[k][j]].q, run[gi[k][j]].d);
+                  out.push_back(dg);
+                  fused_gates.push_back(dg);
+               }
+               else
+                  for (size_t j=0; j<gi[k].size(); ++j)
+                     out.insert(out.end(), run[gi[k][j]].g.begin(), run[gi[k][j]].g.end());
+            }
+            run.clear();
+         }
+
+         /**
+          * \brief accumulate the runs of consecutive diagonal gates of <in>
+          *  into phase tables, applied just before the next non-diagonal
+          *  gate (or measurement, display...) or at the end of the circuit
+          */
+         std::vector<gate *> accumulate_diagonals(std::vector<gate *>& in)
+         {
+            std::vector<gate *>    out;
+            std::vector<diag_item> run;
+            diag_item              it;
+            for (size_t i=0; i<in.size(); ++i)
+            {
+               gate_type_t t = in[i]->type();
+               if ((t == __diagonal_gate__) || (t == __diagonal_hamiltonian_gate__))
+                  out.push_back(in[i]);   // already a table pass, commutes with the run
+               else if (diagonal_item(in, i, it))
+               {
+                  run.push_back(it);
+                  i += it.g.size()-1;
+               }
+               else
+               {
+                  pack_diagonals(run, out);
+                  out.push_back(in[i]);
+               }
+            }
+            pack_diagonals(run, out);
+            return out;
+         }
+
+         /**
+          * \brief build the cached circuit actually executed : diagonal runs
+          *  accumulated (if <diagonals>), then fused (if enabled)
+          */
+         void prepare(bool diagonals)
+         {
+            clear_fused();
+            std::vector<gate *> g = (diagonals ? accumulate_diagonals(gates) : gates);
+            if (fusion)
+               fuse(g);
+            else
+               fused = g;
+            fused_valid = true;
+            fused_diag  = diagonals;
+         }
+
+         /**
+          * \brief a gate prepared for cache-blocked execution
+          */
+         typedef enum { __block_matrix__, __block_phase__, __block_z__, __block_cz__, __block_cphase__, __block_swap__, __block_mc__, __block_diag__ } block_kind_t;
+
+         struct block_op
+         {
+            block_kind_t          kind;
+            std::vector<uint64_t> qubits;   // all qubits, or controls for __block_mc__
+            uint64_t              target;
+            cvector_t             m;        // matrix, or phases for __block_diag__
+         };
+
+         /**
+          * \brief prepare g for cache-blocked execution, using the native
+          *  kernel of the gate when there is one. returns false if g cannot
+          *  be applied to a block of the state vector.
+          */
+         bool block_prepare(gate * g, block_op& op, size_t limit)
+         {
+            op.qubits = g->qubits();
+            for (size_t i=0; i<op.qubits.size(); ++i)
+               if (op.qubits[i] >= limit)
+                  return false;
+            if (g->type() == __diagonal_gate__)
+            {
+               op.kind = __block_diag__;
+               op.m    = ((diagonal_gate *)g)->get_phases();
+               return true;
+            }
+            if ((op.qubits.size() > 6) || !g->get_matrix(op.m))
+               return false;
+
+            size_t d = (1UL << op.qubits.size());
+            switch (g->type())
+            {
+               case __pauli_z_gate__ :
+                  op.kind = __block_z__; break;
+               case __phase_gate__ :
+               case __sdag_gate__ :
+               case __t_gate__ :
+               case __tdag_gate__ :
+               case __rz_gate__ :
+                  op.kind = __block_phase__; break;
+               case __cphase_gate__ :
+                  op.kind = __block_cz__; break;
+               case __ctrl_phase_shift_gate__ :
+                  op.kind = __block_cphase__; break;
+               case __swap_gate__ :
+                  op.kind = __block_swap__; break;
+               case __pauli_x_gate__ :
+               case __pauli_y_gate__ :
+               case __cnot_gate__ :
+               case __ctrl_pauli_y_gate__ :
+               case __toffoli_gate__ :
+               case __multi_ctrl_gate__ :
+               {
+                  // keep the 2x2 corner (all controls set) of the controlled matrix
+                  size_t c = (d >> 1) - 1, t = d - 1;
+                  complex_t m2[] = { op.m[c*d+c], op.m[c*d+t], op.m[t*d+c], op.m[t*d+t] };
+                  op.kind   = __block_mc__;
+                  op.target = op.qubits.back();
+                  op.qubits.pop_back();
+                  op.m.assign(m2, m2+4);
+                  break;
+               }
+               default :
+                  op.kind = __block_matrix__;
+            }
+            return true;
+         }
+
+         /**
+          * \brief apply ops to the 2^b amplitudes at p
+          */
+         static void apply_block(complex_t * p, size_t b, std::vector<block_op>& ops)
+         {
+            for (size_t i=0; i<ops.size(); ++i)
+            {
+               block_op& op = ops[i];
+               size_t    d  = (1UL << op.qubits.size());
+               switch (op.kind)
+               {
+                  case __block_z__ :
+                     __apply_z(0, (1UL << b), op.qubits[0], p); break;
+                  case __block_phase__ :
+                     __apply_phase(0, (1UL << b), op.qubits[0], p, op.m[3]); break;
+                  case __block_cz__ :
+                     __apply_cz(b, op.qubits[0], op.qubits[1], p); break;
+                  case __block_cphase__ :
+                     __apply_cphase(b, op.qubits[0], op.qubits[1], p, op.m[d*d-1]); break;
+                  case __block_swap__ :
+                     __apply_swap(b, op.qubits[0], op.qubits[1], p); break;
+                  case __block_mc__ :
+                     __apply_mc(b, op.qubits, op.target, p, op.m.data()); break;
+                  case __block_diag__ :
+                     __apply_diag(b, op.qubits, p, op.m.data()); break;
+                  default :
+                     if (op.qubits.size() == 1)
+                        __apply_m(0, (1UL << b), op.qubits[0], p, 0, (1UL << op.qubits[0]), op.m.data());
+                     else
+                        __apply_dense(b, op.qubits, p, op.m.data());
+               }
+            }
+         }
+
+         /**
+          * \brief apply ops block by block : they only act on qubits below
+          *  block_qubits, so each block of 2^block_qubits contiguous
+          *  amplitudes is independent and gets all of them while it is cache
+          *  resident
+          */
+         void apply_blocked(qu_register& reg, std::vector<block_op>& ops)
+         {
+            size_t      b = block_qubits;
+            complex_t * s = reg.get_raw_data().data();
+            int64_t     blocks = (int64_t)(1UL << (reg.size() - b));
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+            for (int64_t k=0; k<blocks; ++k)
+               apply_block(s + (((size_t)k) << b), b, ops);
+         }
+
+         /**
+          * \brief move the logical qubits used at least twice by ops into the
+          *  <remap_qubits> lowest physical positions (swapping out qubits the
+          *  ops do not use), then translate ops to physical qubits
+          */
+         void remap(qu_register& reg, std::vector<block_op>& ops)
+         {
+            std::map<uint64_t,size_t> uses;
+            for (size_t i=0; i<ops.size(); ++i)
+            {
+               for (size_t j=0; j<ops[i].qubits.size(); ++j)
+                  uses[ops[i].qubits[j]]++;
+               if (ops[i].kind == __block_mc__)
+                  uses[ops[i].target]++;
+            }
+
+            std::vector<std::pair<size_t,uint64_t> > hot;
+            for (std::map<uint64_t,size_t>::iterator it=uses.begin(); it!=uses.end(); ++it)
+               if ((it->second > 1) && (reg.physical(it->first) >= remap_qubits))
+                  hot.push_back(std::make_pair(it->second, it->first));
+            std::sort(hot.rbegin(), hot.rend());
+
+            // take the free slots from the top, the lowest ones are the
+            // least friendly to the vector kernels
+            size_t p = remap_qubits;
+            for (size_t i=0; i<hot.size(); ++i)
+            {
+               while (p && (uses.find(reg.logical(p-1)) != uses.end()))
+                  p--;
+               if (!p)
+                  break;
+               reg.swap_physical(--p, reg.physical(hot[i].second));
+            }
+
+            for (size_t i=0; i<ops.size(); ++i)
+            {
+               for (size_t j=0; j<ops[i].qubits.size(); ++j)
+                  ops[i].qubits[j] = reg.physical(ops[i].qubits[j]);
+               if (ops[i].kind == __block_mc__)
+                  ops[i].target = reg.physical(ops[i].target);
+            }
+         }
+
+         /**
+          * \brief apply a gate list, blocking runs of low-qubit gates when
+          *  enabled
+          */
+         void apply_gates(qu_register& reg, std::vector<gate *>& g)
+         {
+            size_t n        = reg.size();
+            bool   blocking = block_qubits && (block_qubits < n);
+            bool   remaping = remap_qubits && (remap_qubits < n);
+            if (!blocking && !remaping)
+            {
+               for (size_t i=0; i<g.size(); ++i)
+                  g[i]->apply(reg);
+               return;
+            }
+
+            std::vector<block_op> ops;
+            block_op              op;
+            size_t limit = (remaping ? n : block_qubits);
+            size_t i = 0;
+            while (i < g.size())
+            {
+               size_t j = i;
+               ops.clear();
+               while ((j < g.size()) && block_prepare(g[j], op, limit))
+               {
+                  ops.push_back(op);
+                  j++;
+               }
+               if (ops.size() > 1)
+               {
+                  if (remaping)
+                     remap(reg, ops);
+                  bool low = blocking;
+                  for (size_t k=0; k<ops.size() && low; ++k)
+                  {
+                     for (size_t l=0; l<ops[k].qubits.size(); ++l)
+                        low = low && (ops[k].qubits[l] < block_qubits);
+                     if (ops[k].kind == __block_mc__)
+                        low = low && (ops[k].target < block_qubits);
+                  }
+                  if (low)
+                     apply_blocked(reg, ops);
+                  else
+                     apply_block(reg.get_raw_data().data(), n, ops);
+
+                  for (; i<j; ++i)
+                  {
+                     std::vector<uint64_t> q = g[i]->qubits();
+                     for (size_t l=0; l<q.size(); ++l)
+                        reg.set_measurement_prediction(q[l],__state_unknown__);
+                  }
+               }
+               else
+                  g[i++]->apply(reg);
+            }
+         }
+
+         /**
+          * \brief true if <g> is a controlled phase shift by pi/2^d between
+          *  the qubits a and b
+          */
+         static bool is_qft_rotation(gate * g, uint64_t a, uint64_t b, size_t d)
+         {
+            if (g->type() != __ctrl_phase_shift_gate__)
+               return false;
+            std::vector<uint64_t> q = g->qubits();
+            if (!(((q[0] == a) && (q[1] == b)) || ((q[0] == b) && (q[1] == a))))
+               return false;
+            cvector_t m;
+            g->get_matrix(m);
+            double ph = QX_PI/(double)(1UL << d);
+            return (std::abs(m[15].re - cos(ph)) < 1e-12) && (std::abs(m[15].im - sin(ph)) < 1e-12);
+         }
+
+         /**
+          * \brief match the textbook qft circuit at gates[i] on the qubits t,
+          *  t+dir, ... t+dir*(k-1) (t being the qubit of gates[i]) : for each
+          *  qubit a hadamard then its controlled phase ladder, optionally
+          *  followed by the k/2 closing swaps (in any order). sets k, the
+          *  number of gates <len> and <swaps>.
+          */
+         bool match_qft(size_t i, int64_t dir, size_t& k, size_t& len, bool& swaps)
+         {
+            if (gates[i]->type() != __hadamard_gate__)
+               return false;
+            int64_t t = gates[i]->qubits()[0];
+            k = 1;
+            while ((i+k < gates.size()) && (t+dir*(int64_t)k >= 0) && (t+dir*(int64_t)k < (int64_t)n_qubit)
+                   && is_qft_rotation(gates[i+k], t, t+dir*k, k))
+               ++k;
+            if (k < 2)
+               return false;
+            size_t j = i+k;
+            for (size_t l=1; l<k; ++l)
+            {
+               uint64_t ql = t+dir*l;
+               if ((j >= gates.size()) || (gates[j]->type() != __hadamard_gate__) || (gates[j]->qubits()[0] != ql))
+                  return false;
+               ++j;
+               for (size_t d=1; d<k-l; ++d, ++j)
+                  if ((j >= gates.size()) || !is_qft_rotation(gates[j], ql, ql+dir*d, d))
+                     return false;
+            }
+            size_t            ns = k/2;
+            std::vector<bool> seen(ns, false);
+            swaps = (j+ns <= gates.size());
+            for (size_t s=0; (s<ns) && swaps; ++s)
+            {
+               gate * g = gates[j+s];
+               swaps = (g->type() == __swap_gate__);
+               if (!swaps)
+                  break;
+               std::vector<uint64_t> q = g->qubits();
+               int64_t a = ((int64_t)q[0]-t)*dir;
+               int64_t b = ((int64_t)q[1]-t)*dir;
+               size_t  p = (size_t)std::min(a,b);
+               swaps = (a >= 0) && (b >= 0) && (a+b == (int64_t)k-1) && (p < ns) && !seen[p];
+               if (swaps)
+                  seen[p] = true;
+            }
+            len = j-i+(swaps ? ns : 0);
+            return true;
+         }
+
       public:
 
          /**
           * \brief circuit constructor
           */
-         circuit(size_t n_qubit, std::string name = "", size_t iteration=1) : n_qubit(n_qubit), name(name), iteration(iteration)
+         circuit(size_t n_qubit, std::string name = "", size_t iteration=1) : n_qubit(n_qubit), name(name), iteration(iteration), fusion(0), fused_valid(false), fused_diag(false), diag_acc(true), block_qubits(0), remap_qubits(0)
          {
          }
 
@@ -53,6 +612,7 @@ namespace qx
           */
          ~circuit()
          {
+            clear_fused();
             for (std::vector<gate*>::iterator it= gates.begin(); it != gates.end(); it++)
                delete (*it);
          }
@@ -74,6 +634,7 @@ namespace qx
           */
          void clear()
          {
+            clear_fused();
             for (std::vector<gate*>::iterator it= gates.begin(); it != gates.end(); it++)
                delete (*it);
             gates.clear();
@@ -86,6 +647,7 @@ namespace qx
          {
             // check gate validity before (target/ctrl qubits < n_qubit)
             gates.push_back(g);
+            fused_valid = false;
          }
 
          /**
@@ -113,6 +675,127 @@ namespace qx
             return iteration;
          }
 
+         /**
+          * \brief enable gate fusion before execution : runs of unitary gates
+          *  acting on at most <max_qubits> qubits are merged into a single
+          *  dense operator (typically 4 or 5, at most 6). 0 disables the
+          *  fusion.
+          */
+         void set_fusion(size_t max_qubits)
+         {
+            if (max_qubits > 6)
+               throw std::invalid_argument("gate fusion : fused gates are limited to 6 qubits");
+            if (max_qubits != fusion)
+               clear_fused();
+            fusion = max_qubits;
+         }
+
+         /**
+          * \brief fusion size (0 if disabled)
+          */
+         size_t get_fusion()
+         {
+            return fusion;
+         }
+
+         /**
+          * \brief accumulate the runs of consecutive diagonal gates (Z, S, T,
+          *  Rz, CZ, CR, CRk, diagonal custom gates and cnot ; Rz ; cnot
+          *  sequences...) into phase tables on up to 10 qubits, each applied
+          *  in one pass just before the next non-diagonal gate. enabled by
+          *  default.
+          */
+         void set_diagonal_accumulation(bool enable)
+         {
+            diag_acc = enable;
+         }
+
+         bool get_diagonal_accumulation()
+         {
+            return diag_acc;
+         }
+
+         /**
+          * \brief enable cache-blocked execution : runs of consecutive gates
+          *  acting only on qubits below <qubits> are applied one block of
+          *  2^qubits amplitudes at a time (e.g. 14 for 256 KB blocks, which
+          *  fit in L2). 0 disables the blocking.
+          */
+         void set_blocking(size_t qubits)
+         {
+            block_qubits = qubits;
+         }
+
+         /**
+          * \brief block size in qubits (0 if disabled)
+          */
+         size_t get_blocking()
+         {
+            return block_qubits;
+         }
+
+         /**
+          * \brief enable qubit remapping : ahead of a run of gates, the qubits
+          *  it uses repeatedly are moved into the <qubits> lowest physical
+          *  positions of the register (combined with set_blocking(), the run
+          *  then becomes cache resident). the register keeps the mapping and
+          *  restores the logical order when the state is accessed. 0
+          *  disables the remapping.
+          */
+         void set_remapping(size_t qubits)
+         {
+            remap_qubits = qubits;
+         }
+
+         /**
+          * \brief remapping size in qubits (0 if disabled)
+          */
+         size_t get_remapping()
+         {
+            return remap_qubits;
+         }
+
+         /**
+          * \brief replace the textbook qft circuits (a hadamard and controlled
+          *  phase ladder per qubit, cr q[i+d],q[i],pi/2^d or crk q[i+d],q[i],d+1,
+          *  on a contiguous range of qubits, with or without the closing swaps)
+          *  by qft gates. returns the number of qft found.
+          */
+         size_t detect_qft()
+         {
+            std::vector<gate *> r;
+            size_t              found = 0;
+            size_t              i = 0;
+            while (i < gates.size())
+            {
+               size_t  k, len;
+               bool    swaps;
+               int64_t dir = 0;
+               if (match_qft(i, 1, k, len, swaps))
+                  dir = 1;
+               else if (match_qft(i, -1, k, len, swaps))
+                  dir = -1;
+               if (!dir)
+               {
+                  r.push_back(gates[i++]);
+                  continue;
+               }
+               uint64_t              t = gates[i]->qubits()[0];
+               std::vector<uint64_t> q;
+               for (size_t l=0; l<k; ++l)
+                  q.push_back(t+dir*l);
+               r.push_back(new qft(q, false, swaps));
+               for (size_t l=i; l<i+len; ++l)
+                  delete gates[l];
+               i += len;
+               found++;
+            }
+            gates.swap(r);
+            if (found)
+               clear_fused();
+            return found;
+         }
+
          /**
           * \brief return gate <i>
           */
@@ -134,11 +817,13 @@ namespace qx
                tmr.start();
             }
 #endif
+            if (!verbose && (!fused_valid || (fused_diag != diag_acc)))
+               prepare(diag_acc);
+
             while (it--)
             {
                if (!verbose) 
-                  for (size_t i=0; i<gates.size(); ++i)
-                     gates[i]->apply(reg);
+                  apply_gates(reg, fused);
                else
                {
                   for (size_t i=0; i<gates.size(); ++i)
@@ -159,6 +844,41 @@ namespace qx
 #endif // XPU_TIMER
          }
 
+         /**
+          * \brief execute the circuit on a single-precision register (the
+          *  circuit must only contain unitary gates)
+          */
+         void execute(sp_register& reg, bool silent=false)
+         {
+            size_t it = iteration;
+#ifdef XPU_TIMER
+            xpu::timer tmr;
+            if (!silent)
+            {
+               println("[+] executing circuit '" << name << "' (" << it << " iter, single precision) ...");
+               tmr.start();
+            }
+#endif
+            // phase tables on more than 6 qubits have no matrix
+            if (fusion && (!fused_valid || fused_diag))
+               prepare(false);
+            std::vector<gate *>& g = (fusion ? fused : gates);
+            std::vector<sp_gate> ops(g.size());
+            for (size_t i=0; i<g.size(); ++i)
+               ops[i] = sp_register::prepare(g[i]);
+
+            while (it--)
+               for (size_t i=0; i<ops.size(); ++i)
+                  reg.apply(ops[i]);
+#ifdef XPU_TIMER
+            if (!silent)
+            {
+               tmr.stop();
+               println("[+] circuit execution time: " << tmr.elapsed() << " sec.");
+            }
+#endif // XPU_TIMER
+         }
+
          /**
           * \return gates count
           */
@@ -174,6 +894,7 @@ namespace qx
          void insert(size_t pos, qx::gate * g)
          {
             gates.insert(gates.begin()+pos,g);
+            fused_valid = false;
          }
 
 
@@ -207,6 +928,188 @@ namespace qx
          }
 
    };
+
+   /**
+    * \brief flatten <circuits> into their gates <g> in execution order
+    *  (parallel gates expanded) with the index <c> of their circuit, and check
+    *  that the measurements can be deferred : no classical control,
+    *  preparations only on fresh qubits, and no gate acting on a measured
+    *  qubit after its measurement. the final measurements are flagged in
+    *  <skip> and the circuits holding one in <partial>.
+    */
+   inline bool split_final_measurements(std::vector<circuit *>& circuits, uint64_t n_qubits,
+                                        std::vector<gate *>& g, std::vector<size_t>& c,
+                                        std::vector<bool>& skip, std::vector<bool>& partial)
+   {
+      g.clear();
+      c.clear();
+      for (size_t i=0; i<circuits.size(); ++i)
+      {
+         for (size_t j=0; j<circuits[i]->size(); ++j)
+         {
+            gate * x = circuits[i]->get(j);
+            std::vector<gate *> pg(1, x);
+            if (x->type() == __parallel_gate__)
+               pg = ((parallel_gates *)x)->get_gates();
+            for (size_t k=0; k<pg.size(); ++k)
+            {
+               g.push_back(pg[k]);
+               c.push_back(i);
+            }
+         }
+      }
+
+      // preparations must act on fresh qubits
+      std::vector<bool> used(MAX_QB_N, false);
+      for (size_t i=0; i<g.size(); ++i)
+      {
+         gate_type_t           t = g[i]->type();
+         std::vector<uint64_t> q = g[i]->qubits();
+         if ((t == __prepz_gate__) || (t == __prepx_gate__) || (t == __prepy_gate__))
+            if (used[q[0]] || (circuits[c[i]]->get_iterations() > 1))
+               return false;
+         for (size_t k=0; k<q.size(); ++k)
+            used[q[k]] = true;
+      }
+
+      // measurements must be final, no other non-unitary operation
+      std::vector<bool> touched(MAX_QB_N, false);
+      skip.assign(g.size(), false);
+      partial.assign(circuits.size(), false);
+      for (size_t i=g.size(); i--; )
+      {
+         gate_type_t           t = g[i]->type();
+         std::vector<uint64_t> q = g[i]->qubits();
+         switch (t)
+         {
+            case __measure_gate__:
+            case __measure_reg_gate__:
+               for (size_t k=0; k<q.size(); ++k)
+                  if ((q[k] < n_qubits) && touched[q[k]])
+                     return false;
+               if (circuits[c[i]]->get_iterations() > 1)
+                  return false;
+               // measuring again a measured qubit changes nothing
+               skip[i] = true;
+               partial[c[i]] = true;
+               continue;
+            case __measure_x_gate__:
+            case __measure_x_reg_gate__:
+            case __measure_y_gate__:
+            case __measure_y_reg_gate__:
+            case __bin_ctrl_gate__:
+            case __lookup_table__:
+            case __classical_not_gate__:
+            case __prepare_gate__:
+               return false;
+            default:
+               break;
+         }
+         for (size_t k=0; k<q.size(); ++k)
+            touched[q[k]] = true;
+      }
+      return true;
+   }
+
+   /**
+    * \brief run <circuits> once on <reg>, then draw <shots> measurements of
+    *  the entire register from the final state (see
+    *  qu_register::measure_shots()), when this is equivalent to <shots> runs
+    *  each followed by a measurement of the register (see
+    *  split_final_measurements(), the final measurements are skipped).
+    *  noise is left to the caller. returns false, leaving <reg> untouched,
+    *  when the circuits do not qualify.
+    */
+   inline bool sample_shots(std::vector<circuit *>& circuits, qu_register& reg, size_t shots)
+   {
+      std::vector<gate *> g;
+      std::vector<size_t> c;
+      std::vector<bool>   skip;
+      std::vector<bool>   partial;
+      if (!split_final_measurements(circuits, reg.size(), g, c, skip, partial))
+         return false;
+
+      for (size_t i=0; i<circuits.size(); ++i)
+      {
+         if (!partial[i])
+         {
+            circuits[i]->execute(reg, false, true);
+            continue;
+         }
+         for (size_t k=0; k<g.size(); ++k)
+            if ((c[k] == i) && !skip[k])
+               g[k]->apply(reg);
+      }
+      reg.measure_shots(shots);
+      return true;
+   }
+
+   /**
+    * \brief run the noise-free <circuits> in single precision : their
+    *  unitary part runs on a sp_register in the memory of <reg> (the
+    *  preparations, which act on fresh qubits, are applied to <reg> first)
+    *  and the final state is written back to <reg>, on which the final
+    *  measurements are then applied, or <shots> measurements of the register
+    *  drawn when shots > 0. this halves the memory traffic of the gate
+    *  sweeps without any extra memory. returns false, leaving <reg> untouched,
+    *  when the circuits do not qualify for split_final_measurements() or
+    *  use a gate the sp_register cannot apply (no matrix or more than 6
+    *  qubits).
+    */
+   inline bool execute_single_precision(std::vector<circuit *>& circuits, qu_register& reg, size_t shots=0)
+   {
+      std::vector<gate *> g;
+      std::vector<size_t> c;
+      std::vector<bool>   skip;
+      std::vector<bool>   prep;
+      std::vector<bool>   partial;
+      if (!split_final_measurements(circuits, reg.size(), g, c, skip, partial))
+         return false;
+
+      cvector_t m;
+      prep.assign(g.size(), false);
+      for (size_t k=0; k<g.size(); ++k)
+      {
+         gate_type_t t = g[k]->type();
+         if ((t == __prepz_gate__) || (t == __prepx_gate__) || (t == __prepy_gate__))
+         {
+            prep[k] = partial[c[k]] = true;
+            continue;
+         }
+         if (!skip[k] && ((g[k]->qubits().size() > 6) || !g[k]->get_matrix(m)))
+            return false;
+      }
+
+      for (size_t k=0; k<g.size(); ++k)
+         if (prep[k])
+            g[k]->apply(reg);
+      sp_register sp(reg);
+      for (size_t i=0; i<circuits.size(); ++i)
+      {
+         // circuits of plain unitary gates keep their fused form
+         if (!partial[i] && (circuits[i]->size() == (size_t)std::count(c.begin(), c.end(), i)))
+         {
+            circuits[i]->execute(sp, true);
+            continue;
+         }
+         std::vector<sp_gate> ops;
+         for (size_t k=0; k<g.size(); ++k)
+            if ((c[k] == i) && !skip[k] && !prep[k])
+               ops.push_back(sp_register::prepare(g[k]));
+         for (size_t it=0; it<circuits[i]->get_iterations(); ++it)
+            for (size_t k=0; k<ops.size(); ++k)
+               sp.apply(ops[k]);
+      }
+      sp.release();
+
+      if (shots)
+         reg.measure_shots(shots);
+      else
+         for (size_t k=0; k<g.size(); ++k)
+            if (skip[k])
+               g[k]->apply(reg);
+      return true;
+   }
 } // namespace qx
 
 
@@ -17,6 +17,7 @@
 #include <emmintrin.h> // sse
 
 #include <algorithm>
+#include <stdexcept>
 
 #include "qx/core/hash_set.h"
 #include "qx/core/linalg.h"
@@ -26,6 +27,7 @@
 #include "qx/core/kronecker.h"
 
 #include "qx/compat.h"
+#include "qx/xpu/cpuid.h"
 
 #include <chrono>
 
@@ -44,6 +46,8 @@
 #define __bit_set(x,pos) ((x) | (1<<(pos)))
 #define __bit_flip(x,pos) ((x) ^ (1<<(pos)))
 #define __bit_reset(x,pos) ((x) & ~(1<<(pos)))
+// inserts a zero bit at pos, shifting the higher bits up
+#define __bit_insert(x,pos) ((((x) >> (pos)) << ((pos)+1)) | ((x) & ((1UL<<(pos))-1)))
 
 #define __AVX__NO
 #define __OP_PREFETCH__
@@ -99,7 +103,14 @@ namespace qx
       __classical_not_gate__,
       __qft_gate__,
       __prepare_gate__,
-      __unitary_gate__
+      __unitary_gate__,
+      __multi_ctrl_gate__,
+      __fused_gate__,
+      __ctrl_pauli_y_gate__,
+      __fredkin_gate__,
+      __pauli_rotation_gate__,
+      __diagonal_gate__,
+      __diagonal_hamiltonian_gate__
    } gate_type_t;
 
 
@@ -137,6 +148,13 @@ namespace qx
 	   virtual void                   dump() = 0;
 	   virtual                        ~gate() { };                
 
+	   /**
+	    * \brief fills m with the row-major 2^k x 2^k matrix of the gate, bit i of
+	    *  the row/column index being qubits()[i]. returns false when the gate
+	    *  is not a fixed unitary (measurements, classical control, ...)
+	    */
+	   virtual bool                   get_matrix(cvector_t& m) { return false; }
+
 	   virtual void                   set_duration(uint64_t d) { duration = d; }
 	   virtual uint64_t               get_duration() { return duration; }
 	 
@@ -200,6 +218,22 @@ namespace qx
       return m;
    }
 
+   /**
+    * \brief build the dense matrix of the 2x2 operator m controlled by k
+    *  qubits, local index order (ctrl_1,...,ctrl_k,target)
+    */
+   void build_ctrl_matrix(cvector_t& r, uint64_t k, const complex_t * m)
+   {
+      size_t d = (2UL << k);
+      size_t c = (1UL << k) - 1;
+      size_t t = c | (1UL << k);
+      r.assign(d*d, complex_t(0.0, 0.0));
+      for (size_t i=0; i<d; i++)
+         r[i*d+i] = complex_t(1.0, 0.0);
+      r[c*d+c] = m[0]; r[c*d+t] = m[1];
+      r[t*d+c] = m[2]; r[t*d+t] = m[3];
+   }
+
 
    /**
     * sqg_apply
@@ -289,7 +323,32 @@ namespace qx
 
    }
 
-   void __apply_m(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
+   /**
+    * load balancing : a kernel visiting <total> amplitudes (or pairs) as
+    * contiguous runs of <run> cuts them into shorter runs, so that its
+    * parallel loop has at least 64 iterations whichever qubits the gate acts
+    * on. runs are never cut below 4 amplitudes (one avx-512 register), both
+    * arguments are powers of 2.
+    */
+   inline size_t __run_length(size_t total, size_t run)
+   {
+      return std::min(run, std::max<size_t>(total >> 6, 4));
+   }
+
+   /**
+    * real matrices (ry, rotation(), real custom or fused gates) : the
+    * single-qubit kernels take a template flag R which drops the imaginary
+    * terms, leaving a real scalar times complex product : half the
+    * multiplies and no permute. the dispatchers check the matrix on every
+    * call, which also catches matrices that are only real by value.
+    */
+   inline bool __is_real(const complex_t * matrix)
+   {
+      return (matrix[0].im == 0) && (matrix[1].im == 0) && (matrix[2].im == 0) && (matrix[3].im == 0);
+   }
+
+   template <bool R>
+   void __apply_m_sse(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
    {
 
 #if 0
@@ -303,17 +362,31 @@ namespace qx
       complex_t m01 = matrix[1];
       complex_t m10 = matrix[2];
       complex_t m11 = matrix[3];
+      __m128d   r00 = _mm_set1_pd(matrix[0].re);
+      __m128d   r01 = _mm_set1_pd(matrix[1].re);
+      __m128d   r10 = _mm_set1_pd(matrix[2].re);
+      __m128d   r11 = _mm_set1_pd(matrix[3].re);
 
 
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
 #ifdef USE_OPENMP
 #pragma omp parallel for // shared(m00,m01,m10,m11)
 #endif
-      for(int64_t offset = start; offset < (int64_t)end; offset += (1UL << (qubit + 1)))
-         for(size_t i = (size_t)offset; i < (size_t)offset + (1UL << qubit); i++)
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + __bit_insert(((size_t)k)*len, qubit), e = i + len; i < e; i++)
          {
             size_t i0 = i + stride0;
             size_t i1 = i + stride1;
 
+            if (R)
+            {
+               __m128d in0 = state[i0].xmm;
+               __m128d in1 = state[i1].xmm;
+               state[i0].xmm = _mm_add_pd(_mm_mul_pd(r00, in0), _mm_mul_pd(r01, in1));
+               state[i1].xmm = _mm_add_pd(_mm_mul_pd(r10, in0), _mm_mul_pd(r11, in1));
+               continue;
+            }
             complex_t in0 = state[i0];
             complex_t in1 = state[i1];
             state[i0] = m00*in0+m01*in1;
@@ -329,46 +402,19 @@ namespace qx
 
 #ifdef __SSE__
 // #ifdef __FMA__
-   void __apply_x(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
-   {
-#ifdef USE_OPENMP
-#pragma omp parallel for // private(m00,r00,neg)    
-#endif
-      for(int64_t offset = start; offset < (int64_t)end; offset += (1UL << (qubit + 1UL)))
-         for(size_t i = (size_t)offset; i < (size_t)offset + (1UL << qubit); i++)
-         {
-            size_t i0 = i + stride0;
-            size_t i1 = i + stride1;
-
-            __m128d xin0 = state[i0].xmm; // _mm_load_pd((double*)&(state[i0].xmm));
-            // __m128d xin1 = state[i1].xmm; // _mm_load_pd((double*)&(state[i1].xmm));
-
-            state[i0].xmm = state[i1].xmm;
-            state[i1].xmm = xin0;
-         }
-   }
-// #else
-// #error "FMA not available !"
-// #endif // FMA
-#else
-#error "SSE not available !"
-#endif // SSE
-
-
-
-#ifdef __SSE__
-// #ifdef __FMA__
-   void __apply_h(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
+   void __apply_h_sse(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
    {
       __m128d   m00 = matrix[0].xmm;
       __m128d   r00 = _mm_shuffle_pd(m00,m00,3);         // 1 cyc
       __m128d   neg = _mm_set1_pd(-0.0f);
 
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
 #ifdef USE_OPENMP
 #pragma omp parallel for // private(m00,r00,neg)    
 #endif
-      for(int64_t offset = start; offset < (int64_t)end; offset += (1UL << (qubit + 1UL)))
-         for(size_t i = (size_t)offset; i < (size_t)offset + (1UL << qubit); i++)
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + __bit_insert(((size_t)k)*len, qubit), e = i + len; i < e; i++)
          {
             size_t i0 = i + stride0;
             size_t i1 = i + stride1;
@@ -404,202 +450,2010 @@ namespace qx
 #error "SSE not available !"
 #endif // SSE
 
-   uint64_t rw_process_ui(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_ui m, cvector_t * v, cvector_t * res)
+   /**
+    * avx2/fma kernels : two amplitude pairs per instruction.
+    *
+    * amplitudes are stored as (im,re), so a complex product c*v is computed
+    * as re(c)*v + (im(c),-im(c))*swap(v) : one in-lane permute per input and
+    * no addsub. the amplitude pairs must not share a register, which means
+    * these kernels require (1 << qubit) >= 2.
+    */
+   template <bool R>
+   QX_TARGET_AVX2
+   void __apply_m_avx2(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
    {
-      uint64_t k = n-qubit;
-      // println("run : " << is << " .. " << ie);
-      complex_t * pv = v->data();
-      complex_t * pr = res->data();
-      size_t bc, c1, c2;
-      size_t nk = n-k;
-
-      for (uint64_t r=is; r<ie; ++r)
-      {
-         bc = r;
-         c1 = __bit_reset(bc,nk);
-         c2 = __bit_set(bc,nk);
-         bc++;
-#ifdef __OP_PREFETCH__
-         _mm_prefetch((char*)&pv[__bit_reset(bc,nk)],_MM_HINT_T0);
-         _mm_prefetch((char*)&pv[__bit_set(bc,nk)],_MM_HINT_T0);
-#endif // __OP_PREFETCH__
-#ifdef __AVX__ 
-         // cxc
-         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
-         // cxr
-         // pr[r].xmm = complex_t::_mm256_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
-#elif __SSE__
-         // complex_t s; // = 0;
-         //pr[r] = pv[c1]*(m->get(r,c1)) + pv[c2]*(m->get(r,c2));
-         // --- cc mul add --- 
-         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
-         // --- cr mul add --- pr[r].xmm = _mm_add_pd(complex_t::mul_cr(pv[c1].xmm,m.get(r,c1).xmm), complex_t::mul_cr(pv[c2].xmm,m.get(r,c2).xmm));
-         // --- f. mul add ---
-         // pr[r].xmm = complex_t::_mm_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
-#else
-         pr[r] = (pv[c1]*(m.get(r,c1))) + (pv[c2]*(m.get(r,c2)));
+      __m256d r00 = _mm256_set1_pd(matrix[0].re);
+      __m256d r01 = _mm256_set1_pd(matrix[1].re);
+      __m256d r10 = _mm256_set1_pd(matrix[2].re);
+      __m256d r11 = _mm256_set1_pd(matrix[3].re);
+      __m256d i00 = _mm256_set_pd(-matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im);
+      __m256d i01 = _mm256_set_pd(-matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im);
+      __m256d i10 = _mm256_set_pd(-matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im);
+      __m256d i11 = _mm256_set_pd(-matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im);
+
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
 #endif
-      }
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + __bit_insert(((size_t)k)*len, qubit), e = i + len; i < e; i += 2)
+         {
+            double * p0 = (double*)&state[i + stride0];
+            double * p1 = (double*)&state[i + stride1];
 
-      return 0;
+            __m256d in0 = _mm256_load_pd(p0);
+            __m256d in1 = _mm256_load_pd(p1);
+
+            __m256d o0 = _mm256_mul_pd(r00, in0);
+            o0 = _mm256_fmadd_pd(r01, in1, o0);
+            __m256d o1 = _mm256_mul_pd(r10, in0);
+            o1 = _mm256_fmadd_pd(r11, in1, o1);
+
+            if (!R)
+            {
+               __m256d sw0 = _mm256_permute_pd(in0, 0x5);
+               __m256d sw1 = _mm256_permute_pd(in1, 0x5);
+               o0 = _mm256_fmadd_pd(i00, sw0, o0);
+               o0 = _mm256_fmadd_pd(i01, sw1, o0);
+               o1 = _mm256_fmadd_pd(i10, sw0, o1);
+               o1 = _mm256_fmadd_pd(i11, sw1, o1);
+            }
+
+            _mm256_store_pd(p0, o0);
+            _mm256_store_pd(p1, o1);
+         }
    }
- 
 
-   void sparse_mulmv(uint64_t n, uint64_t qubit, kronecker_ui m, cvector_t& v, cvector_t& res)
+   QX_TARGET_AVX2
+   void __apply_h_avx2(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
    {
-      uint64_t k = n-qubit;
-      uint64_t rows = (1UL << n);
-      uint64_t z = 0;
+      __m256d r = _mm256_set1_pd(matrix[0].re);
 
-#ifdef SEQUENTIAL
-      rw_process_ui(z,rows,1,n,qubit,m,&v,&res);
-#else
-      /*xpu::task rw_t(rw_process_ui,0,0,0,n,qubit,m,&v,&res);
-      xpu::parallel_for process(z,rows,1,&rw_t);
-      process.run();*/
-      rw_process_ui(z,rows,0,n,qubit,m,&v,&res);
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
 #endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + __bit_insert(((size_t)k)*len, qubit), e = i + len; i < e; i += 2)
+         {
+            double * p0 = (double*)&state[i + stride0];
+            double * p1 = (double*)&state[i + stride1];
+            __m256d in0 = _mm256_load_pd(p0);
+            __m256d in1 = _mm256_load_pd(p1);
+            _mm256_store_pd(p0, _mm256_mul_pd(r, _mm256_add_pd(in0, in1)));
+            _mm256_store_pd(p1, _mm256_mul_pd(r, _mm256_sub_pd(in0, in1)));
+         }
    }
 
-   uint64_t rw_process_iu(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_iu m, cvector_t * v, cvector_t * res)
+   /**
+    * avx-512 kernels : four amplitude pairs per instruction, same scheme
+    * as the avx2 ones. require (1 << qubit) >= 4.
+    */
+   template <bool R>
+   QX_TARGET_AVX512
+   void __apply_m_avx512(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
    {
-      uint64_t k = n-qubit;
-      // println("run : " << is << " .. " << ie);
-      complex_t * pv = v->data();
-      complex_t * pr = res->data();
-      size_t bc, c1, c2;
-      size_t nk = n-k;
-
-      for (uint64_t r=is; r<ie; ++r)
-      {
-         bc = r;
-         c1 = __bit_reset(bc,nk);
-         c2 = __bit_set(bc,nk);
-         bc++;
-#ifdef __OP_PREFETCH__
-         _mm_prefetch((char*)&pv[__bit_reset(bc,nk)],_MM_HINT_T0);
-         _mm_prefetch((char*)&pv[__bit_set(bc,nk)],_MM_HINT_T0);
-#endif // __OP_PREFETCH__
-#ifdef __AVX__ 
-         // cxc
-         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
-         // cxr
-         // pr[r].xmm = complex_t::_mm256_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
-#elif __SSE__
-         // complex_t s; // = 0;
-         // pr[r] = pv[c1]*(m->get(r,c1)) + pv[c2]*(m->get(r,c2));
-         // --- cc mul add --- 
-         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
-         // --- cr mul add --- pr[r].xmm = _mm_add_pd(complex_t::mul_cr(pv[c1].xmm,m.get(r,c1).xmm), complex_t::mul_cr(pv[c2].xmm,m.get(r,c2).xmm));
-         // --- f. mul add ---
-         // pr[r].xmm = complex_t::_mm_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
-#else
-         pr[r] = (pv[c1]*(m.get(r,c1))) + (pv[c2]*(m.get(r,c2)));
+      __m512d r00 = _mm512_set1_pd(matrix[0].re);
+      __m512d r01 = _mm512_set1_pd(matrix[1].re);
+      __m512d r10 = _mm512_set1_pd(matrix[2].re);
+      __m512d r11 = _mm512_set1_pd(matrix[3].re);
+      __m512d i00 = _mm512_set_pd(-matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im);
+      __m512d i01 = _mm512_set_pd(-matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im);
+      __m512d i10 = _mm512_set_pd(-matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im);
+      __m512d i11 = _mm512_set_pd(-matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im);
+
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
 #endif
-      }
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + __bit_insert(((size_t)k)*len, qubit), e = i + len; i < e; i += 4)
+         {
+            double * p0 = (double*)&state[i + stride0];
+            double * p1 = (double*)&state[i + stride1];
 
-      return 0;
+            __m512d in0 = _mm512_load_pd(p0);
+            __m512d in1 = _mm512_load_pd(p1);
+
+            __m512d o0 = _mm512_mul_pd(r00, in0);
+            o0 = _mm512_fmadd_pd(r01, in1, o0);
+            __m512d o1 = _mm512_mul_pd(r10, in0);
+            o1 = _mm512_fmadd_pd(r11, in1, o1);
+
+            if (!R)
+            {
+               __m512d sw0 = QX_MM512_PERMUTE_PD(in0, 0x55);
+               __m512d sw1 = QX_MM512_PERMUTE_PD(in1, 0x55);
+               o0 = _mm512_fmadd_pd(i00, sw0, o0);
+               o0 = _mm512_fmadd_pd(i01, sw1, o0);
+               o1 = _mm512_fmadd_pd(i10, sw0, o1);
+               o1 = _mm512_fmadd_pd(i11, sw1, o1);
+            }
+
+            _mm512_store_pd(p0, o0);
+            _mm512_store_pd(p1, o1);
+         }
    }
- 
 
-   void sparse_mulmv(uint64_t n, uint64_t qubit, kronecker_iu m, cvector_t& v, cvector_t& res)
+   QX_TARGET_AVX512
+   void __apply_h_avx512(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
    {
-      uint64_t k = n-qubit;
-      uint64_t rows = (1UL << n);
-      uint64_t z = 0;
+      __m512d r = _mm512_set1_pd(matrix[0].re);
 
-#ifdef SEQUENTIAL
-      rw_process_iu(z,rows,1,n,qubit,m,&v,&res);
-#else
-      /*xpu::task rw_t(rw_process_iu,0,0,0,n,qubit,m,&v,&res);
-      xpu::parallel_for process(z,rows,1,&rw_t);
-      process.run();*/
-      rw_process_iu(z,rows,0,n,qubit,m,&v,&res);
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
 #endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + __bit_insert(((size_t)k)*len, qubit), e = i + len; i < e; i += 4)
+         {
+            double * p0 = (double*)&state[i + stride0];
+            double * p1 = (double*)&state[i + stride1];
+            __m512d in0 = _mm512_load_pd(p0);
+            __m512d in1 = _mm512_load_pd(p1);
+            _mm512_store_pd(p0, _mm512_mul_pd(r, _mm512_add_pd(in0, in1)));
+            _mm512_store_pd(p1, _mm512_mul_pd(r, _mm512_sub_pd(in0, in1)));
+         }
    }
-   
-   // static xpu::core::os::mutex mtx;
 
-   uint64_t rw_process_iui(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_iui m, cvector_t * v, cvector_t * res)
+   /**
+    * lowest target qubits (q < 4) : a pair is at most 8 amplitudes apart, so
+    * the generic kernels spend their time in a 1 to 8 iteration inner loop.
+    * these kernels are specialized on the target qubit Q at compile time :
+    * the inner loop is fully unrolled, and when both amplitudes of a pair sit
+    * in the same vector register (q = 0 for avx2, q < 2 for avx-512) the state
+    * is streamed contiguously and the partner amplitude is obtained with a
+    * lane shuffle. they only handle the plain layout (stride0 = 0,
+    * stride1 = 1 << q).
+    *
+    * a single contiguous sweep keeps fewer memory requests in flight than
+    * the two streams (half a state apart) of the higher qubits, so these
+    * kernels walk the quarters of the range together.
+    */
+   inline std::size_t __low_streams(std::size_t len, std::size_t step)
    {
-      uint64_t k = n-qubit;
-      // println("run : " << is << " .. " << ie);
-      complex_t * pv = v->data();
-      complex_t * pr = res->data();
-      size_t bc, c1, c2;
-      size_t nk = n-k;
+      return ((len % (4*step)) ? 1 : 4);
+   }
 
-      for (uint64_t r=is; r<ie; r++) //+=2)
-      {
-         // 1st
-         bc = r;
-         c1 = __bit_reset(bc,nk);
-         c2 = __bit_set(bc,nk);
-         bc++;
-#ifdef __OP_PREFETCH__
-         _mm_prefetch((char*)&pv[__bit_reset(bc,nk)],_MM_HINT_T0);
-         _mm_prefetch((char*)&pv[__bit_set(bc,nk)],_MM_HINT_T0);
-#endif // __OP_PREFETCH__
-#ifdef __AVX__ 
-         // mtx.lock();
-         // cxc : 
-         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
-         // cxr
-         // pr[r].xmm = complex_t::_mm256_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+   template <std::size_t Q, bool R>
+   void __apply_m_low_sse(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      complex_t m00 = matrix[0];
+      complex_t m01 = matrix[1];
+      complex_t m10 = matrix[2];
+      complex_t m11 = matrix[3];
+      __m128d   r00 = _mm_set1_pd(matrix[0].re);
+      __m128d   r01 = _mm_set1_pd(matrix[1].re);
+      __m128d   r10 = _mm_set1_pd(matrix[2].re);
+      __m128d   r11 = _mm_set1_pd(matrix[3].re);
+      const std::size_t d = (1UL << Q);
 
-         /*
-            __m256d a; //_mm256_loadu2_m128d((double*)&pv[c1], (double*)&pv[c2]);
-            a  = _mm256_insertf128_pd(a,_mm_permute_pd(pv[c1].xmm,1), 0);
-            a  = _mm256_insertf128_pd(a,_mm_permute_pd(pv[c2].xmm,1), 1);
-            print("(r="<<r<<") : pr12: "); xpu::dump_m256d(a);
-         // __m256d b  = _mm256_set_m128d((m.get(r,c1)).xmm, (m.get(r,c2)).xmm);
-         __m256d b;
-         b  = _mm256_insertf128_pd(b,_mm_permute_pd(m.get(r,c1).xmm, 1), 1);
-         print("(r="<<r<<") : c1 : "); xpu::dump_m256d(b);
-         b  = _mm256_insertf128_pd(b,_mm_permute_pd(m.get(r,c2).xmm, 1), 0);
-         print("(r="<<r<<") : c2 : "); xpu::dump_m256d(b);
-         __m256d ab  = xpu::_mm256_cmul_pd(a,b);
-         print("(r="<<r<<") : mul: "); xpu::dump_m256d(ab);
-         __m256d abr = _mm256_permute2f128_pd(ab, ab, 1);
-         print("(r="<<r<<") : prm: "); xpu::dump_m256d(abr);
-         ab = _mm256_add_pd(ab,abr);
-         print("(r="<<r<<") : add: "); xpu::dump_m256d(ab);
-         pr[r].xmm = _mm256_extractf128_pd(ab,0);
-         print("(r="<<r<<") : res:"); xpu::dump_m128d(pr[r].xmm);
-         mtx.unlock();
-          */
-#elif  __SSE__
-         /*
-            mtx.lock();
-            print("(r="<<r<<") : pr1: "); xpu::dump_m128d(pv[c1].xmm);
-            print("(r="<<r<<") : pr2: "); xpu::dump_m128d(pv[c2].xmm);
-            print("(r="<<r<<") : c1 : "); xpu::dump_m128d((m.get(r,c1)).xmm);
-            print("(r="<<r<<") : c2 : "); xpu::dump_m128d((m.get(r,c2)).xmm);
-          */
-         // --- cxc mul --- 
-         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
-         // --- cxr mul --- pr[r].xmm = _mm_add_pd(complex_t::mul_cr(pv[c1].xmm,m.get(r,c1).xmm), complex_t::mul_cr(pv[c2].xmm,m.get(r,c2).xmm));
-         // --- fus ma  ---
-         // pr[r].xmm = complex_t::_mm_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+      std::size_t ns   = __low_streams(end - start, 2*d);
+      std::size_t part = (end - start) / ns;
 
-         // pr[r].xmm = xpu::_mm128_mul_add_pc(pv[c1].xmm, pv[c2].xmm, m.get(r,c1).xmm, m.get(r,c2).xmm);
-         /*
-            print("(r="<<r<<") : res: "); xpu::dump_m128d(pr[r].xmm);
-            mtx.unlock();
-          */
-#else
-         pr[r] = (pv[c1]*(m.get(r,c1))) + (pv[c2]*(m.get(r,c2)));
+#ifdef USE_OPENMP
+#pragma omp parallel for
 #endif
-         /*
-         // 2nd
-         c1 = __bit_reset(bc,n-k);
-         c2 = __bit_set(bc,n-k);
-#ifdef __AVX__NO 
-a  = _mm256_loadu2_m128d((double*)&pv[c1], (double*)&pv[c2]);
-         // __m256d b  = _mm256_set_m128d((m.get(r,c1)).xmm, (m.get(r,c2)).xmm);
-         b  = _mm256_insertf128_pd(b,(m.get(bc,c1)).xmm, 1);
-         b  = _mm256_insertf128_pd(b,(m.get(bc,c2)).xmm, 0);
-         ab  = xpu::_mm256_cmul_pd(a,b);
+      for (int64_t o = 0; o < (int64_t)part; o += 2*d)
+         for (std::size_t k = 0, b = start + o; k < ns; k++, b += part)
+            for (std::size_t j = 0; j < d; j++)
+            {
+               if (R)
+               {
+                  __m128d in0 = state[b + j].xmm;
+                  __m128d in1 = state[b + j + d].xmm;
+                  state[b + j].xmm     = _mm_add_pd(_mm_mul_pd(r00, in0), _mm_mul_pd(r01, in1));
+                  state[b + j + d].xmm = _mm_add_pd(_mm_mul_pd(r10, in0), _mm_mul_pd(r11, in1));
+                  continue;
+               }
+               complex_t in0 = state[b + j];
+               complex_t in1 = state[b + j + d];
+               state[b + j]     = m00*in0+m01*in1;
+               state[b + j + d] = m10*in0+m11*in1;
+            }
+   }
+
+   template <std::size_t Q>
+   void __apply_h_low_sse(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      __m128d r = _mm_set1_pd(matrix[0].re);
+      const std::size_t d = (1UL << Q);
+
+      std::size_t ns   = __low_streams(end - start, 2*d);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 2*d)
+         for (std::size_t k = 0, b = start + o; k < ns; k++, b += part)
+            for (std::size_t j = 0; j < d; j++)
+            {
+               __m128d in0 = state[b + j].xmm;
+               __m128d in1 = state[b + j + d].xmm;
+               state[b + j].xmm     = _mm_mul_pd(r, _mm_add_pd(in0, in1));
+               state[b + j + d].xmm = _mm_mul_pd(r, _mm_sub_pd(in0, in1));
+            }
+   }
+
+   template <std::size_t Q, bool R>
+   QX_TARGET_AVX2
+   void __apply_m_low_avx2(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      __m256d r00 = _mm256_set1_pd(matrix[0].re);
+      __m256d r01 = _mm256_set1_pd(matrix[1].re);
+      __m256d r10 = _mm256_set1_pd(matrix[2].re);
+      __m256d r11 = _mm256_set1_pd(matrix[3].re);
+      __m256d i00 = _mm256_set_pd(-matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im);
+      __m256d i01 = _mm256_set_pd(-matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im);
+      __m256d i10 = _mm256_set_pd(-matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im);
+      __m256d i11 = _mm256_set_pd(-matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im);
+      const std::size_t d = (1UL << Q);
+
+      std::size_t ns   = __low_streams(end - start, 2*d);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 2*d)
+         for (std::size_t k = 0, b = start + o; k < ns; k++, b += part)
+            for (std::size_t j = 0; j < d; j += 2)
+            {
+               double * p0 = (double*)&state[b + j];
+               double * p1 = (double*)&state[b + j + d];
+
+               __m256d in0 = _mm256_load_pd(p0);
+               __m256d in1 = _mm256_load_pd(p1);
+
+               __m256d o0 = _mm256_mul_pd(r00, in0);
+               o0 = _mm256_fmadd_pd(r01, in1, o0);
+               __m256d o1 = _mm256_mul_pd(r10, in0);
+               o1 = _mm256_fmadd_pd(r11, in1, o1);
+
+               if (!R)
+               {
+                  __m256d sw0 = _mm256_permute_pd(in0, 0x5);
+                  __m256d sw1 = _mm256_permute_pd(in1, 0x5);
+                  o0 = _mm256_fmadd_pd(i00, sw0, o0);
+                  o0 = _mm256_fmadd_pd(i01, sw1, o0);
+                  o1 = _mm256_fmadd_pd(i10, sw0, o1);
+                  o1 = _mm256_fmadd_pd(i11, sw1, o1);
+               }
+
+               _mm256_store_pd(p0, o0);
+               _mm256_store_pd(p1, o1);
+            }
+   }
+
+   template <std::size_t Q>
+   QX_TARGET_AVX2
+   void __apply_h_low_avx2(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      __m256d r = _mm256_set1_pd(matrix[0].re);
+      const std::size_t d = (1UL << Q);
+
+      std::size_t ns   = __low_streams(end - start, 2*d);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 2*d)
+         for (std::size_t k = 0, b = start + o; k < ns; k++, b += part)
+            for (std::size_t j = 0; j < d; j += 2)
+            {
+               double * p0 = (double*)&state[b + j];
+               double * p1 = (double*)&state[b + j + d];
+               __m256d in0 = _mm256_load_pd(p0);
+               __m256d in1 = _mm256_load_pd(p1);
+               _mm256_store_pd(p0, _mm256_mul_pd(r, _mm256_add_pd(in0, in1)));
+               _mm256_store_pd(p1, _mm256_mul_pd(r, _mm256_sub_pd(in0, in1)));
+            }
+   }
+
+   /**
+    * qubit 0 with avx2 : a register holds one pair (a0 | a1). with
+    * sw = (a1 | a0), the result is A.v + B.sw, A = (m00 | m11), B = (m01 | m10).
+    */
+   template <bool R>
+   QX_TARGET_AVX2
+   void __apply_m_q0_avx2(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      const complex_t& m00 = matrix[0];
+      const complex_t& m01 = matrix[1];
+      const complex_t& m10 = matrix[2];
+      const complex_t& m11 = matrix[3];
+      __m256d ra = _mm256_set_pd(m11.re, m11.re, m00.re, m00.re);
+      __m256d ia = _mm256_set_pd(-m11.im, m11.im, -m00.im, m00.im);
+      __m256d rb = _mm256_set_pd(m10.re, m10.re, m01.re, m01.re);
+      __m256d ib = _mm256_set_pd(-m10.im, m10.im, -m01.im, m01.im);
+
+      std::size_t ns   = __low_streams(end - start, 2);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 2)
+         for (std::size_t k = 0, i = start + o; k < ns; k++, i += part)
+         {
+            double * p  = (double*)&state[i];
+            __m256d  in = _mm256_load_pd(p);
+            __m256d  sw = _mm256_permute2f128_pd(in, in, 0x01);
+            __m256d  o  = _mm256_mul_pd(ra, in);
+            o = _mm256_fmadd_pd(rb, sw, o);
+            if (!R)
+            {
+               o = _mm256_fmadd_pd(ia, _mm256_permute_pd(in, 0x5), o);
+               o = _mm256_fmadd_pd(ib, _mm256_permute_pd(sw, 0x5), o);
+            }
+            _mm256_store_pd(p, o);
+         }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_h_q0_avx2(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      __m256d r = _mm256_set1_pd(matrix[0].re);
+      __m256d s = _mm256_set_pd(-1, -1, 1, 1);
+
+      std::size_t ns   = __low_streams(end - start, 2);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 2)
+         for (std::size_t k = 0, i = start + o; k < ns; k++, i += part)
+         {
+            double * p  = (double*)&state[i];
+            __m256d  in = _mm256_load_pd(p);
+            __m256d  sw = _mm256_permute2f128_pd(in, in, 0x01);
+            _mm256_store_pd(p, _mm256_mul_pd(r, _mm256_fmadd_pd(s, in, sw)));
+         }
+   }
+
+   template <std::size_t Q, bool R>
+   QX_TARGET_AVX512
+   void __apply_m_low_avx512(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      __m512d r00 = _mm512_set1_pd(matrix[0].re);
+      __m512d r01 = _mm512_set1_pd(matrix[1].re);
+      __m512d r10 = _mm512_set1_pd(matrix[2].re);
+      __m512d r11 = _mm512_set1_pd(matrix[3].re);
+      __m512d i00 = _mm512_set_pd(-matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im);
+      __m512d i01 = _mm512_set_pd(-matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im);
+      __m512d i10 = _mm512_set_pd(-matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im);
+      __m512d i11 = _mm512_set_pd(-matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im);
+      const std::size_t d = (1UL << Q);
+
+      std::size_t ns   = __low_streams(end - start, 2*d);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 2*d)
+         for (std::size_t k = 0, b = start + o; k < ns; k++, b += part)
+            for (std::size_t j = 0; j < d; j += 4)
+            {
+               double * p0 = (double*)&state[b + j];
+               double * p1 = (double*)&state[b + j + d];
+
+               __m512d in0 = _mm512_load_pd(p0);
+               __m512d in1 = _mm512_load_pd(p1);
+
+               __m512d o0 = _mm512_mul_pd(r00, in0);
+               o0 = _mm512_fmadd_pd(r01, in1, o0);
+               __m512d o1 = _mm512_mul_pd(r10, in0);
+               o1 = _mm512_fmadd_pd(r11, in1, o1);
+
+               if (!R)
+               {
+                  __m512d sw0 = QX_MM512_PERMUTE_PD(in0, 0x55);
+                  __m512d sw1 = QX_MM512_PERMUTE_PD(in1, 0x55);
+                  o0 = _mm512_fmadd_pd(i00, sw0, o0);
+                  o0 = _mm512_fmadd_pd(i01, sw1, o0);
+                  o1 = _mm512_fmadd_pd(i10, sw0, o1);
+                  o1 = _mm512_fmadd_pd(i11, sw1, o1);
+               }
+
+               _mm512_store_pd(p0, o0);
+               _mm512_store_pd(p1, o1);
+            }
+   }
+
+   template <std::size_t Q>
+   QX_TARGET_AVX512
+   void __apply_h_low_avx512(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      __m512d r = _mm512_set1_pd(matrix[0].re);
+      const std::size_t d = (1UL << Q);
+
+      std::size_t ns   = __low_streams(end - start, 2*d);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 2*d)
+         for (std::size_t k = 0, b = start + o; k < ns; k++, b += part)
+            for (std::size_t j = 0; j < d; j += 4)
+            {
+               double * p0 = (double*)&state[b + j];
+               double * p1 = (double*)&state[b + j + d];
+               __m512d in0 = _mm512_load_pd(p0);
+               __m512d in1 = _mm512_load_pd(p1);
+               _mm512_store_pd(p0, _mm512_mul_pd(r, _mm512_add_pd(in0, in1)));
+               _mm512_store_pd(p1, _mm512_mul_pd(r, _mm512_sub_pd(in0, in1)));
+            }
+   }
+
+   /**
+    * qubits 0 and 1 with avx-512 : a register holds two pairs, the partner of
+    * each amplitude is obtained by swapping 128-bit lanes (q = 0) or 256-bit
+    * halves (q = 1). A and B hold m00/m01 in the lanes where bit q is clear
+    * and m11/m10 in the others.
+    */
+   template <std::size_t Q, bool R>
+   QX_TARGET_AVX512
+   void __apply_m_inreg_avx512(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      QX_ALIGNED(64) double a[4][8];   // re(A), (im,-im)(A), re(B), (im,-im)(B)
+      for (std::size_t l = 0; l < 4; l++)
+      {
+         const complex_t& ca = matrix[((l >> Q) & 1) ? 3 : 0];
+         const complex_t& cb = matrix[((l >> Q) & 1) ? 2 : 1];
+         a[0][2*l] = ca.re;  a[0][2*l+1] = ca.re;
+         a[1][2*l] = ca.im;  a[1][2*l+1] = -ca.im;
+         a[2][2*l] = cb.re;  a[2][2*l+1] = cb.re;
+         a[3][2*l] = cb.im;  a[3][2*l+1] = -cb.im;
+      }
+      __m512d ra = _mm512_load_pd(a[0]);
+      __m512d ia = _mm512_load_pd(a[1]);
+      __m512d rb = _mm512_load_pd(a[2]);
+      __m512d ib = _mm512_load_pd(a[3]);
+
+      std::size_t ns   = __low_streams(end - start, 4);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 4)
+         for (std::size_t k = 0, i = start + o; k < ns; k++, i += part)
+         {
+            double * p  = (double*)&state[i];
+            __m512d  in = _mm512_load_pd(p);
+            __m512d  sw = QX_MM512_SHUFFLE_F64X2(in, in, (Q == 0 ? 0xB1 : 0x4E));
+            __m512d  o  = _mm512_mul_pd(ra, in);
+            o = _mm512_fmadd_pd(rb, sw, o);
+            if (!R)
+            {
+               o = _mm512_fmadd_pd(ia, QX_MM512_PERMUTE_PD(in, 0x55), o);
+               o = _mm512_fmadd_pd(ib, QX_MM512_PERMUTE_PD(sw, 0x55), o);
+            }
+            _mm512_store_pd(p, o);
+         }
+   }
+
+   template <std::size_t Q>
+   QX_TARGET_AVX512
+   void __apply_h_inreg_avx512(std::size_t start, std::size_t end, complex_t * state, const complex_t * matrix)
+   {
+      __m512d r = _mm512_set1_pd(matrix[0].re);
+      __m512d s = (Q == 0 ? _mm512_set_pd(-1, -1, 1, 1, -1, -1, 1, 1) : _mm512_set_pd(-1, -1, -1, -1, 1, 1, 1, 1));
+
+      std::size_t ns   = __low_streams(end - start, 4);
+      std::size_t part = (end - start) / ns;
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t o = 0; o < (int64_t)part; o += 4)
+         for (std::size_t k = 0, i = start + o; k < ns; k++, i += part)
+         {
+            double * p  = (double*)&state[i];
+            __m512d  in = _mm512_load_pd(p);
+            __m512d  sw = QX_MM512_SHUFFLE_F64X2(in, in, (Q == 0 ? 0xB1 : 0x4E));
+            _mm512_store_pd(p, _mm512_mul_pd(r, _mm512_fmadd_pd(s, in, sw)));
+         }
+   }
+
+   template <bool R>
+   void __apply_m_low(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const complex_t * matrix)
+   {
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && ((end - start) >= 4))
+      {
+         switch (qubit)
+         {
+            case 0:  __apply_m_inreg_avx512<0, R>(start, end, state, matrix); return;
+            case 1:  __apply_m_inreg_avx512<1, R>(start, end, state, matrix); return;
+            case 2:  __apply_m_low_avx512<2, R>(start, end, state, matrix); return;
+            default: __apply_m_low_avx512<3, R>(start, end, state, matrix); return;
+         }
+      }
+      else if (simd >= xpu::simd_level::avx2)
+      {
+         switch (qubit)
+         {
+            case 0:  __apply_m_q0_avx2<R>(start, end, state, matrix); return;
+            case 1:  __apply_m_low_avx2<1, R>(start, end, state, matrix); return;
+            case 2:  __apply_m_low_avx2<2, R>(start, end, state, matrix); return;
+            default: __apply_m_low_avx2<3, R>(start, end, state, matrix); return;
+         }
+      }
+      switch (qubit)
+      {
+         case 0:  __apply_m_low_sse<0, R>(start, end, state, matrix); return;
+         case 1:  __apply_m_low_sse<1, R>(start, end, state, matrix); return;
+         case 2:  __apply_m_low_sse<2, R>(start, end, state, matrix); return;
+         default: __apply_m_low_sse<3, R>(start, end, state, matrix); return;
+      }
+   }
+
+   void __apply_m_low(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const complex_t * matrix)
+   {
+      if (__is_real(matrix))
+         __apply_m_low<true>(start, end, qubit, state, matrix);
+      else
+         __apply_m_low<false>(start, end, qubit, state, matrix);
+   }
+
+   void __apply_h_low(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const complex_t * matrix)
+   {
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && ((end - start) >= 4))
+      {
+         switch (qubit)
+         {
+            case 0:  __apply_h_inreg_avx512<0>(start, end, state, matrix); return;
+            case 1:  __apply_h_inreg_avx512<1>(start, end, state, matrix); return;
+            case 2:  __apply_h_low_avx512<2>(start, end, state, matrix); return;
+            default: __apply_h_low_avx512<3>(start, end, state, matrix); return;
+         }
+      }
+      else if (simd >= xpu::simd_level::avx2)
+      {
+         switch (qubit)
+         {
+            case 0:  __apply_h_q0_avx2(start, end, state, matrix); return;
+            case 1:  __apply_h_low_avx2<1>(start, end, state, matrix); return;
+            case 2:  __apply_h_low_avx2<2>(start, end, state, matrix); return;
+            default: __apply_h_low_avx2<3>(start, end, state, matrix); return;
+         }
+      }
+      switch (qubit)
+      {
+         case 0:  __apply_h_low_sse<0>(start, end, state, matrix); return;
+         case 1:  __apply_h_low_sse<1>(start, end, state, matrix); return;
+         case 2:  __apply_h_low_sse<2>(start, end, state, matrix); return;
+         default: __apply_h_low_sse<3>(start, end, state, matrix); return;
+      }
+   }
+
+   /**
+    * runtime dispatch : the widest kernel supported by the host cpu
+    * (see xpu::host_simd_level()) whose register holds no more than one
+    * half of an amplitude block.
+    */
+   void __apply_m(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
+   {
+      xpu::simd_level simd = xpu::host_simd_level();
+      bool            real = __is_real(matrix);
+      if ((qubit < 4) && (stride0 == 0) && (stride1 == (1UL << qubit)))
+         __apply_m_low(start, end, qubit, state, matrix);
+      else if ((simd >= xpu::simd_level::avx512) && (qubit >= 2))
+      {
+         if (real) __apply_m_avx512<true>(start, end, qubit, state, stride0, stride1, matrix);
+         else      __apply_m_avx512<false>(start, end, qubit, state, stride0, stride1, matrix);
+      }
+      else if ((simd >= xpu::simd_level::avx2) && (qubit >= 1))
+      {
+         if (real) __apply_m_avx2<true>(start, end, qubit, state, stride0, stride1, matrix);
+         else      __apply_m_avx2<false>(start, end, qubit, state, stride0, stride1, matrix);
+      }
+      else
+      {
+         if (real) __apply_m_sse<true>(start, end, qubit, state, stride0, stride1, matrix);
+         else      __apply_m_sse<false>(start, end, qubit, state, stride0, stride1, matrix);
+      }
+   }
+
+   void __apply_h(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const std::size_t stride0, const std::size_t stride1, const complex_t * matrix)
+   {
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((qubit < 4) && (stride0 == 0) && (stride1 == (1UL << qubit)))
+         __apply_h_low(start, end, qubit, state, matrix);
+      else if ((simd >= xpu::simd_level::avx512) && (qubit >= 2))
+         __apply_h_avx512(start, end, qubit, state, stride0, stride1, matrix);
+      else if ((simd >= xpu::simd_level::avx2) && (qubit >= 1))
+         __apply_h_avx2(start, end, qubit, state, stride0, stride1, matrix);
+      else
+         __apply_h_sse(start, end, qubit, state, stride0, stride1, matrix);
+   }
+
+   /**
+    * diagonal gates diag(1,p) : only the half of the state where the target
+    * qubit is set is read and written, with one complex multiply per
+    * amplitude (z-type gates only flip the sign bits).
+    */
+   void __apply_phase_sse(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const complex_t phase)
+   {
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + (__bit_insert(((size_t)k)*len, qubit) | (1UL << qubit)), e = i + len; i < e; i++)
+            state[i] = state[i]*phase;
+   }
+
+   void __apply_z_sse(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state)
+   {
+      __m128d neg = _mm_set1_pd(-0.0);
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + (__bit_insert(((size_t)k)*len, qubit) | (1UL << qubit)), e = i + len; i < e; i++)
+            state[i].xmm = _mm_xor_pd(state[i].xmm, neg);
+   }
+
+   QX_TARGET_AVX2
+   void __apply_phase_avx2(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const complex_t phase)
+   {
+      __m256d pr = _mm256_set1_pd(phase.re);
+      __m256d pi = _mm256_set_pd(-phase.im, phase.im, -phase.im, phase.im);
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + (__bit_insert(((size_t)k)*len, qubit) | (1UL << qubit)), e = i + len; i < e; i += 2)
+         {
+            double * p = (double*)&state[i];
+            __m256d in = _mm256_load_pd(p);
+            __m256d sw = _mm256_permute_pd(in, 0x5);
+            _mm256_store_pd(p, _mm256_fmadd_pd(pi, sw, _mm256_mul_pd(pr, in)));
+         }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_z_avx2(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state)
+   {
+      __m256d neg = _mm256_set1_pd(-0.0);
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + (__bit_insert(((size_t)k)*len, qubit) | (1UL << qubit)), e = i + len; i < e; i += 2)
+         {
+            double * p = (double*)&state[i];
+            _mm256_store_pd(p, _mm256_xor_pd(_mm256_load_pd(p), neg));
+         }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_phase_avx512(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const complex_t phase)
+   {
+      __m512d pr = _mm512_set1_pd(phase.re);
+      __m512d pi = _mm512_set_pd(-phase.im, phase.im, -phase.im, phase.im, -phase.im, phase.im, -phase.im, phase.im);
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + (__bit_insert(((size_t)k)*len, qubit) | (1UL << qubit)), e = i + len; i < e; i += 4)
+         {
+            double * p = (double*)&state[i];
+            __m512d in = _mm512_load_pd(p);
+            __m512d sw = QX_MM512_PERMUTE_PD(in, 0x55);
+            _mm512_store_pd(p, _mm512_fmadd_pd(pi, sw, _mm512_mul_pd(pr, in)));
+         }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_z_avx512(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state)
+   {
+      __m512i neg = _mm512_set1_epi64((int64_t)0x8000000000000000ULL);
+      size_t  len  = __run_length((end - start) >> 1, (1UL << qubit));
+      int64_t runs = (int64_t)(((end - start) >> 1) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for(int64_t k = 0; k < runs; k++)
+         for(size_t i = start + (__bit_insert(((size_t)k)*len, qubit) | (1UL << qubit)), e = i + len; i < e; i += 4)
+         {
+            double * p = (double*)&state[i];
+            __m512i in = _mm512_castpd_si512(_mm512_load_pd(p));
+            _mm512_store_pd(p, _mm512_castsi512_pd(_mm512_xor_si512(in, neg)));
+         }
+   }
+
+   void __apply_phase(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state, const complex_t phase)
+   {
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (qubit >= 2))
+         __apply_phase_avx512(start, end, qubit, state, phase);
+      else if ((simd >= xpu::simd_level::avx2) && (qubit >= 1))
+         __apply_phase_avx2(start, end, qubit, state, phase);
+      else
+         __apply_phase_sse(start, end, qubit, state, phase);
+   }
+
+   void __apply_z(std::size_t start, std::size_t end, const std::size_t qubit, complex_t * state)
+   {
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (qubit >= 2))
+         __apply_z_avx512(start, end, qubit, state);
+      else if ((simd >= xpu::simd_level::avx2) && (qubit >= 1))
+         __apply_z_avx2(start, end, qubit, state);
+      else
+         __apply_z_sse(start, end, qubit, state);
+   }
+
+   /**
+    * controlled-z : negates the quarter of the state where both qubits are
+    * set. the amplitudes are visited as contiguous runs of at most 2^lo, cut
+    * by __run_length() so that parallelism does not depend on how high the
+    * qubits are.
+    */
+   void __apply_cz_sse(std::size_t n, std::size_t lo, std::size_t hi, complex_t * state)
+   {
+      __m128d neg = _mm_set1_pd(-0.0);
+      size_t  len  = __run_length((1UL << (n - 2)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 2)) / len);
+      size_t  set  = (1UL << lo) | (1UL << hi);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __bit_insert(__bit_insert(((size_t)r)*len, lo), hi) | set;
+         for (size_t i = base; i < base + len; i++)
+            state[i].xmm = _mm_xor_pd(state[i].xmm, neg);
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_cz_avx2(std::size_t n, std::size_t lo, std::size_t hi, complex_t * state)
+   {
+      __m256d neg = _mm256_set1_pd(-0.0);
+      size_t  len  = __run_length((1UL << (n - 2)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 2)) / len);
+      size_t  set  = (1UL << lo) | (1UL << hi);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __bit_insert(__bit_insert(((size_t)r)*len, lo), hi) | set;
+         for (size_t i = base; i < base + len; i += 2)
+         {
+            double * p = (double*)&state[i];
+            _mm256_store_pd(p, _mm256_xor_pd(_mm256_load_pd(p), neg));
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_cz_avx512(std::size_t n, std::size_t lo, std::size_t hi, complex_t * state)
+   {
+      __m512i neg = _mm512_set1_epi64((int64_t)0x8000000000000000ULL);
+      size_t  len  = __run_length((1UL << (n - 2)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 2)) / len);
+      size_t  set  = (1UL << lo) | (1UL << hi);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __bit_insert(__bit_insert(((size_t)r)*len, lo), hi) | set;
+         for (size_t i = base; i < base + len; i += 4)
+         {
+            double * p = (double*)&state[i];
+            __m512i in = _mm512_castpd_si512(_mm512_load_pd(p));
+            _mm512_store_pd(p, _mm512_castsi512_pd(_mm512_xor_si512(in, neg)));
+         }
+      }
+   }
+
+   void __apply_cz(std::size_t n, std::size_t q0, std::size_t q1, complex_t * state)
+   {
+      std::size_t lo = std::min(q0, q1);
+      std::size_t hi = std::max(q0, q1);
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (lo >= 2))
+         __apply_cz_avx512(n, lo, hi, state);
+      else if ((simd >= xpu::simd_level::avx2) && (lo >= 1))
+         __apply_cz_avx2(n, lo, hi, state);
+      else
+         __apply_cz_sse(n, lo, hi, state);
+   }
+
+   /**
+    * controlled phase : multiplies the quarter of the state where both qubits
+    * are set by p, visited in the same runs as __apply_cz.
+    */
+   void __apply_cphase_sse(std::size_t n, std::size_t lo, std::size_t hi, complex_t * state, const complex_t phase)
+   {
+      size_t  len  = __run_length((1UL << (n - 2)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 2)) / len);
+      size_t  set  = (1UL << lo) | (1UL << hi);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __bit_insert(__bit_insert(((size_t)r)*len, lo), hi) | set;
+         for (size_t i = base; i < base + len; i++)
+            state[i] = state[i]*phase;
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_cphase_avx2(std::size_t n, std::size_t lo, std::size_t hi, complex_t * state, const complex_t phase)
+   {
+      __m256d pr = _mm256_set1_pd(phase.re);
+      __m256d pi = _mm256_set_pd(-phase.im, phase.im, -phase.im, phase.im);
+      size_t  len  = __run_length((1UL << (n - 2)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 2)) / len);
+      size_t  set  = (1UL << lo) | (1UL << hi);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __bit_insert(__bit_insert(((size_t)r)*len, lo), hi) | set;
+         for (size_t i = base; i < base + len; i += 2)
+         {
+            double * p = (double*)&state[i];
+            __m256d in = _mm256_load_pd(p);
+            __m256d sw = _mm256_permute_pd(in, 0x5);
+            _mm256_store_pd(p, _mm256_fmadd_pd(pi, sw, _mm256_mul_pd(pr, in)));
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_cphase_avx512(std::size_t n, std::size_t lo, std::size_t hi, complex_t * state, const complex_t phase)
+   {
+      __m512d pr = _mm512_set1_pd(phase.re);
+      __m512d pi = _mm512_set_pd(-phase.im, phase.im, -phase.im, phase.im, -phase.im, phase.im, -phase.im, phase.im);
+      size_t  len  = __run_length((1UL << (n - 2)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 2)) / len);
+      size_t  set  = (1UL << lo) | (1UL << hi);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __bit_insert(__bit_insert(((size_t)r)*len, lo), hi) | set;
+         for (size_t i = base; i < base + len; i += 4)
+         {
+            double * p = (double*)&state[i];
+            __m512d in = _mm512_load_pd(p);
+            __m512d sw = QX_MM512_PERMUTE_PD(in, 0x55);
+            _mm512_store_pd(p, _mm512_fmadd_pd(pi, sw, _mm512_mul_pd(pr, in)));
+         }
+      }
+   }
+
+   void __apply_cphase(std::size_t n, std::size_t q0, std::size_t q1, complex_t * state, const complex_t phase)
+   {
+      std::size_t lo = std::min(q0, q1);
+      std::size_t hi = std::max(q0, q1);
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (lo >= 2))
+         __apply_cphase_avx512(n, lo, hi, state, phase);
+      else if ((simd >= xpu::simd_level::avx2) && (lo >= 1))
+         __apply_cphase_avx2(n, lo, hi, state, phase);
+      else
+         __apply_cphase_sse(n, lo, hi, state, phase);
+   }
+
+   /**
+    * multi-controlled 2x2 gates : the 2^(n-k-1) amplitude pairs with every
+    * control set are enumerated by inserting the fixed (control and target)
+    * bits into a flat index, in ascending order of position. like the other
+    * two-qubit kernels, pairs come in contiguous runs of at most 2^lo
+    * amplitudes, lo being the lowest fixed bit (see __run_length()).
+    */
+   inline size_t __insert_bits(size_t x, const size_t * pos, size_t count)
+   {
+      for (size_t i = 0; i < count; i++)
+         x = __bit_insert(x, pos[i]);
+      return x;
+   }
+
+   void __apply_mc_m_sse(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, const complex_t * matrix)
+   {
+      complex_t m00 = matrix[0];
+      complex_t m01 = matrix[1];
+      complex_t m10 = matrix[2];
+      complex_t m11 = matrix[3];
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         complex_t * a = state + base;
+         complex_t * b = state + (base | (1UL << target));
+         for (size_t i = 0; i < len; i++)
+         {
+            complex_t in0 = a[i];
+            complex_t in1 = b[i];
+            a[i] = m00*in0+m01*in1;
+            b[i] = m10*in0+m11*in1;
+         }
+      }
+   }
+
+   void __apply_mc_x_sse(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state)
+   {
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         complex_t * a = state + base;
+         complex_t * b = state + (base | (1UL << target));
+         for (size_t i = 0; i < len; i++)
+         {
+            __m128d t = a[i].xmm;
+            a[i].xmm = b[i].xmm;
+            b[i].xmm = t;
+         }
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_mc_m_avx2(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, const complex_t * matrix)
+   {
+      __m256d r00 = _mm256_set1_pd(matrix[0].re);
+      __m256d r01 = _mm256_set1_pd(matrix[1].re);
+      __m256d r10 = _mm256_set1_pd(matrix[2].re);
+      __m256d r11 = _mm256_set1_pd(matrix[3].re);
+      __m256d i00 = _mm256_set_pd(-matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im);
+      __m256d i01 = _mm256_set_pd(-matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im);
+      __m256d i10 = _mm256_set_pd(-matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im);
+      __m256d i11 = _mm256_set_pd(-matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im);
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base | (1UL << target)));
+         for (size_t i = 0; i < 2*len; i += 4)
+         {
+            __m256d in0 = _mm256_load_pd(a + i);
+            __m256d in1 = _mm256_load_pd(b + i);
+            __m256d sw0 = _mm256_permute_pd(in0, 0x5);
+            __m256d sw1 = _mm256_permute_pd(in1, 0x5);
+
+            __m256d o0 = _mm256_mul_pd(r00, in0);
+            o0 = _mm256_fmadd_pd(i00, sw0, o0);
+            o0 = _mm256_fmadd_pd(r01, in1, o0);
+            o0 = _mm256_fmadd_pd(i01, sw1, o0);
+
+            __m256d o1 = _mm256_mul_pd(r10, in0);
+            o1 = _mm256_fmadd_pd(i10, sw0, o1);
+            o1 = _mm256_fmadd_pd(r11, in1, o1);
+            o1 = _mm256_fmadd_pd(i11, sw1, o1);
+
+            _mm256_store_pd(a + i, o0);
+            _mm256_store_pd(b + i, o1);
+         }
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_mc_x_avx2(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, std::size_t lmask)
+   {
+      int64_t s0 = ((0 & lmask) == lmask) ? -1 : 0;
+      int64_t s1 = ((1 & lmask) == lmask) ? -1 : 0;
+      __m256d sel = _mm256_castsi256_pd(_mm256_set_epi64x(s1, s1, s0, s0));
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base | (1UL << target)));
+         for (size_t i = 0; i < 2*len; i += 4)
+         {
+            __m256d in0 = _mm256_load_pd(a + i);
+            __m256d in1 = _mm256_load_pd(b + i);
+            _mm256_store_pd(a + i, _mm256_blendv_pd(in0, in1, sel));
+            _mm256_store_pd(b + i, _mm256_blendv_pd(in1, in0, sel));
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_mc_m_avx512(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, const complex_t * matrix)
+   {
+      __m512d r00 = _mm512_set1_pd(matrix[0].re);
+      __m512d r01 = _mm512_set1_pd(matrix[1].re);
+      __m512d r10 = _mm512_set1_pd(matrix[2].re);
+      __m512d r11 = _mm512_set1_pd(matrix[3].re);
+      __m512d i00 = _mm512_set_pd(-matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im, -matrix[0].im, matrix[0].im);
+      __m512d i01 = _mm512_set_pd(-matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im, -matrix[1].im, matrix[1].im);
+      __m512d i10 = _mm512_set_pd(-matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im, -matrix[2].im, matrix[2].im);
+      __m512d i11 = _mm512_set_pd(-matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im, -matrix[3].im, matrix[3].im);
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base | (1UL << target)));
+         for (size_t i = 0; i < 2*len; i += 8)
+         {
+            __m512d in0 = _mm512_load_pd(a + i);
+            __m512d in1 = _mm512_load_pd(b + i);
+            __m512d sw0 = QX_MM512_PERMUTE_PD(in0, 0x55);
+            __m512d sw1 = QX_MM512_PERMUTE_PD(in1, 0x55);
+
+            __m512d o0 = _mm512_mul_pd(r00, in0);
+            o0 = _mm512_fmadd_pd(i00, sw0, o0);
+            o0 = _mm512_fmadd_pd(r01, in1, o0);
+            o0 = _mm512_fmadd_pd(i01, sw1, o0);
+
+            __m512d o1 = _mm512_mul_pd(r10, in0);
+            o1 = _mm512_fmadd_pd(i10, sw0, o1);
+            o1 = _mm512_fmadd_pd(r11, in1, o1);
+            o1 = _mm512_fmadd_pd(i11, sw1, o1);
+
+            _mm512_store_pd(a + i, o0);
+            _mm512_store_pd(b + i, o1);
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_mc_x_avx512(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, std::size_t lmask)
+   {
+      __mmask8 sel = 0;
+      for (size_t l = 0; l < 4; l++)
+         if ((l & lmask) == lmask)
+            sel |= (__mmask8)(3 << (2*l));
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base | (1UL << target)));
+         for (size_t i = 0; i < 2*len; i += 8)
+         {
+            __m512d in0 = _mm512_load_pd(a + i);
+            __m512d in1 = _mm512_load_pd(b + i);
+            _mm512_store_pd(a + i, _mm512_mask_blend_pd(sel, in0, in1));
+            _mm512_store_pd(b + i, _mm512_mask_blend_pd(sel, in1, in0));
+         }
+      }
+   }
+
+   /**
+    * monomial 2x2 gates (x, y, and any anti-diagonal matrix) : the pairs are
+    * exchanged and multiplied by their phase in the same pass,
+    * a' = p0.b and b' = p1.a, with no other arithmetic. in the avx kernels,
+    * controls on the qubits held within one register (lmask) select lanes
+    * with a blend instead of cutting the runs down to single amplitudes.
+    */
+   void __apply_mc_p_sse(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, const complex_t p0, const complex_t p1)
+   {
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         complex_t * a = state + base;
+         complex_t * b = state + (base | (1UL << target));
+         for (size_t i = 0; i < len; i++)
+         {
+            complex_t t = a[i];
+            a[i] = p0*b[i];
+            b[i] = p1*t;
+         }
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_mc_p_avx2(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, const complex_t p0, const complex_t p1, std::size_t lmask)
+   {
+      int64_t s0 = ((0 & lmask) == lmask) ? -1 : 0;
+      int64_t s1 = ((1 & lmask) == lmask) ? -1 : 0;
+      __m256d sel = _mm256_castsi256_pd(_mm256_set_epi64x(s1, s1, s0, s0));
+      __m256d r0 = _mm256_set1_pd(p0.re);
+      __m256d i0 = _mm256_set_pd(-p0.im, p0.im, -p0.im, p0.im);
+      __m256d r1 = _mm256_set1_pd(p1.re);
+      __m256d i1 = _mm256_set_pd(-p1.im, p1.im, -p1.im, p1.im);
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base | (1UL << target)));
+         for (size_t i = 0; i < 2*len; i += 4)
+         {
+            __m256d in0 = _mm256_load_pd(a + i);
+            __m256d in1 = _mm256_load_pd(b + i);
+            __m256d o0  = _mm256_fmadd_pd(i0, _mm256_permute_pd(in1, 0x5), _mm256_mul_pd(r0, in1));
+            __m256d o1  = _mm256_fmadd_pd(i1, _mm256_permute_pd(in0, 0x5), _mm256_mul_pd(r1, in0));
+            _mm256_store_pd(a + i, _mm256_blendv_pd(in0, o0, sel));
+            _mm256_store_pd(b + i, _mm256_blendv_pd(in1, o1, sel));
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_mc_p_avx512(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t target, complex_t * state, const complex_t p0, const complex_t p1, std::size_t lmask)
+   {
+      __mmask8 sel = 0;
+      for (size_t l = 0; l < 4; l++)
+         if ((l & lmask) == lmask)
+            sel |= (__mmask8)(3 << (2*l));
+      __m512d r0 = _mm512_set1_pd(p0.re);
+      __m512d i0 = _mm512_set_pd(-p0.im, p0.im, -p0.im, p0.im, -p0.im, p0.im, -p0.im, p0.im);
+      __m512d r1 = _mm512_set1_pd(p1.re);
+      __m512d i1 = _mm512_set_pd(-p1.im, p1.im, -p1.im, p1.im, -p1.im, p1.im, -p1.im, p1.im);
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base | (1UL << target)));
+         for (size_t i = 0; i < 2*len; i += 8)
+         {
+            __m512d in0 = _mm512_load_pd(a + i);
+            __m512d in1 = _mm512_load_pd(b + i);
+            __m512d o0  = _mm512_fmadd_pd(i0, QX_MM512_PERMUTE_PD(in1, 0x55), _mm512_mul_pd(r0, in1));
+            __m512d o1  = _mm512_fmadd_pd(i1, QX_MM512_PERMUTE_PD(in0, 0x55), _mm512_mul_pd(r1, in0));
+            _mm512_store_pd(a + i, _mm512_mask_blend_pd(sel, in0, o0));
+            _mm512_store_pd(b + i, _mm512_mask_blend_pd(sel, in1, o1));
+         }
+      }
+   }
+
+   /**
+    * applies matrix (row-major 2x2) to target when all ctrls are set. an
+    * anti-diagonal matrix is a monomial gate : an exact pauli-x matrix only
+    * swaps amplitudes, other phases are applied while swapping.
+    */
+   void __apply_mc(std::size_t n, const std::vector<uint64_t>& ctrls, std::size_t target, complex_t * state, const complex_t * matrix)
+   {
+      // an uncontrolled gate on qubit 0 has no contiguous runs : its pairs
+      // are swapped within vector registers instead
+      if (ctrls.empty() && (target == 0))
+      {
+         __apply_m_low(0, (1UL << n), 0, state, matrix);
+         return;
+      }
+
+      std::vector<size_t> fixed(ctrls.begin(), ctrls.end());
+      fixed.push_back(target);
+      std::sort(fixed.begin(), fixed.end());
+      size_t cmask = 0;
+      for (size_t i = 0; i < ctrls.size(); i++)
+         cmask |= (1UL << ctrls[i]);
+
+      bool p = (matrix[0] == complex_t(0.0, 0.0)) && (matrix[3] == complex_t(0.0, 0.0));
+      bool x = p && (matrix[1] == complex_t(1.0, 0.0)) && (matrix[2] == complex_t(1.0, 0.0));
+
+      xpu::simd_level simd = xpu::host_simd_level();
+      // monomial gates : the controls below w (2^w amplitudes per register)
+      // become a lane mask, the runs are then cut by the target and the
+      // higher controls only
+      size_t w = 0;
+      if (p && (simd >= xpu::simd_level::avx512) && (target >= 2))
+         w = 2;
+      else if (p && (simd >= xpu::simd_level::avx2) && (target >= 1))
+         w = 1;
+      size_t lmask = cmask & ((1UL << w) - 1);
+      if (lmask)
+      {
+         fixed.erase(fixed.begin(), std::lower_bound(fixed.begin(), fixed.end(), w));
+         cmask ^= lmask;
+      }
+      size_t lo = fixed[0];
+
+      if ((simd >= xpu::simd_level::avx512) && (lo >= 2))
+      {
+         if (x)      __apply_mc_x_avx512(n, fixed.data(), fixed.size(), cmask, target, state, lmask);
+         else if (p) __apply_mc_p_avx512(n, fixed.data(), fixed.size(), cmask, target, state, matrix[1], matrix[2], lmask);
+         else        __apply_mc_m_avx512(n, fixed.data(), fixed.size(), cmask, target, state, matrix);
+      }
+      else if ((simd >= xpu::simd_level::avx2) && (lo >= 1))
+      {
+         if (x)      __apply_mc_x_avx2(n, fixed.data(), fixed.size(), cmask, target, state, lmask);
+         else if (p) __apply_mc_p_avx2(n, fixed.data(), fixed.size(), cmask, target, state, matrix[1], matrix[2], lmask);
+         else        __apply_mc_m_avx2(n, fixed.data(), fixed.size(), cmask, target, state, matrix);
+      }
+      else
+      {
+         if (x)      __apply_mc_x_sse(n, fixed.data(), fixed.size(), cmask, target, state);
+         else if (p) __apply_mc_p_sse(n, fixed.data(), fixed.size(), cmask, target, state, matrix[1], matrix[2]);
+         else        __apply_mc_m_sse(n, fixed.data(), fixed.size(), cmask, target, state, matrix);
+      }
+   }
+
+   /**
+    * dense k-qubit operator : each group of 2^k amplitudes that only differ in
+    * the target qubits is gathered, multiplied by the 2^k x 2^k matrix (bit i
+    * of the local index being qubits[i]) and scattered back. the group and
+    * the matrix (at most 16x16 for the specialized sizes) stay in L1.
+    */
+   template<size_t K>
+   void __apply_dense_k(std::size_t n, const size_t * fixed, const size_t * off, complex_t * state, const complex_t * matrix)
+   {
+      const size_t D = (1UL << K);
+      int64_t groups = (int64_t)(1UL << (n - K));
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t g = 0; g < groups; g++)
+      {
+         complex_t in[D];
+         size_t base = __insert_bits((size_t)g, fixed, K);
+         for (size_t j = 0; j < D; j++)
+            in[j] = state[base + off[j]];
+         for (size_t r = 0; r < D; r++)
+         {
+            const complex_t * row = matrix + r*D;
+            complex_t acc(0.0, 0.0);
+            for (size_t c = 0; c < D; c++)
+               acc += row[c]*in[c];
+            state[base + off[r]] = acc;
+         }
+      }
+   }
+
+   void __apply_dense_n(std::size_t n, std::size_t k, const size_t * fixed, const size_t * off, complex_t * state, const complex_t * matrix)
+   {
+      size_t d = (1UL << k);
+      int64_t groups = (int64_t)(1UL << (n - k));
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t g = 0; g < groups; g++)
+      {
+         complex_t in[64];
+         size_t base = __insert_bits((size_t)g, fixed, k);
+         for (size_t j = 0; j < d; j++)
+            in[j] = state[base + off[j]];
+         for (size_t r = 0; r < d; r++)
+         {
+            const complex_t * row = matrix + r*d;
+            complex_t acc(0.0, 0.0);
+            for (size_t c = 0; c < d; c++)
+               acc += row[c]*in[c];
+            state[base + off[r]] = acc;
+         }
+      }
+   }
+
+   /**
+    * applies a dense operator on 2 to 6 qubits
+    */
+   void __apply_dense(std::size_t n, const std::vector<uint64_t>& qubits, complex_t * state, const complex_t * matrix)
+   {
+      size_t k = qubits.size();
+      size_t d = (1UL << k);
+      assert(k <= 6);
+      std::vector<size_t> fixed(qubits.begin(), qubits.end());
+      std::sort(fixed.begin(), fixed.end());
+      std::vector<size_t> off(d, 0);
+      for (size_t j = 0; j < d; j++)
+         for (size_t i = 0; i < k; i++)
+            if ((j >> i) & 1)
+               off[j] |= (1UL << qubits[i]);
+
+      switch (k)
+      {
+         case 2  : __apply_dense_k<2>(n, fixed.data(), off.data(), state, matrix); break;
+         case 3  : __apply_dense_k<3>(n, fixed.data(), off.data(), state, matrix); break;
+         case 4  : __apply_dense_k<4>(n, fixed.data(), off.data(), state, matrix); break;
+         default : __apply_dense_n(n, k, fixed.data(), off.data(), state, matrix); break;
+      }
+   }
+
+   /**
+    * swap : exchanges the |01> and |10> blocks in a single pass, |00> and
+    * |11> are not touched. with controls (fredkin), only the blocks where
+    * every control is set move. the blocks are runs of at most 2^lo
+    * contiguous amplitudes, lo being the lowest fixed bit, moved with
+    * full-width loads and stores when lo is high enough.
+    */
+   void __apply_mc_swap_sse(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t q0, std::size_t q1, complex_t * state)
+   {
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         complex_t * a = state + (base | (1UL << q0));
+         complex_t * b = state + (base | (1UL << q1));
+         for (size_t i = 0; i < len; i++)
+         {
+            __m128d t = a[i].xmm;
+            a[i].xmm = b[i].xmm;
+            b[i].xmm = t;
+         }
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_mc_swap_avx2(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t q0, std::size_t q1, complex_t * state)
+   {
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + (base | (1UL << q0)));
+         double * b = (double*)(state + (base | (1UL << q1)));
+         for (size_t i = 0; i < 2*len; i += 4)
+         {
+            __m256d t = _mm256_load_pd(a + i);
+            _mm256_store_pd(a + i, _mm256_load_pd(b + i));
+            _mm256_store_pd(b + i, t);
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_mc_swap_avx512(std::size_t n, const std::size_t * fixed, std::size_t nfixed, std::size_t cmask, std::size_t q0, std::size_t q1, complex_t * state)
+   {
+      size_t  len  = __run_length((1UL << (n - nfixed)), (1UL << fixed[0]));
+      int64_t runs = (int64_t)((1UL << (n - nfixed)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t base = __insert_bits(((size_t)r)*len, fixed, nfixed) | cmask;
+         double * a = (double*)(state + (base | (1UL << q0)));
+         double * b = (double*)(state + (base | (1UL << q1)));
+         for (size_t i = 0; i < 2*len; i += 8)
+         {
+            __m512d t = _mm512_load_pd(a + i);
+            _mm512_store_pd(a + i, _mm512_load_pd(b + i));
+            _mm512_store_pd(b + i, t);
+         }
+      }
+   }
+
+   /**
+    * exchanges q0 and q1 where all ctrls are set (fredkin for one control)
+    */
+   void __apply_cswap(std::size_t n, const std::vector<uint64_t>& ctrls, std::size_t q0, std::size_t q1, complex_t * state)
+   {
+      if (q0 == q1)
+         return;
+      std::vector<size_t> fixed(ctrls.begin(), ctrls.end());
+      fixed.push_back(q0);
+      fixed.push_back(q1);
+      std::sort(fixed.begin(), fixed.end());
+      size_t cmask = 0;
+      for (size_t i = 0; i < ctrls.size(); i++)
+         cmask |= (1UL << ctrls[i]);
+      size_t lo = fixed[0];
+
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (lo >= 2))
+         __apply_mc_swap_avx512(n, fixed.data(), fixed.size(), cmask, q0, q1, state);
+      else if ((simd >= xpu::simd_level::avx2) && (lo >= 1))
+         __apply_mc_swap_avx2(n, fixed.data(), fixed.size(), cmask, q0, q1, state);
+      else
+         __apply_mc_swap_sse(n, fixed.data(), fixed.size(), cmask, q0, q1, state);
+   }
+
+   void __apply_swap(std::size_t n, std::size_t q0, std::size_t q1, complex_t * state)
+   {
+      __apply_cswap(n, std::vector<uint64_t>(), q0, q1, state);
+   }
+
+   /**
+    * pauli rotation exp(-i.theta.P) : the pauli string P maps |i> to
+    * i^ny.(-1)^|i & zmask|.|i ^ xmask>, xmask holding the qubits acted on by
+    * X or Y, zmask those acted on by Z or Y and ny the number of Y. each
+    * amplitude a (bit hi, the highest bit of xmask, clear) is paired with
+    * its partner b = a ^ xmask and the rotation is a single pass :
+    *    a' = c.a + fa.b,  b' = c.b + fb.a
+    * with c = cos(theta), fb = g.(-1)^|a & zmask|, fa = (-1)^ny.fb and
+    * g = -i.sin(theta).i^ny. the pairs are visited as runs of the indices
+    * below lo, the lowest bit of xmask | zmask, over which the parity is
+    * constant : f holds fa and fb for an even parity, then for an odd one.
+    */
+   inline complex_t __pauli_factor(std::size_t ny, double theta)
+   {
+      complex_t g(0.0, -sin(theta));
+      for (size_t k = 0; k < (ny & 3); k++)
+         g = complex_t(-g.im, g.re);
+      return g;
+   }
+
+   void __apply_pauli_sse(std::size_t n, std::size_t lo, std::size_t hi, std::size_t xmask, std::size_t zmask, complex_t * state, const double c, const complex_t * f)
+   {
+      complex_t cc(c, 0.0);
+      size_t  len  = __run_length((1UL << (n - 1)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 1)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t      base = __bit_insert(((size_t)r)*len, hi);
+         size_t      odd  = QX_POPCOUNT(base & zmask) & 1;
+         complex_t   fa   = f[2*odd];
+         complex_t   fb   = f[2*odd+1];
+         complex_t * a = state + base;
+         complex_t * b = state + (base ^ xmask);
+         for (size_t i = 0; i < len; i++)
+         {
+            complex_t t = a[i];
+            a[i] = cc*t + fa*b[i];
+            b[i] = cc*b[i] + fb*t;
+         }
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_pauli_avx2(std::size_t n, std::size_t lo, std::size_t hi, std::size_t xmask, std::size_t zmask, complex_t * state, const double c, const complex_t * f)
+   {
+      __m256d cc = _mm256_set1_pd(c);
+      __m256d fr[4], fi[4];
+      for (size_t k = 0; k < 4; k++)
+      {
+         fr[k] = _mm256_set1_pd(f[k].re);
+         fi[k] = _mm256_set_pd(-f[k].im, f[k].im, -f[k].im, f[k].im);
+      }
+      size_t  len  = __run_length((1UL << (n - 1)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 1)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t   base = __bit_insert(((size_t)r)*len, hi);
+         size_t   odd  = QX_POPCOUNT(base & zmask) & 1;
+         __m256d  ra = fr[2*odd], ia = fi[2*odd];
+         __m256d  rb = fr[2*odd+1], ib = fi[2*odd+1];
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base ^ xmask));
+         for (size_t i = 0; i < 2*len; i += 4)
+         {
+            __m256d in0 = _mm256_load_pd(a + i);
+            __m256d in1 = _mm256_load_pd(b + i);
+            __m256d o0  = _mm256_fmadd_pd(ra, in1, _mm256_mul_pd(cc, in0));
+            __m256d o1  = _mm256_fmadd_pd(rb, in0, _mm256_mul_pd(cc, in1));
+            o0 = _mm256_fmadd_pd(ia, _mm256_permute_pd(in1, 0x5), o0);
+            o1 = _mm256_fmadd_pd(ib, _mm256_permute_pd(in0, 0x5), o1);
+            _mm256_store_pd(a + i, o0);
+            _mm256_store_pd(b + i, o1);
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_pauli_avx512(std::size_t n, std::size_t lo, std::size_t hi, std::size_t xmask, std::size_t zmask, complex_t * state, const double c, const complex_t * f)
+   {
+      __m512d cc = _mm512_set1_pd(c);
+      __m512d fr[4], fi[4];
+      for (size_t k = 0; k < 4; k++)
+      {
+         fr[k] = _mm512_set1_pd(f[k].re);
+         fi[k] = _mm512_set_pd(-f[k].im, f[k].im, -f[k].im, f[k].im, -f[k].im, f[k].im, -f[k].im, f[k].im);
+      }
+      size_t  len  = __run_length((1UL << (n - 1)), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << (n - 1)) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t   base = __bit_insert(((size_t)r)*len, hi);
+         size_t   odd  = QX_POPCOUNT(base & zmask) & 1;
+         __m512d  ra = fr[2*odd], ia = fi[2*odd];
+         __m512d  rb = fr[2*odd+1], ib = fi[2*odd+1];
+         double * a = (double*)(state + base);
+         double * b = (double*)(state + (base ^ xmask));
+         for (size_t i = 0; i < 2*len; i += 8)
+         {
+            __m512d in0 = _mm512_load_pd(a + i);
+            __m512d in1 = _mm512_load_pd(b + i);
+            __m512d o0  = _mm512_fmadd_pd(ra, in1, _mm512_mul_pd(cc, in0));
+            __m512d o1  = _mm512_fmadd_pd(rb, in0, _mm512_mul_pd(cc, in1));
+            o0 = _mm512_fmadd_pd(ia, QX_MM512_PERMUTE_PD(in1, 0x55), o0);
+            o1 = _mm512_fmadd_pd(ib, QX_MM512_PERMUTE_PD(in0, 0x55), o1);
+            _mm512_store_pd(a + i, o0);
+            _mm512_store_pd(b + i, o1);
+         }
+      }
+   }
+
+   /**
+    * diagonal pauli rotations (Z only) : amplitude i is multiplied by
+    * p[|i & zmask| mod 2], over runs of the indices below lo.
+    */
+   void __apply_zparity_sse(std::size_t n, std::size_t lo, std::size_t zmask, complex_t * state, const complex_t * p)
+   {
+      size_t  len  = __run_length((1UL << n), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << n) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t      base = ((size_t)r)*len;
+         complex_t   ph   = p[QX_POPCOUNT(base & zmask) & 1];
+         complex_t * a    = state + base;
+         for (size_t i = 0; i < len; i++)
+            a[i] *= ph;
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_zparity_avx2(std::size_t n, std::size_t lo, std::size_t zmask, complex_t * state, const complex_t * p)
+   {
+      __m256d pr[2], pi[2];
+      for (size_t k = 0; k < 2; k++)
+      {
+         pr[k] = _mm256_set1_pd(p[k].re);
+         pi[k] = _mm256_set_pd(-p[k].im, p[k].im, -p[k].im, p[k].im);
+      }
+      size_t  len  = __run_length((1UL << n), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << n) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t   base = ((size_t)r)*len;
+         size_t   odd  = QX_POPCOUNT(base & zmask) & 1;
+         __m256d  re = pr[odd], im = pi[odd];
+         double * a = (double*)(state + base);
+         for (size_t i = 0; i < 2*len; i += 4)
+         {
+            __m256d in = _mm256_load_pd(a + i);
+            _mm256_store_pd(a + i, _mm256_fmadd_pd(im, _mm256_permute_pd(in, 0x5), _mm256_mul_pd(re, in)));
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_zparity_avx512(std::size_t n, std::size_t lo, std::size_t zmask, complex_t * state, const complex_t * p)
+   {
+      __m512d pr[2], pi[2];
+      for (size_t k = 0; k < 2; k++)
+      {
+         pr[k] = _mm512_set1_pd(p[k].re);
+         pi[k] = _mm512_set_pd(-p[k].im, p[k].im, -p[k].im, p[k].im, -p[k].im, p[k].im, -p[k].im, p[k].im);
+      }
+      size_t  len  = __run_length((1UL << n), (1UL << lo));
+      int64_t runs = (int64_t)((1UL << n) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t   base = ((size_t)r)*len;
+         size_t   odd  = QX_POPCOUNT(base & zmask) & 1;
+         __m512d  re = pr[odd], im = pi[odd];
+         double * a = (double*)(state + base);
+         for (size_t i = 0; i < 2*len; i += 8)
+         {
+            __m512d in = _mm512_load_pd(a + i);
+            _mm512_store_pd(a + i, _mm512_fmadd_pd(im, QX_MM512_PERMUTE_PD(in, 0x55), _mm512_mul_pd(re, in)));
+         }
+      }
+   }
+
+   /**
+    * exp(-i.theta.P), P being given by xmask and zmask (see above)
+    */
+   void __apply_pauli_rotation(std::size_t n, std::size_t xmask, std::size_t zmask, double theta, complex_t * state)
+   {
+      size_t lo = 0;
+      while ((lo < n) && !(((xmask | zmask) >> lo) & 1))
+         lo++;
+
+      xpu::simd_level simd = xpu::host_simd_level();
+      if (!xmask)
+      {
+         complex_t p[] = { complex_t(cos(theta), -sin(theta)), complex_t(cos(theta), sin(theta)) };
+         if ((simd >= xpu::simd_level::avx512) && (lo >= 2))
+            __apply_zparity_avx512(n, lo, zmask, state, p);
+         else if ((simd >= xpu::simd_level::avx2) && (lo >= 1))
+            __apply_zparity_avx2(n, lo, zmask, state, p);
+         else
+            __apply_zparity_sse(n, lo, zmask, state, p);
+         return;
+      }
+
+      size_t hi = 63;
+      while (!((xmask >> hi) & 1))
+         hi--;
+      size_t    ny = QX_POPCOUNT(xmask & zmask);
+      complex_t g  = __pauli_factor(ny, theta);
+      complex_t fa = (ny & 1) ? complex_t(-g.re, -g.im) : g;
+      complex_t f[] = { fa, g, complex_t(-fa.re, -fa.im), complex_t(-g.re, -g.im) };
+
+      if ((simd >= xpu::simd_level::avx512) && (lo >= 2))
+         __apply_pauli_avx512(n, lo, hi, xmask, zmask, state, cos(theta), f);
+      else if ((simd >= xpu::simd_level::avx2) && (lo >= 1))
+         __apply_pauli_avx2(n, lo, hi, xmask, zmask, state, cos(theta), f);
+      else
+         __apply_pauli_sse(n, lo, hi, xmask, zmask, state, cos(theta), f);
+   }
+
+   /**
+    * diagonal operator on k <= 10 qubits : amplitude i is multiplied by
+    * phases[j], bit l of j being bit qubits[l] of i. the bits of j coming
+    * from the qubits below lo are read from the index table lidx (2^lo
+    * entries), the others (hq[l] -> bit hl[l] of j) are constant over a run
+    * and computed once per run.
+    */
+   inline size_t __diag_high_index(size_t base, const size_t * hq, const size_t * hl, size_t nh)
+   {
+      size_t j = 0;
+      for (size_t l = 0; l < nh; l++)
+         j |= ((base >> hq[l]) & 1) << hl[l];
+      return j;
+   }
+
+   void __apply_diag_sse(std::size_t n, std::size_t lo, const uint16_t * lidx, const size_t * hq, const size_t * hl, size_t nh, complex_t * state, const complex_t * phases)
+   {
+      size_t  lmask = (1UL << lo) - 1;
+      size_t  len   = __run_length((1UL << n), (1UL << lo));
+      int64_t runs  = (int64_t)((1UL << n) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t           base = ((size_t)r)*len;
+         size_t           h    = __diag_high_index(base, hq, hl, nh);
+         const uint16_t * li   = lidx + (base & lmask);
+         complex_t *      a    = state + base;
+         for (size_t i = 0; i < len; i++)
+            a[i] *= phases[h | li[i]];
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __apply_diag_avx2(std::size_t n, std::size_t lo, const uint16_t * lidx, const size_t * hq, const size_t * hl, size_t nh, complex_t * state, const complex_t * phases)
+   {
+      size_t  lmask = (1UL << lo) - 1;
+      size_t  len   = __run_length((1UL << n), (1UL << lo));
+      int64_t runs  = (int64_t)((1UL << n) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t           base = ((size_t)r)*len;
+         size_t           h    = __diag_high_index(base, hq, hl, nh);
+         const uint16_t * li   = lidx + (base & lmask);
+         double *         a    = (double*)(state + base);
+         for (size_t i = 0; i < len; i += 2)
+         {
+            __m256d p  = _mm256_insertf128_pd(_mm256_castpd128_pd256(phases[h | li[i]].xmm), phases[h | li[i+1]].xmm, 1);
+            __m256d in = _mm256_load_pd(a + 2*i);
+            __m256d pi = _mm256_mul_pd(_mm256_permute_pd(p, 0x0), _mm256_permute_pd(in, 0x5));
+            _mm256_store_pd(a + 2*i, _mm256_fmsubadd_pd(_mm256_permute_pd(p, 0xF), in, pi));
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __apply_diag_avx512(std::size_t n, std::size_t lo, const uint16_t * lidx, const size_t * hq, const size_t * hl, size_t nh, complex_t * state, const complex_t * phases)
+   {
+      size_t  lmask = (1UL << lo) - 1;
+      size_t  len   = __run_length((1UL << n), (1UL << lo));
+      int64_t runs  = (int64_t)((1UL << n) / len);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t r = 0; r < runs; r++)
+      {
+         size_t           base = ((size_t)r)*len;
+         size_t           h    = __diag_high_index(base, hq, hl, nh);
+         const uint16_t * li   = lidx + (base & lmask);
+         double *         a    = (double*)(state + base);
+         for (size_t i = 0; i < len; i += 4)
+         {
+            __m256d p0 = _mm256_insertf128_pd(_mm256_castpd128_pd256(phases[h | li[i]].xmm), phases[h | li[i+1]].xmm, 1);
+            __m256d p1 = _mm256_insertf128_pd(_mm256_castpd128_pd256(phases[h | li[i+2]].xmm), phases[h | li[i+3]].xmm, 1);
+            __m512d p  = QX_MM512_INSERTF64X4(_mm512_castpd256_pd512(p0), p1, 1);
+            __m512d in = _mm512_load_pd(a + 2*i);
+            __m512d pi = _mm512_mul_pd(QX_MM512_PERMUTE_PD(p, 0x00), QX_MM512_PERMUTE_PD(in, 0x55));
+            _mm512_store_pd(a + 2*i, _mm512_fmsubadd_pd(QX_MM512_PERMUTE_PD(p, 0xFF), in, pi));
+         }
+      }
+   }
+
+   /**
+    * multiply amplitude i by phases[j], bit l of j being bit qubits[l] of i
+    * (at most 10 qubits)
+    */
+   void __apply_diag(std::size_t n, const std::vector<uint64_t>& qubits, complex_t * state, const complex_t * phases)
+   {
+      size_t                lo = std::min<size_t>(n, 10);
+      std::vector<size_t>   bit(lo, 0);
+      std::vector<size_t>   hq, hl;
+      for (size_t l = 0; l < qubits.size(); l++)
+      {
+         if (qubits[l] < lo)
+            bit[qubits[l]] = (1UL << l);
+         else
+         {
+            hq.push_back(qubits[l]);
+            hl.push_back(l);
+         }
+      }
+      std::vector<uint16_t> lidx(1UL << lo, 0);
+      for (size_t b = 0; b < lo; b++)
+         for (size_t t = (1UL << b); t < (2UL << b); t++)
+            lidx[t] = (uint16_t)(lidx[t - (1UL << b)] | bit[b]);
+
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (lo >= 2))
+         __apply_diag_avx512(n, lo, lidx.data(), hq.data(), hl.data(), hq.size(), state, phases);
+      else if ((simd >= xpu::simd_level::avx2) && (lo >= 1))
+         __apply_diag_avx2(n, lo, lidx.data(), hq.data(), hl.data(), hq.size(), state, phases);
+      else
+         __apply_diag_sse(n, lo, lidx.data(), hq.data(), hl.data(), hq.size(), state, phases);
+   }
+
+   uint64_t rw_process_ui(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_ui m, cvector_t * v, cvector_t * res)
+   {
+      uint64_t k = n-qubit;
+      // println("run : " << is << " .. " << ie);
+      complex_t * pv = v->data();
+      complex_t * pr = res->data();
+      size_t bc, c1, c2;
+      size_t nk = n-k;
+
+      for (uint64_t r=is; r<ie; ++r)
+      {
+         bc = r;
+         c1 = __bit_reset(bc,nk);
+         c2 = __bit_set(bc,nk);
+         bc++;
+#ifdef __OP_PREFETCH__
+         _mm_prefetch((char*)&pv[__bit_reset(bc,nk)],_MM_HINT_T0);
+         _mm_prefetch((char*)&pv[__bit_set(bc,nk)],_MM_HINT_T0);
+#endif // __OP_PREFETCH__
+#ifdef __AVX__ 
+         // cxc
+         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
+         // cxr
+         // pr[r].xmm = complex_t::_mm256_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+#elif __SSE__
+         // complex_t s; // = 0;
+         //pr[r] = pv[c1]*(m->get(r,c1)) + pv[c2]*(m->get(r,c2));
+         // --- cc mul add --- 
+         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
+         // --- cr mul add --- pr[r].xmm = _mm_add_pd(complex_t::mul_cr(pv[c1].xmm,m.get(r,c1).xmm), complex_t::mul_cr(pv[c2].xmm,m.get(r,c2).xmm));
+         // --- f. mul add ---
+         // pr[r].xmm = complex_t::_mm_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+#else
+         pr[r] = (pv[c1]*(m.get(r,c1))) + (pv[c2]*(m.get(r,c2)));
+#endif
+      }
+
+      return 0;
+   }
+ 
+
+   void sparse_mulmv(uint64_t n, uint64_t qubit, kronecker_ui m, cvector_t& v, cvector_t& res)
+   {
+      uint64_t k = n-qubit;
+      uint64_t rows = (1UL << n);
+      uint64_t z = 0;
+
+#ifdef SEQUENTIAL
+      rw_process_ui(z,rows,1,n,qubit,m,&v,&res);
+#else
+      /*xpu::task rw_t(rw_process_ui,0,0,0,n,qubit,m,&v,&res);
+      xpu::parallel_for process(z,rows,1,&rw_t);
+      process.run();*/
+      rw_process_ui(z,rows,0,n,qubit,m,&v,&res);
+#endif
+   }
+
+   uint64_t rw_process_iu(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_iu m, cvector_t * v, cvector_t * res)
+   {
+      uint64_t k = n-qubit;
+      // println("run : " << is << " .. " << ie);
+      complex_t * pv = v->data();
+      complex_t * pr = res->data();
+      size_t bc, c1, c2;
+      size_t nk = n-k;
+
+      for (uint64_t r=is; r<ie; ++r)
+      {
+         bc = r;
+         c1 = __bit_reset(bc,nk);
+         c2 = __bit_set(bc,nk);
+         bc++;
+#ifdef __OP_PREFETCH__
+         _mm_prefetch((char*)&pv[__bit_reset(bc,nk)],_MM_HINT_T0);
+         _mm_prefetch((char*)&pv[__bit_set(bc,nk)],_MM_HINT_T0);
+#endif // __OP_PREFETCH__
+#ifdef __AVX__ 
+         // cxc
+         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
+         // cxr
+         // pr[r].xmm = complex_t::_mm256_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+#elif __SSE__
+         // complex_t s; // = 0;
+         // pr[r] = pv[c1]*(m->get(r,c1)) + pv[c2]*(m->get(r,c2));
+         // --- cc mul add --- 
+         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
+         // --- cr mul add --- pr[r].xmm = _mm_add_pd(complex_t::mul_cr(pv[c1].xmm,m.get(r,c1).xmm), complex_t::mul_cr(pv[c2].xmm,m.get(r,c2).xmm));
+         // --- f. mul add ---
+         // pr[r].xmm = complex_t::_mm_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+#else
+         pr[r] = (pv[c1]*(m.get(r,c1))) + (pv[c2]*(m.get(r,c2)));
+#endif
+      }
+
+      return 0;
+   }
+ 
+
+   void sparse_mulmv(uint64_t n, uint64_t qubit, kronecker_iu m, cvector_t& v, cvector_t& res)
+   {
+      uint64_t k = n-qubit;
+      uint64_t rows = (1UL << n);
+      uint64_t z = 0;
+
+#ifdef SEQUENTIAL
+      rw_process_iu(z,rows,1,n,qubit,m,&v,&res);
+#else
+      /*xpu::task rw_t(rw_process_iu,0,0,0,n,qubit,m,&v,&res);
+      xpu::parallel_for process(z,rows,1,&rw_t);
+      process.run();*/
+      rw_process_iu(z,rows,0,n,qubit,m,&v,&res);
+#endif
+   }
+   
+   // static xpu::core::os::mutex mtx;
+
+   uint64_t rw_process_iui(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_iui m, cvector_t * v, cvector_t * res)
+   {
+      uint64_t k = n-qubit;
+      // println("run : " << is << " .. " << ie);
+      complex_t * pv = v->data();
+      complex_t * pr = res->data();
+      size_t bc, c1, c2;
+      size_t nk = n-k;
+
+      for (uint64_t r=is; r<ie; r++) //+=2)
+      {
+         // 1st
+         bc = r;
+         c1 = __bit_reset(bc,nk);
+         c2 = __bit_set(bc,nk);
+         bc++;
+#ifdef __OP_PREFETCH__
+         _mm_prefetch((char*)&pv[__bit_reset(bc,nk)],_MM_HINT_T0);
+         _mm_prefetch((char*)&pv[__bit_set(bc,nk)],_MM_HINT_T0);
+#endif // __OP_PREFETCH__
+#ifdef __AVX__ 
+         // mtx.lock();
+         // cxc : 
+         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
+         // cxr
+         // pr[r].xmm = complex_t::_mm256_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+
+         /*
+            __m256d a; //_mm256_loadu2_m128d((double*)&pv[c1], (double*)&pv[c2]);
+            a  = _mm256_insertf128_pd(a,_mm_permute_pd(pv[c1].xmm,1), 0);
+            a  = _mm256_insertf128_pd(a,_mm_permute_pd(pv[c2].xmm,1), 1);
+            print("(r="<<r<<") : pr12: "); xpu::dump_m256d(a);
+         // __m256d b  = _mm256_set_m128d((m.get(r,c1)).xmm, (m.get(r,c2)).xmm);
+         __m256d b;
+         b  = _mm256_insertf128_pd(b,_mm_permute_pd(m.get(r,c1).xmm, 1), 1);
+         print("(r="<<r<<") : c1 : "); xpu::dump_m256d(b);
+         b  = _mm256_insertf128_pd(b,_mm_permute_pd(m.get(r,c2).xmm, 1), 0);
+         print("(r="<<r<<") : c2 : "); xpu::dump_m256d(b);
+         __m256d ab  = xpu::_mm256_cmul_pd(a,b);
+         print("(r="<<r<<") : mul: "); xpu::dump_m256d(ab);
+         __m256d abr = _mm256_permute2f128_pd(ab, ab, 1);
+         print("(r="<<r<<") : prm: "); xpu::dump_m256d(abr);
+         ab = _mm256_add_pd(ab,abr);
+         print("(r="<<r<<") : add: "); xpu::dump_m256d(ab);
+         pr[r].xmm = _mm256_extractf128_pd(ab,0);
+         print("(r="<<r<<") : res:"); xpu::dump_m128d(pr[r].xmm);
+         mtx.unlock();
+          */
+#elif  __SSE__
+         /*
+            mtx.lock();
+            print("(r="<<r<<") : pr1: "); xpu::dump_m128d(pv[c1].xmm);
+            print("(r="<<r<<") : pr2: "); xpu::dump_m128d(pv[c2].xmm);
+            print("(r="<<r<<") : c1 : "); xpu::dump_m128d((m.get(r,c1)).xmm);
+            print("(r="<<r<<") : c2 : "); xpu::dump_m128d((m.get(r,c2)).xmm);
+          */
+         // --- cxc mul --- 
+         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
+         // --- cxr mul --- pr[r].xmm = _mm_add_pd(complex_t::mul_cr(pv[c1].xmm,m.get(r,c1).xmm), complex_t::mul_cr(pv[c2].xmm,m.get(r,c2).xmm));
+         // --- fus ma  ---
+         // pr[r].xmm = complex_t::_mm_cr_mul_add_pd(pv[c1].xmm, m.get(r,c1).xmm, pv[c2].xmm, m.get(r,c2).xmm);
+
+         // pr[r].xmm = xpu::_mm128_mul_add_pc(pv[c1].xmm, pv[c2].xmm, m.get(r,c1).xmm, m.get(r,c2).xmm);
+         /*
+            print("(r="<<r<<") : res: "); xpu::dump_m128d(pr[r].xmm);
+            mtx.unlock();
+          */
+#else
+         pr[r] = (pv[c1]*(m.get(r,c1))) + (pv[c2]*(m.get(r,c2)));
+#endif
+         /*
+         // 2nd
+         c1 = __bit_reset(bc,n-k);
+         c2 = __bit_set(bc,n-k);
+#ifdef __AVX__NO 
+a  = _mm256_loadu2_m128d((double*)&pv[c1], (double*)&pv[c2]);
+         // __m256d b  = _mm256_set_m128d((m.get(r,c1)).xmm, (m.get(r,c2)).xmm);
+         b  = _mm256_insertf128_pd(b,(m.get(bc,c1)).xmm, 1);
+         b  = _mm256_insertf128_pd(b,(m.get(bc,c2)).xmm, 0);
+         ab  = xpu::_mm256_cmul_pd(a,b);
          abr = _mm256_permute2f128_pd(ab, ab, 1);
          ab = _mm256_add_pd(ab,abr);
          pr[bc].xmm = _mm256_extractf128_pd(ab,0);
@@ -642,6 +2496,16 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
    }
 
+   /**
+    * diag_apply : applies diag(1,p) to the target qubit
+    */
+   inline void diag_apply(const complex_t p, uint64_t qubit, qu_register& qureg)
+   {
+      uint64_t     n  = qureg.size();
+      complex_t *  s  = qureg.get_data().data();
+      __apply_phase(0, (1UL << n), qubit, s, p);
+   }
+
 #endif // remove naive tensor computation
 
 
@@ -734,6 +2598,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __hadamard_gate__; 
@@ -746,61 +2616,6 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
    };
 
-   inline void __swap(cvector_t& amp, size_t size, size_t bit, size_t trg, size_t ctrl, size_t offset=0)
-   {
-      // println("bit=" << bit);
-      // println("ctrl=" << ctrl);
-      complex_t * p = amp.data();
-      size_t incrementer = 1UL << (bit+1);
-
-      if ((1UL<<bit) == 1) {
-         for (size_t i=__bit_set(0,bit), end=(1UL<<size); i<end; i+=incrementer) {
-            size_t v = i+offset;
-            std::swap(amp[v], amp[__bit_reset(v,trg)]);
-         }
-      }
-      else {
-         for (size_t i=__bit_set(0,bit), end=(1UL<<size); i<end; i+=incrementer) {
-            size_t v = i+offset;
-            for (size_t j=0; j<(1UL<<bit); j++)
-            {
-               // v += j;
-               /*
-                  #ifdef __SSE__
-                  __m128d x = _mm_load_pd((const double *)&p[v]);
-                  __m128d y = _mm_load_pd((const double *)&p[__bit_reset(v,trg)]);
-                  _mm_store_pd((double *)&p[__bit_reset(v,trg)],x);
-                  _mm_store_pd((double *)&p[v],y);
-                  #else
-               */
-               std::swap(amp[v], amp[__bit_reset(v,trg)]);
-               ++v;
-               // println("swap("<<v<<","<<__bit_reset(v,trg)<<")");
-               // #endif
-            }
-         }
-      }
-   }
-
-
-   inline int cx_worker(uint64_t cs, uint64_t ce, uint64_t s, cvector_t * p_amp, size_t bit1, size_t bit2, size_t trg, size_t ctrl)
-   {
-      cvector_t &amp = * p_amp;
-      // xpu::parallel_for fswp(__bit_set(0,b1), (1 << qn), (1 << (b1+1)), &t);
-      size_t step=(1UL << (bit1+1));
-      // size_t b   = cs;
-      // size_t e   = ce;
-      size_t offset = __bit_set(0,bit1);
-
-      //for (size_t i=__bit_set(0,bit1); i<(1<<size); i += (1 << (bit1+1)))
-      //__swap(amp,bit1,bit2,trg,ctrl,i);
-      // for (size_t i=b; i<e; i++)
-      //    __swap(amp,bit1,bit2,trg,ctrl,offset+(i*step));
-      for (size_t i=cs; i<ce; i++)
-         __swap(amp,bit1,bit2,trg,ctrl,offset+(i*step));
-      return 0;
-   }
-
    /**
     * \brief controlled-not gate:
     *
@@ -862,46 +2677,13 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
 #elif defined(CG_BC)
 
-            uint64_t sn = qreg.states();
             uint64_t qn = qreg.size();
             uint64_t cq = control_qubit;
             uint64_t tq = target_qubit;
 
             cvector_t& amp = qreg.get_data();
 
-            // perms(qn,cq,tq,amp);
-            // #if 0
-            size_t b1 = std::max(cq,tq);
-            size_t b2 = std::min(cq,tq);
-
-
-            size_t steps = ((1UL << qn)-(__bit_set(0,b1)))/(1UL << (b1+1))+1;
-            /*
-               println("from=" << (__bit_set(0,b1)));
-               println("to=" << (1 << qn));
-               println("s=" << (1 << (b1+1)));
-               println("steps=" << steps);
-             */
-            if (qn<17) 
-               fast_cx(amp, qn, b1, b2, tq, cq);
-            else
-            {
-#ifdef USE_OPENMP
-#pragma omp parallel
-{
-#ifndef _MSC_VER
-#pragma omp for simd
-#endif
-               for (size_t i=0; i<steps; ++i)
-                  cx_worker(i,i+1,1UL,&amp,b1,b2,(size_t)tq,(size_t)cq);
-}
-#else
-               xpu::task t(cx_worker,0UL,0UL,0UL,&amp,b1,b2,(size_t)tq,(size_t)cq);
-               xpu::parallel_for fswp(0, steps, 1, &t);
-               fswp.run();
-#endif
-            }
-            // #endif
+            __apply_mc(qn, std::vector<uint64_t>(1, cq), tq, amp.data(), pauli_x_c);
 
 #elif defined(CG_HASH_SET)
 
@@ -977,6 +2759,11 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            build_ctrl_matrix(r, 1, pauli_x_c);
+            return true;
+         }
 
          gate_type_t type()
          {
@@ -987,35 +2774,6 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
          {
             println("  [-] cnot(ctrl_qubit=" << control_qubit << ", target_qubit=" << target_qubit << ")");
          }
-
-	   private:
-#if 0
-	   void __swap(cvector_t& amp, size_t size, size_t bit, size_t trg, size_t ctrl, size_t offset=0)
-	   {
-	      // println("bit=" << bit);
-	      // println("ctrl=" << ctrl);
-	      for (size_t i=__bit_set(0,bit); i<(1UL<<size); i += (1UL << (bit+1)))
-		 for (size_t j=0; j<(1<<bit); j++)
-		 {
-		    size_t v = i+j+offset; 
-		    std::swap(amp[v], amp[__bit_reset(v,trg)]);
-		    // println(" swap(" << std::bitset<16>(v) << "," << std::bitset<16>(__bit_reset(v,trg)) << ")");
-		 }
-	   }
-#endif
-
-
-      void fast_cx(cvector_t& amp, size_t size, size_t bit1, size_t bit2, size_t trg, size_t ctrl)
-      {
-         /*
-            println("from=" << (__bit_set(0,bit1)));
-            println("to=" << (1 << size));
-            println("s=" << (1 << (bit1+1)));
-          */
-         for (size_t i=__bit_set(0,bit1); i<(1UL<<size); i += (1UL << (bit1+1)))
-            __swap(amp,bit1,bit2,trg,ctrl,i);
-      }
-
    };
 
 
@@ -1075,24 +2833,10 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
             //println("\ntoffoli " << cq1 << "," << cq2 << "," << tq);
 #if 1
-            size_t c1=cq1;
-            size_t c2=cq2;
-            size_t c3=tq;
-            size_t t=tq;
-            size_t size=qn;
-
-            sort(c1,c2,c3);
-#ifdef USE_OPENMP
-#pragma omp parallel for
-#endif
-            for (int64_t i=__bit_set(__bit_set(__bit_set(0,c1),c2),c3); i<(int64_t)(1UL<<size); i += (1UL << (c3+1)))
-               for (size_t j=(size_t)i; j<((size_t)i+(1UL<<c3)); j += (1UL << (c2+1)))
-                  for (size_t k=j; k<(j+(1UL<<c2)); k+=(1UL << (c1+1)))
-                     for (size_t l=k; l<(k+(1UL<<(c1))); l++)
-                     {
-                        std::swap(amp[__bit_set(l,t)],amp[__bit_reset(l,t)]);
-                        // println("swap : " << __bit_set(l,t) << "," << __bit_reset(l,t));
-                     }
+            std::vector<uint64_t> ctrls;
+            ctrls.push_back(cq1);
+            ctrls.push_back(cq2);
+            __apply_mc(qn, ctrls, tq, amp.data(), pauli_x_c);
 #else
             std::vector<uint64_t> done(sn, 0);
             perm_t p = perms(qn,cq1,cq2,tq);
@@ -1124,28 +2868,263 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
                   (qreg.get_measurement_prediction(control_qubit_2) == __state_unknown__)  )
             {
                qreg.set_measurement_prediction(target_qubit,__state_unknown__);
-               // qreg.set_binary(target_qubit,__state_unknown__);
-            }
-
+               // qreg.set_binary(target_qubit,__state_unknown__);
+            }
+
+            return 0;
+         }
+
+
+         std::vector<uint64_t>  qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(control_qubit_1);
+            r.push_back(control_qubit_2);
+            r.push_back(target_qubit);
+            return r;
+         }
+
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(control_qubit_1);
+            r.push_back(control_qubit_2);
+            return r;
+         }
+
+         std::vector<uint64_t>  target_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(target_qubit);
+            return r;
+         }
+
+         bool get_matrix(cvector_t& r)
+         {
+            build_ctrl_matrix(r, 2, pauli_x_c);
+            return true;
+         }
+
+         gate_type_t type()
+         {
+            return __toffoli_gate__;
+         }
+
+
+         void dump()
+         {
+            println("  [-] toffoli(ctrl_qubit_1=" << control_qubit_1 << ", ctrl_qubit_2=" << control_qubit_2 << ", target_qubit=" << target_qubit << ")");
+         }
+
+   };
+
+   /**
+    * \brief controlled pauli-y :
+    *
+    *    | 1  0  0  0 |
+    *    | 0  1  0  0 |
+    *    | 0  0  0 -i |
+    *    | 0  0  i  0 |
+    */
+   class ctrl_pauli_y : public gate
+   {
+      private:
+
+         uint64_t control_qubit;
+         uint64_t target_qubit;
+
+      public:
+
+         ctrl_pauli_y(uint64_t ctrl_q, uint64_t target_q) : control_qubit(ctrl_q), target_qubit(target_q)
+         {
+         }
+
+         int64_t apply(qu_register& qreg)
+         {
+            __apply_mc(qreg.size(), std::vector<uint64_t>(1, control_qubit), target_qubit, qreg.get_data().data(), pauli_y_c);
+
+            if (qreg.get_measurement_prediction(control_qubit) == __state_1__)
+               qreg.flip_binary(target_qubit);
+            else if (qreg.get_measurement_prediction(control_qubit) == __state_unknown__)
+               qreg.set_measurement_prediction(target_qubit,__state_unknown__);
+            return 0;
+         }
+
+         std::vector<uint64_t>  qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(control_qubit);
+            r.push_back(target_qubit);
+            return r;
+         }
+
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(control_qubit);
+            return r;
+         }
+
+         std::vector<uint64_t>  target_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(target_qubit);
+            return r;
+         }
+
+         bool get_matrix(cvector_t& r)
+         {
+            build_ctrl_matrix(r, 1, pauli_y_c);
+            return true;
+         }
+
+         gate_type_t type()
+         {
+            return __ctrl_pauli_y_gate__;
+         }
+
+         void dump()
+         {
+            println("  [-] ctrl_pauli_y(ctrl_qubit=" << control_qubit << ", target_qubit=" << target_qubit << ")");
+         }
+   };
+
+   /**
+    * \brief fredkin (controlled swap) : exchanges qubit1 and qubit2 when the
+    *  control qubit is set
+    */
+   class fredkin : public gate
+   {
+      private:
+
+         uint64_t control_qubit;
+         uint64_t qubit1;
+         uint64_t qubit2;
+
+      public:
+
+         fredkin(uint64_t ctrl_q, uint64_t qubit1, uint64_t qubit2) : control_qubit(ctrl_q), qubit1(qubit1), qubit2(qubit2)
+         {
+         }
+
+         int64_t apply(qu_register& qreg)
+         {
+            __apply_cswap(qreg.size(), std::vector<uint64_t>(1, control_qubit), qubit1, qubit2, qreg.get_data().data());
+
+            if (qreg.get_measurement_prediction(qubit1) != qreg.get_measurement_prediction(qubit2))
+            {
+               qreg.set_measurement_prediction(qubit1,__state_unknown__);
+               qreg.set_measurement_prediction(qubit2,__state_unknown__);
+            }
+            return 0;
+         }
+
+         std::vector<uint64_t>  qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(control_qubit);
+            r.push_back(qubit1);
+            r.push_back(qubit2);
+            return r;
+         }
+
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(control_qubit);
+            return r;
+         }
+
+         std::vector<uint64_t>  target_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(qubit1);
+            r.push_back(qubit2);
+            return r;
+         }
+
+         bool get_matrix(cvector_t& r)
+         {
+            // local index order (ctrl,qubit1,qubit2) : |ctrl,1,0> <-> |ctrl,0,1>
+            r.assign(64, complex_t(0.0, 0.0));
+            for (size_t i=0; i<8; i++)
+               r[i*8+i] = complex_t(1.0, 0.0);
+            r[3*8+3] = complex_t(0.0, 0.0); r[3*8+5] = complex_t(1.0, 0.0);
+            r[5*8+5] = complex_t(0.0, 0.0); r[5*8+3] = complex_t(1.0, 0.0);
+            return true;
+         }
+
+         gate_type_t type()
+         {
+            return __fredkin_gate__;
+         }
+
+         void dump()
+         {
+            println("  [-] fredkin(ctrl_qubit=" << control_qubit << ", q1=" << qubit1 << ", q2=" << qubit2 << ")");
+         }
+   };
+
+   /**
+    * \brief multi-controlled gate : applies the 2x2 matrix m to the target
+    *  qubit when all the control qubits are set (e.g. C^kX, C^kZ, C^kRy)
+    */
+   class multi_ctrl_gate : public gate
+   {
+      private:
+
+         std::vector<uint64_t>  ctrl_qubits;
+         uint64_t               target_qubit;
+         cmatrix_t              m;
+
+      public:
+
+         multi_ctrl_gate(std::vector<uint64_t> ctrl_qubits, uint64_t target_qubit, cmatrix_t m) : ctrl_qubits(ctrl_qubits),
+                                                                                              target_qubit(target_qubit),
+                                                                                              m(m)
+         {
+            for (size_t i=0; i<ctrl_qubits.size(); i++)
+            {
+               if (ctrl_qubits[i] == target_qubit)
+                  throw std::invalid_argument("multi-controlled gate : the target qubit is also a control qubit");
+               for (size_t j=i+1; j<ctrl_qubits.size(); j++)
+                  if (ctrl_qubits[i] == ctrl_qubits[j])
+                     throw std::invalid_argument("multi-controlled gate : duplicate control qubit");
+            }
+         }
+
+         int64_t apply(qu_register& qreg)
+         {
+            __apply_mc(qreg.size(), ctrl_qubits, target_qubit, qreg.get_data().data(), m.m);
+
+            bool all_set = true;
+            for (size_t i = 0; i < ctrl_qubits.size(); i++)
+            {
+               state_t s = qreg.get_measurement_prediction(ctrl_qubits[i]);
+               if (s == __state_0__)
+                  return 0;
+               if (s != __state_1__)
+                  all_set = false;
+            }
+            bool x = (m(0,0) == complex_t(0.0, 0.0)) && (m(0,1) == complex_t(1.0, 0.0)) &&
+                     (m(1,0) == complex_t(1.0, 0.0)) && (m(1,1) == complex_t(0.0, 0.0));
+            if (all_set && x)
+               qreg.flip_binary(target_qubit);
+            else
+               qreg.set_measurement_prediction(target_qubit,__state_unknown__);
             return 0;
          }
 
-
          std::vector<uint64_t>  qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(control_qubit_1);
-            r.push_back(control_qubit_2);
+            std::vector<uint64_t> r(ctrl_qubits);
             r.push_back(target_qubit);
             return r;
          }
 
          std::vector<uint64_t>  control_qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(control_qubit_1);
-            r.push_back(control_qubit_2);
-            return r;
+            return ctrl_qubits;
          }
 
          std::vector<uint64_t>  target_qubits()
@@ -1155,47 +3134,32 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         /**
+          * dense matrix, up to 6 qubits
+          */
+         bool get_matrix(cvector_t& r)
+         {
+            if (ctrl_qubits.size() > 5)
+               return false;
+            build_ctrl_matrix(r, ctrl_qubits.size(), m.m);
+            return true;
+         }
 
          gate_type_t type()
          {
-            return __toffoli_gate__;
+            return __multi_ctrl_gate__;
          }
 
-
          void dump()
          {
-            println("  [-] toffoli(ctrl_qubit_1=" << control_qubit_1 << ", ctrl_qubit_2=" << control_qubit_2 << ", target_qubit=" << target_qubit << ")");
+            print("  [-] multi_ctrl_gate(ctrl_qubits=");
+            for (size_t i = 0; i < ctrl_qubits.size(); i++)
+               print((i ? "," : "") << ctrl_qubits[i]);
+            println(", target_qubit=" << target_qubit << ")");
          }
-
    };
 
 
-   int fliper(int cs, int ce, int s, uint64_t q, cvector_t * p_amp)
-   {
-      cvector_t &amp = * p_amp;
-      for (int i=cs; i<ce; ++i)
-      {
-         if (__bit_test(i,q))
-            std::swap(amp[i],amp[__bit_flip(i,q)]);
-      }
-      return 0;
-   }
-
-   #define __swap_xmm(x,y) { x = _mm_xor_pd(x,y); y = _mm_xor_pd(y,x); x = _mm_xor_pd(x,y); }
-
-   void fast_flip(uint64_t q, uint64_t n, cvector_t& amp)
-   {
-      complex_t * x = amp.data();
-#ifdef USE_OPENMP
-#pragma omp parallel for 
-#endif 
-      for (int64_t i=0; i<(int64_t)(1UL << n); i+=(1UL << (q+1)))
-         for (size_t j=(size_t)i; j<((size_t)i+(1UL << q)); j++)
-            //__swap_xmm(x[j].xmm,x[__bit_flip(j,q)].xmm);
-            std::swap(x[j].xmm,x[__bit_flip(j,q)].xmm);
-   }
-
-
    void flip(uint64_t q, uint64_t n, cvector_t& amp)
    {
       uint64_t nn = (1UL << n);
@@ -1283,6 +3247,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __identity_gate__; 
@@ -1317,25 +3287,7 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
-            // #define FAST_FLIP
-#ifdef FAST_FLIP
-            uint64_t qn = qreg.size();
-            cvector_t& amp = qreg.get_data();
-
-            // flip(qubit,qn,amp);
-            fast_flip(qubit,qn,amp);
-            /* 
-               xpu::task flip_t(fliper,0,0,0,qubit,&amp);
-               xpu::parallel_for parallel_flip(0,(1 << qn),1,&flip_t);
-               parallel_flip.run();
-             */
-#else
-            uint64_t     n  = qreg.size();
-            complex_t *  s  = qreg.get_data().data();
-            // cm.dump();
-            __apply_m(0, (1UL << n), qubit, s, 0, (1UL << qubit), m.m);
-            // sqg_apply(m,qubit,qreg);
-#endif // FAST_FLIP
+            __apply_mc(qreg.size(), std::vector<uint64_t>(), qubit, qreg.get_data().data(), pauli_x_c);
 
             qreg.flip_binary(qubit);
             return 0;
@@ -1380,6 +3332,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __pauli_x_gate__; 
@@ -1410,7 +3368,7 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
+            __apply_mc(qreg.size(), std::vector<uint64_t>(), qubit, qreg.get_data().data(), pauli_y_c);
             qreg.flip_binary(qubit);
             return 0;
          }
@@ -1454,6 +3412,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __pauli_y_gate__; 
@@ -1483,7 +3447,8 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
+            uint64_t n = qreg.size();
+            __apply_z(0, (1UL << n), qubit, qreg.get_data().data());
             return 0;
          }
 
@@ -1529,6 +3494,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __pauli_z_gate__; 
@@ -1557,7 +3528,7 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
+            diag_apply(m(1,1),qubit,qreg);
             return 0;
          }
 
@@ -1599,6 +3570,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __phase_gate__; 
@@ -1625,7 +3602,7 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
+            diag_apply(m(1,1),qubit,qreg);
             return 0;
          }
 
@@ -1654,6 +3631,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __sdag_gate__;
@@ -1681,7 +3664,7 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
 	   int64_t apply(qu_register& qreg)
 	   {
-		 sqg_apply(m,qubit,qreg);
+		 diag_apply(m(1,1),qubit,qreg);
 		 return 0;
 	   }
 
@@ -1710,6 +3693,11 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 		 return r;
 	   }
 
+	   bool get_matrix(cvector_t& r)
+	   {
+	      r.assign(m.m, m.m+4);
+	      return true;
+	   }
 
 	   gate_type_t type()
 	   {
@@ -1738,7 +3726,7 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
+            diag_apply(m(1,1),qubit,qreg);
             return 0;
          }
 
@@ -1767,6 +3755,12 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
             return __tdag_gate__;
@@ -1807,43 +3801,248 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
    }
 
    /**
-    *                  | (cos(?/2)       -e(i?)sin(?/2))    |
-    * general gate u = |                                    |
-    *                  | (e(i?)sin(?/2)   e(i?+i?)cos(?/2)) |
-    */
-   class unitary : public gate
+    *                  | (cos(?/2)       -e(i?)sin(?/2))    |
+    * general gate u = |                                    |
+    *                  | (e(i?)sin(?/2)   e(i?+i?)cos(?/2)) |
+    */
+   class unitary : public gate
+   {
+      private:
+
+         uint64_t   qubit;
+         double     angle[3];
+         cmatrix_t  m;
+
+      public:
+
+         unitary(uint64_t qubit, double angle[3]) : qubit(qubit)
+         {
+            // m.resize(2,2);
+            m(0,0) = cos(angle[1]/2);      m(0,1) = complex_t(-cos(angle[2]/2),-sin(angle[2]/2))*sin(angle[1]/2);
+            m(1,0) = complex_t(cos(angle[3]/2),sin(angle[3]/2))*sin(angle[1]/2) ; m(1,1) = complex_t(cos((angle[3]/2)+(angle[2]/2)),sin((angle[3]/2)+(angle[2]/2)))*cos(angle[1]/2);
+         }
+
+         int64_t apply(qu_register& qreg)
+         {
+            sqg_apply(m,qubit,qreg);
+            qreg.set_measurement_prediction(qubit,__state_unknown__);
+            // qreg.set_binary(qubit,__state_unknown__);
+            return 0;
+         }
+
+         double get_angle()
+         {
+            return *angle;
+         }
+
+         void dump()
+         {
+            println("  [-] unitary(qubit=" << qubit << ", angle=" << angle << ")");
+         }
+
+         std::vector<uint64_t>  qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(qubit);
+            return r;
+         }
+
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            return r;
+         }
+
+         std::vector<uint64_t>  target_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(qubit);
+            return r;
+         }
+
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
+         gate_type_t type()
+         {
+            return __unitary_gate__;
+         }
+
+   };
+
+   /**
+    * \brief  rotation-x :
+    */ 
+   class rx : public gate
+   {
+      private:
+
+         uint64_t   qubit;
+         double     angle;
+         cmatrix_t  m;
+
+      public:
+
+         rx(uint64_t qubit, double angle) : qubit(qubit), angle(angle)
+         {
+            // m.resize(2,2);
+            m(0,0) = cos(angle/2);      m(0,1) = complex_t(0,-sin(angle/2));
+            m(1,0) = complex_t(0,-sin(angle/2)); m(1,1) = cos(angle/2);
+            reset_gphase(m);
+         }
+
+         int64_t apply(qu_register& qreg)
+         {
+            sqg_apply(m,qubit,qreg);
+            qreg.set_measurement_prediction(qubit,__state_unknown__);
+            // qreg.set_binary(qubit,__state_unknown__);
+            return 0;
+         }
+
+         void dump()
+         {
+            println("  [-] rx(qubit=" << qubit << ", angle=" << angle << ")");
+         }
+
+         std::vector<uint64_t>  qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(qubit);
+            return r;
+         }
+
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            return r;
+         }
+
+         std::vector<uint64_t>  target_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(qubit);
+            return r;
+         }
+
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
+         gate_type_t type()
+         {
+            return __rx_gate__; 
+         }
+
+   };
+
+
+   /**
+    * \brief  rotation-y :
+    */ 
+   class ry : public gate
+   {
+      private:
+
+         uint64_t   qubit;
+         double     angle;
+         cmatrix_t  m;
+
+      public:
+
+         ry(uint64_t qubit, double angle) : qubit(qubit), angle(angle)
+         {
+            // m.resize(2,2);
+            m(0,0) = cos(angle/2);   m(0,1) = -sin(angle/2);
+            m(1,0) = sin(angle/2);   m(1,1) =  cos(angle/2);
+            // reset_gphase(m);
+         }
+
+         int64_t apply(qu_register& qreg)
+         {
+            sqg_apply(m,qubit,qreg);
+            qreg.set_measurement_prediction(qubit,__state_unknown__);
+            //qreg.set_binary(qubit,__state_unknown__);
+            return 0;
+         }
+
+         void dump()
+         {
+            println("  [-] ry(qubit=" << qubit << ", angle=" << angle << ")");
+         }
+
+         std::vector<uint64_t>  qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(qubit);
+            return r;
+         }
+
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            return r;
+         }
+
+         std::vector<uint64_t>  target_qubits()
+         {
+            std::vector<uint64_t> r;
+            r.push_back(qubit);
+            return r;
+         }
+
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
+         gate_type_t type()
+         {
+            return __ry_gate__;
+         }
+   };
+
+
+   /**
+    * \brief  rotation-z :
+    */ 
+   class rz : public gate
    {
       private:
 
          uint64_t   qubit;
-         double     angle[3];
+         double     angle;
          cmatrix_t  m;
+         complex_t  p;
 
       public:
 
-         unitary(uint64_t qubit, double angle[3]) : qubit(qubit)
+         rz(uint64_t qubit, double angle) : qubit(qubit), angle(angle)
          {
             // m.resize(2,2);
-            m(0,0) = cos(angle[1]/2);      m(0,1) = complex_t(-cos(angle[2]/2),-sin(angle[2]/2))*sin(angle[1]/2);
-            m(1,0) = complex_t(cos(angle[3]/2),sin(angle[3]/2))*sin(angle[1]/2) ; m(1,1) = complex_t(cos((angle[3]/2)+(angle[2]/2)),sin((angle[3]/2)+(angle[2]/2)))*cos(angle[1]/2);
+            m(0,0) = complex_t(cos(-angle/2), sin(-angle/2));   m(0,1) = 0;
+            m(1,0) = 0;  m(1,1) =  complex_t(cos(angle/2), sin(angle/2)); 
+            reset_gphase(m);
+            p = complex_t(cos(angle), sin(angle));
          }
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
+            // diag(1,e^(i*angle)), i.e. m up to the global phase removed above
+            diag_apply(p,qubit,qreg);
             qreg.set_measurement_prediction(qubit,__state_unknown__);
-            // qreg.set_binary(qubit,__state_unknown__);
+            //qreg.set_binary(qubit,__state_unknown__);
             return 0;
          }
 
-         double get_angle()
-         {
-            return *angle;
-         }
-
          void dump()
          {
-            println("  [-] unitary(qubit=" << qubit << ", angle=" << angle << ")");
+            println("  [-] rz(qubit=" << qubit << ", angle=" << angle << ")");
          }
 
          std::vector<uint64_t>  qubits()
@@ -1866,728 +4065,979 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(m.m, m.m+4);
+            return true;
+         }
+
          gate_type_t type()
          {
-            return __unitary_gate__;
+            return __rz_gate__; 
+         }
+   };
+
+   void __shift(cvector_t& amp, size_t size, size_t bit, complex_t p, size_t offset=0)
+   {
+      // println("bit=" << bit);
+      // println("ctrl=" << ctrl);
+      complex_t * x = amp.data();
+      // println(">>>> " << p);
+      for (size_t i=__bit_set(0,bit); i<(1UL<<size); i += (1UL << (bit+1)))
+         for (size_t j=0; j<(1UL<<bit); j++)
+         {
+            size_t v = i+j+offset; 
+            // amp[v] *= p;
+            // println(" before mul : " << x[v]);
+            x[v] *= p;
+            // println(" after mul : " << x[v]);
+            // println(" swap(" << std::bitset<16>(v) << "," << std::bitset<16>(__bit_reset(v,trg)) << ")");
+         }
+   }
+
+   void __shift(complex_t * x, size_t size, size_t bit, complex_t p, size_t offset=0)
+   {
+      // println("bit=" << bit);
+      // println("ctrl=" << ctrl);
+      for (size_t i=__bit_set(0,bit); i<(1UL<<size); i += (1UL << (bit+1)))
+         for (size_t j=0; j<(1UL<<bit); j++)
+         {
+            size_t v = i+j+offset; 
+            // amp[v] *= p;
+            x[v] *= p;
+            // println(" swap(" << std::bitset<16>(v) << "," << std::bitset<16>(__bit_reset(v,trg)) << ")");
          }
+   }
+
+
+
+
+   int shift_worker(int cs, int ce, int s, cvector_t * p_amp, size_t bit1, size_t bit2, complex_t p)
+   {
+      cvector_t &amp = * p_amp;
+      // xpu::parallel_for fswp(__bit_set(0,b1), (1 << qn), (1 << (b1+1)), &t);
+      size_t step=(1UL << (bit1+1));
+      size_t b   = cs;
+      size_t e   = ce;
+
+      size_t offset = __bit_set(0,bit1);
+
+      //for (size_t i=__bit_set(0,bit1); i<(1<<size); i += (1 << (bit1+1)))
+      //__swap(amp,bit1,bit2,trg,ctrl,i);
+      for (size_t i=b; i<e; i++)
+         __shift(amp,bit1,bit2,p,offset+(i*step));
+      return 0;
+   }
+
 
+   /**
+    * \brief twiddle factors tw(t) = e^(sign*2*pi*i*t/2^k), t < 2^(k-1), kept
+    *  as two tables of about 2^(k/2) entries each :
+    *  tw(t) = coarse[t >> f] * fine[t & (2^f-1)]
+    */
+   struct __qft_twiddles
+   {
+      size_t     f;
+      cvector_t  fine;
+      cvector_t  coarse;
+
+      __qft_twiddles(size_t k, double sign)
+      {
+         size_t b = (k > 1 ? k-1 : 0);
+         f = (b+1)/2;
+         fine.resize(1UL << f);
+         coarse.resize(1UL << (b-f));
+         double w = sign*2*QX_PI/(double)(1UL << k);
+         for (size_t r=0; r<fine.size(); ++r)
+            fine[r] = complex_t(cos(w*r), sin(w*r));
+         for (size_t c=0; c<coarse.size(); ++c)
+            coarse[c] = complex_t(cos(w*(c << f)), sin(w*(c << f)));
+      }
+
+      inline complex_t operator () (size_t t) const
+      {
+         return coarse[t >> f]*fine[t & ((1UL << f)-1)];
+      }
    };
 
    /**
-    * \brief  rotation-x :
-    */ 
-   class rx : public gate
+    * \brief radix-2 butterfly on the amplitudes i0 and i0+d (r : 1/sqrt(2))
+    */
+   inline void __qft_butterfly2(complex_t * s, size_t i0, size_t d, const complex_t& w, const __m128d r)
+   {
+      complex_t a = s[i0];
+      complex_t b = w*s[i0+d];
+      s[i0].xmm   = _mm_mul_pd((a+b).xmm, r);
+      s[i0+d].xmm = _mm_mul_pd((a-b).xmm, r);
+   }
+
+   /**
+    * \brief radix-4 butterfly (two radix-2 stages) on the amplitudes
+    *  i0 + {0,1,2,3}*d. w1 and w2 are the twiddles of the first and second
+    *  stage, w4 is +/-i.
+    */
+   inline void __qft_butterfly4(complex_t * s, size_t i0, size_t d, const complex_t& w1, const complex_t& w2, const complex_t& w4)
+   {
+      complex_t w3 = w2*w4;
+      __m128d   h  = _mm_set1_pd(0.5);
+      complex_t a0 = s[i0];
+      complex_t a1 = w1*s[i0+d];
+      complex_t a2 = s[i0+2*d];
+      complex_t a3 = w1*s[i0+3*d];
+      complex_t b0 = a0+a1;
+      complex_t b1 = a0-a1;
+      complex_t b2 = w2*(a2+a3);
+      complex_t b3 = w3*(a2-a3);
+      s[i0].xmm     = _mm_mul_pd((b0+b2).xmm, h);
+      s[i0+d].xmm   = _mm_mul_pd((b1+b3).xmm, h);
+      s[i0+2*d].xmm = _mm_mul_pd((b0-b2).xmm, h);
+      s[i0+3*d].xmm = _mm_mul_pd((b1-b3).xmm, h);
+   }
+
+   /**
+    * \brief twiddles of one qft pass : pt[u] = tw(u << (k-st-2)) for the
+    *  radix-4 pass over stages st and st+1 (tw(u << (k-st-1)) for a radix-2
+    *  pass), u < 2^(st+1) (2^st). left empty above 2^16 entries, the pass
+    *  then uses the two-level table.
+    */
+   inline void __qft_pass_twiddles(cvector_t& pt, bool radix4, size_t k, size_t st, const __qft_twiddles& tw)
+   {
+      size_t e  = (radix4 ? st+1 : st);
+      size_t sh = k-1-e;
+      pt.clear();
+      if (e > 16)
+         return;
+      pt.resize(1UL << e);
+      for (size_t u=0; u<pt.size(); ++u)
+         pt[u] = tw(u << sh);
+   }
+
+   /**
+    * \brief butterflies [b0,b1) of one qft pass (radix-4 over stages st and
+    *  st+1, or radix-2 over stage st), indexed from <base>. <pt> holds the
+    *  pass twiddles (see __qft_pass_twiddles()) unless empty.
+    */
+   inline void __qft_pass(complex_t * s, size_t base, size_t b0, size_t b1, bool radix4, size_t lo, size_t k, size_t st, const __qft_twiddles& tw, const cvector_t& pt)
+   {
+      size_t            p  = lo+st;
+      size_t            m  = (1UL << p)-1;
+      size_t            jm = (1UL << st)-1;
+      size_t            d  = (1UL << p);
+      const complex_t * w  = (pt.empty() ? NULL : pt.data());
+      if (radix4)
+      {
+         complex_t w4 = tw(1UL << (k-2));
+         for (size_t b=b0; b<b1; ++b)
+         {
+            size_t i0 = base + (((b >> p) << (p+2)) | (b & m));
+            size_t j  = (i0 >> lo) & jm;
+            if (w)
+               __qft_butterfly4(s, i0, d, w[2*j], w[j], w4);
+            else
+               __qft_butterfly4(s, i0, d, tw(j << (k-1-st)), tw(j << (k-2-st)), w4);
+         }
+      }
+      else
+      {
+         __m128d r = _mm_set1_pd(1/std::sqrt(2.0));
+         for (size_t b=b0; b<b1; ++b)
+         {
+            size_t i0 = base + __bit_insert(b,p);
+            size_t j  = (i0 >> lo) & jm;
+            __qft_butterfly2(s, i0, d, (w ? w[j] : tw(j << (k-1-st))), r);
+         }
+      }
+   }
+
+   /**
+    * \brief bit-reverse the field of k qubits starting at qubit lo
+    */
+   void __qft_reverse(size_t n, size_t lo, size_t k, complex_t * s)
+   {
+      if (k < 2)
+         return;
+      size_t hb = k/2;
+      size_t lb = k-hb;
+      std::vector<size_t> rt(1UL << lb);
+      for (size_t x=0; x<rt.size(); ++x)
+      {
+         rt[x] = 0;
+         for (size_t i=0; i<lb; ++i)
+            if ((x >> i) & 1)
+               rt[x] |= (1UL << (lb-1-i));
+      }
+      const size_t * prt = rt.data();
+      size_t fm = (1UL << k)-1;
+      size_t lm = (1UL << lb)-1;
+      int64_t ns = (int64_t)(1UL << n);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t i=0; i<ns; ++i)
+      {
+         size_t f = (((size_t)i) >> lo) & fm;
+         size_t r = (prt[f & lm] << hb) | (prt[f >> lb] >> (lb-hb));
+         if (r > f)
+            std::swap(s[i], s[i ^ ((f ^ r) << lo)]);
+      }
+   }
+
+   /**
+    * \brief in-place qft on the k qubits lo..lo+k-1 of an n-qubit state :
+    *  optional bit reversal of the field (<pre>), then the decimation in
+    *  time fft (sign +1 : qft, -1 : inverse qft), normalized, without its
+    *  bit reversal, then another optional bit reversal (<post>).
+    *
+    *  the fft alone is the H + controlled-phase ladder of the textbook qft
+    *  circuit (h q[lo]; cr q[lo+1],q[lo],pi/2; ... h q[lo+k-1]), the
+    *  closing swaps being the bit reversal.
+    *
+    *  passes are radix-4 (radix-2 for the last one when k is odd). the
+    *  passes whose butterflies stay within 2^14 amplitudes (256 KB) are
+    *  applied block by block, the others in one parallel sweep each.
+    */
+   void __apply_qft(size_t n, size_t lo, size_t k, complex_t * s, double sign, bool pre, bool post)
+   {
+      const size_t   block = 14;
+      __qft_twiddles tw(k, sign);
+
+      if (pre)
+         __qft_reverse(n, lo, k, s);
+
+      size_t bq = std::min(block, n);
+      size_t st = 0;
+      // passes local to a block
+      size_t ls = st;
+      while ((ls < k) && (lo+ls+((ls+1 < k) ? 1 : 0) < bq))
+         ls += ((ls+1 < k) ? 2 : 1);
+      if (ls > st)
+      {
+         std::vector<cvector_t> pt((ls+1)/2);
+         for (size_t t=st; t<ls; t+=2)
+            __qft_pass_twiddles(pt[t/2], (t+1 < k), k, t, tw);
+         int64_t blocks = (int64_t)(1UL << (n-bq));
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+         for (int64_t bl=0; bl<blocks; ++bl)
+         {
+            for (size_t t=st; t<ls; t+=2)
+            {
+               bool r4 = (t+1 < k);
+               __qft_pass(s, ((size_t)bl) << bq, 0, (1UL << (bq - (r4 ? 2 : 1))), r4, lo, k, t, tw, pt[t/2]);
+            }
+         }
+         st = ls;
+      }
+      // remaining passes, parallelized over the butterflies
+      const size_t chunk = 1024;
+      cvector_t    pt;
+      for (; st<k; st+=2)
+      {
+         bool    r4  = (st+1 < k);
+         size_t  nb  = (1UL << (n - (r4 ? 2 : 1)));
+         int64_t nc  = (int64_t)((nb+chunk-1)/chunk);
+         __qft_pass_twiddles(pt, r4, k, st, tw);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+         for (int64_t c=0; c<nc; ++c)
+            __qft_pass(s, 0, c*chunk, std::min<size_t>((c+1)*chunk, nb), r4, lo, k, st, tw, pt);
+      }
+
+      if (post)
+         __qft_reverse(n, lo, k, s);
+   }
+
+   /**
+    * \brief quantum fourier transform (or its inverse) on a contiguous range
+    *  of qubits.
+    *
+    *  qubits[0] is the first qubit of the textbook circuit (the most
+    *  significant bit of the input) : qft({0,1,2}) is
+    *     h q0; cr q1,q0,pi/2; cr q2,q0,pi/4; h q1; cr q2,q1,pi/2; h q2;
+    *     swap q0,q2
+    *  the qubits can be listed in increasing or decreasing order. <swaps>
+    *  includes the closing swaps (the bit reversal of the output).
+    */
+   class qft : public gate
    {
       private:
 
-         uint64_t   qubit;
-         double     angle;
-         cmatrix_t  m;
+         std::vector<uint64_t>     qubit;
+         bool                      inverse;
+         bool                      swaps;
+         uint64_t                  lo;
 
       public:
 
-         rx(uint64_t qubit, double angle) : qubit(qubit), angle(angle)
+         qft(std::vector<uint64_t> qubit, bool inverse=false, bool swaps=true) : qubit(qubit), inverse(inverse), swaps(swaps)
          {
-            // m.resize(2,2);
-            m(0,0) = cos(angle/2);      m(0,1) = complex_t(0,-sin(angle/2));
-            m(1,0) = complex_t(0,-sin(angle/2)); m(1,1) = cos(angle/2);
-            reset_gphase(m);
+            if (qubit.empty())
+               throw std::invalid_argument("qft : empty qubit list");
+            bool up   = true;
+            bool down = true;
+            for (size_t i=1; i<qubit.size(); ++i)
+            {
+               up   = up && (qubit[i] == qubit[0]+i);
+               down = down && (qubit[i]+i == qubit[0]);
+            }
+            if (!up && !down)
+               throw std::invalid_argument("qft : the qubits must be a contiguous range");
+            lo = std::min(qubit.front(), qubit.back());
          }
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
-            qreg.set_measurement_prediction(qubit,__state_unknown__);
-            // qreg.set_binary(qubit,__state_unknown__);
+            // the fft computes F.R (R : bit reversal of the field, F : dft with
+            // qubit lo as least significant bit), the circuit is :
+            //    increasing, no swaps : F.R      decreasing, no swaps : R.F
+            //    increasing, swaps    : R.F.R    decreasing, swaps    : F
+            size_t k    = qubit.size();
+            bool   up   = (k == 1) || (qubit[1] > qubit[0]);
+            bool   pre  = (inverse ? (up != swaps) : !up);
+            bool   post = (inverse ? up : (up == swaps));
+            __apply_qft(qreg.size(), lo, k, qreg.get_data().data(), (inverse ? -1.0 : 1.0), pre, post);
+            for (size_t i=0; i<k; ++i)
+               qreg.set_measurement_prediction(qubit[i], __state_unknown__);
             return 0;
          }
 
          void dump()
          {
-            println("  [-] rx(qubit=" << qubit << ", angle=" << angle << ")");
+            print("  [-] " << (inverse ? "inverse qft(" : "qft("));
+            for (size_t i=0; i<(qubit.size()-1); ++i)
+               print("q" << qubit[i] << ","); 
+            println("q" << qubit[qubit.size()-1] << (swaps ? ")" : ", no swaps)"));
          }
 
          std::vector<uint64_t>  qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(qubit);
-            return r;
+            return qubit;
          }
 
          std::vector<uint64_t>  control_qubits()
          {
-            std::vector<uint64_t> r;
-            return r;
+            return qubit;
          }
 
          std::vector<uint64_t>  target_qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(qubit);
-            return r;
+            return qubit;
          }
 
          gate_type_t type()
          {
-            return __rx_gate__; 
+            return __qft_gate__; 
+         }
+   };
+
+   /**
+    * \brief  controlled phase shift by arbitrary phase angle or (2*pi/(2^(k=ctrl-target)))
+    */ 
+   class ctrl_phase_shift : public gate
+   {
+      private:
+
+         uint64_t                  ctrl_qubit;
+         uint64_t                  target_qubit;
+         complex_t                 z;
+         complex_t                 m[2][2];
+         double                    phase;
+
+      protected:
+
+         void build_operator()
+         {
+            m[0][0] = complex_t(cos(-phase/2), sin(-phase/2));   m[0][1] = 0.0;
+            m[1][0] = 0.0;                                       m[1][1] =  complex_t(cos(phase/2), sin(phase/2));
+
+            double n = m[0][0].norm();
+            if (n > 10e-9)
+            {
+               complex_t p(m[0][0].re/n,m[0][0].im/n);
+               m[0][0] /= p;
+               m[0][1] /= p;
+               m[1][0] /= p;
+               m[1][1] /= p;
+            }
+            else
+            {
+               n = m[0][1].norm();
+               complex_t p(m[0][0].re/n,m[0][0].im/n);
+               m[0][0] /= p;
+               m[0][1] /= p;
+               m[1][0] /= p;
+               m[1][1] /= p;
+            }
+         }
+
+
+
+      public:
+
+         /**
+          * ctor (q)
+          */
+         ctrl_phase_shift(uint64_t ctrl_qubit, uint64_t target_qubit) :    ctrl_qubit(ctrl_qubit), 
+                                                                           target_qubit(target_qubit),
+                                                                           z(0.0, 0.0)
+         {
+            phase = 2*QX_PI/(1UL << (ctrl_qubit - target_qubit));
+            build_operator();
          }
 
-   };
-
 
-   /**
-    * \brief  rotation-y :
-    */ 
-   class ry : public gate
-   {
-      private:
-
-         uint64_t   qubit;
-         double     angle;
-         cmatrix_t  m;
+         /**
+          * ctor (k)
+          */
+         ctrl_phase_shift(uint64_t ctrl_qubit, uint64_t target_qubit, size_t k) : ctrl_qubit(ctrl_qubit), 
+                                                                                    target_qubit(target_qubit)  
+         {               
+            phase = 2*QX_PI/(1UL << k);
+            build_operator();
+         }
 
-      public:
 
-         ry(uint64_t qubit, double angle) : qubit(qubit), angle(angle)
+         /**
+          * ctor (p)
+          */
+         ctrl_phase_shift(uint64_t ctrl_qubit, uint64_t target_qubit, double angle) : ctrl_qubit(ctrl_qubit), 
+                                                                                      target_qubit(target_qubit) 
          {
-            // m.resize(2,2);
-            m(0,0) = cos(angle/2);   m(0,1) = -sin(angle/2);
-            m(1,0) = sin(angle/2);   m(1,1) =  cos(angle/2);
-            // reset_gphase(m);
+            phase = angle;
+            build_operator();
          }
 
+         
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
-            qreg.set_measurement_prediction(qubit,__state_unknown__);
-            //qreg.set_binary(qubit,__state_unknown__);
+            // m is diag(1,e^(i*phase)) once the global phase is factored out
+            __apply_cphase(qreg.size(), ctrl_qubit, target_qubit, qreg.get_data().data(), m[1][1]);
             return 0;
          }
 
          void dump()
          {
-            println("  [-] ry(qubit=" << qubit << ", angle=" << angle << ")");
+            println("  [-] ctrl_phase_shift(ctrl_qubit=" << ctrl_qubit << ", target_qubit: " << target_qubit << ", phase = (" << z.re << ", i." << z.im << ") )");
          }
 
          std::vector<uint64_t>  qubits()
          {
             std::vector<uint64_t> r;
-            r.push_back(qubit);
+            r.push_back(ctrl_qubit);
+            r.push_back(target_qubit);
             return r;
          }
 
          std::vector<uint64_t>  control_qubits()
          {
             std::vector<uint64_t> r;
+            r.push_back(ctrl_qubit);
             return r;
          }
 
          std::vector<uint64_t>  target_qubits()
          {
             std::vector<uint64_t> r;
-            r.push_back(qubit);
+            r.push_back(target_qubit);
             return r;
          }
 
+         bool get_matrix(cvector_t& r)
+         {
+            complex_t d[] = { complex_t(1.0, 0.0), complex_t(0.0, 0.0), complex_t(0.0, 0.0), m[1][1] };
+            build_ctrl_matrix(r, 1, d);
+            return true;
+         }
 
          gate_type_t type()
          {
-            return __ry_gate__;
+            return __ctrl_phase_shift_gate__; 
          }
    };
 
 
+
    /**
-    * \brief  rotation-z :
-    */ 
-   class rz : public gate
+    * \brief  swap :
+    *
+    *    | 1  0  0  0 | 
+    *    | 0  0  1  0 |
+    *    | 0  1  0  0 |
+    *    | 0  0  0  1 |  
+    */
+   class swap : public gate
    {
       private:
 
-         uint64_t   qubit;
-         double     angle;
-         cmatrix_t  m;
+         uint64_t qubit1;
+         uint64_t qubit2;
+
+         // cmatrix_t m;
 
       public:
 
-         rz(uint64_t qubit, double angle) : qubit(qubit), angle(angle)
+         swap(uint64_t qubit1, uint64_t qubit2) : qubit1(qubit1), qubit2(qubit2)
          {
-            // m.resize(2,2);
-            m(0,0) = complex_t(cos(-angle/2), sin(-angle/2));   m(0,1) = 0;
-            m(1,0) = 0;  m(1,1) =  complex_t(cos(angle/2), sin(angle/2)); 
-            reset_gphase(m);
+            // m =  build_matrix(swap_c,4);
          }
 
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
-            qreg.set_measurement_prediction(qubit,__state_unknown__);
-            //qreg.set_binary(qubit,__state_unknown__);
+            __apply_swap(qreg.size(), qubit1, qubit2, qreg.get_data().data());
+
+            state_t p1 = qreg.get_measurement_prediction(qubit1);
+            qreg.set_measurement_prediction(qubit1, qreg.get_measurement_prediction(qubit2));
+            qreg.set_measurement_prediction(qubit2, p1);
             return 0;
          }
 
-         void dump()
+
+         void    dump()
          {
-            println("  [-] rz(qubit=" << qubit << ", angle=" << angle << ")");
+            println("  [-] swap(q1=" << qubit1 << ", q2=" << qubit2 << ")");
          }
 
          std::vector<uint64_t>  qubits()
          {
             std::vector<uint64_t> r;
-            r.push_back(qubit);
+            r.push_back(qubit1);
+            r.push_back(qubit2);
             return r;
          }
 
          std::vector<uint64_t>  control_qubits()
          {
-            std::vector<uint64_t> r;
-            return r;
-         }
-
-         std::vector<uint64_t>  target_qubits()
-         {
-            std::vector<uint64_t> r;
-            r.push_back(qubit);
-            return r;
-         }
-
-         gate_type_t type()
-         {
-            return __rz_gate__; 
-         }
-   };
-
-   void __shift(cvector_t& amp, size_t size, size_t bit, complex_t p, size_t offset=0)
-   {
-      // println("bit=" << bit);
-      // println("ctrl=" << ctrl);
-      complex_t * x = amp.data();
-      // println(">>>> " << p);
-      for (size_t i=__bit_set(0,bit); i<(1UL<<size); i += (1UL << (bit+1)))
-         for (size_t j=0; j<(1UL<<bit); j++)
-         {
-            size_t v = i+j+offset; 
-            // amp[v] *= p;
-            // println(" before mul : " << x[v]);
-            x[v] *= p;
-            // println(" after mul : " << x[v]);
-            // println(" swap(" << std::bitset<16>(v) << "," << std::bitset<16>(__bit_reset(v,trg)) << ")");
-         }
-   }
-
-   void __shift(complex_t * x, size_t size, size_t bit, complex_t p, size_t offset=0)
-   {
-      // println("bit=" << bit);
-      // println("ctrl=" << ctrl);
-      for (size_t i=__bit_set(0,bit); i<(1UL<<size); i += (1UL << (bit+1)))
-         for (size_t j=0; j<(1UL<<bit); j++)
-         {
-            size_t v = i+j+offset; 
-            // amp[v] *= p;
-            x[v] *= p;
-            // println(" swap(" << std::bitset<16>(v) << "," << std::bitset<16>(__bit_reset(v,trg)) << ")");
-         }
-   }
-
-
-
-
-   int shift_worker(int cs, int ce, int s, cvector_t * p_amp, size_t bit1, size_t bit2, complex_t p)
-   {
-      cvector_t &amp = * p_amp;
-      // xpu::parallel_for fswp(__bit_set(0,b1), (1 << qn), (1 << (b1+1)), &t);
-      size_t step=(1UL << (bit1+1));
-      size_t b   = cs;
-      size_t e   = ce;
-
-      size_t offset = __bit_set(0,bit1);
-
-      //for (size_t i=__bit_set(0,bit1); i<(1<<size); i += (1 << (bit1+1)))
-      //__swap(amp,bit1,bit2,trg,ctrl,i);
-      for (size_t i=b; i<e; i++)
-         __shift(amp,bit1,bit2,p,offset+(i*step));
-      return 0;
-   }
-
-
-   uint64_t qft_1st_fold_worker(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_ui m, cvector_t * v, cvector_t * res)
-   {
-      uint64_t k = n-qubit;
-      // println("run : " << is << " .. " << ie);
-      complex_t * pv = v->data();
-      complex_t * pr = res->data();
-      size_t bc, c1, c2;
-
-      for (uint64_t r=is; r<ie; ++r)
-      {
-         bc = r;
-         c1 = __bit_reset(bc,n-k);
-         c2 = __bit_set(bc,n-k);
-#ifdef __OP_PREFETCH__
-         _mm_prefetch((char*)&pv[__bit_reset((bc+1),n-k)],_MM_HINT_T0);
-         _mm_prefetch((char*)&pv[__bit_set((bc+1),n-k)],_MM_HINT_T0);
-#endif // __OP_PREFETCH__
-#ifdef __AVX__ //NO 
-         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
-#else
-         // complex_t s; // = 0;
-         //pr[r] = pv[c1]*(m->get(r,c1)) + pv[c2]*(m->get(r,c2));
-         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
-#endif
-      }
-      size_t bit2 = qubit;
-      for (size_t j=qubit+1; j<n; ++j)
-      {
-         complex_t  p(cos(QX_PI/(1UL << (j-qubit))), sin(QX_PI/(1UL << (j- qubit))));
-         size_t bit1 = j;
-         size_t step=(1UL << (bit1+1));
-         size_t offset = __bit_set(0,bit1);
-         for (size_t i=is; i<ie; i++)
-         {
-            // println("i=" << i*step);
-            __shift(pr,bit1,bit2,p,offset+(i*step));
-         }
-      }
-
-      return 0;
-   }
-
-
-   void qft_1st_fold(uint64_t n, uint64_t qubit, kronecker_ui m, cvector_t& v, cvector_t& res)
-   {
-      uint64_t k = n-qubit;
-      uint64_t rows = (1UL << n);
-      uint64_t z = 0;
-
-      //xpu::task qf_t(qft_fold_worker,0,0,0,n,qubit,m,&v,&res);
-      //xpu::parallel_for process(z,rows,1,&qf_t);
-      //process.run();
-
-      static const uint64_t SIZE = 1000;
-#ifdef USE_OPENMP
-#pragma omp parallel for
-#endif
-      for (int64_t batch = 0; batch <= rows / SIZE; batch++) {
-        qft_1st_fold_worker(batch*SIZE,std::min<uint64_t>((batch+1)*SIZE,rows),1,n,qubit,m,&v,&res);
-      }
-
-   }
-
-
-   uint64_t qft_nth_fold_worker(uint64_t is, uint64_t ie, uint64_t s, uint64_t n, uint64_t qubit, kronecker_iui m, cvector_t * v, cvector_t * res)
-   {
-      uint64_t k = n-qubit;
-      // println("run : " << is << " .. " << ie);
-      complex_t * pv = v->data();
-      complex_t * pr = res->data();
-      size_t bc, c1, c2;
-
-      for (uint64_t r=is; r<ie; ++r)
-      {
-         bc = r;
-         c1 = __bit_reset(bc,n-k);
-         c2 = __bit_set(bc,n-k);
-#ifdef __OP_PREFETCH__
-         _mm_prefetch((char*)&pv[__bit_reset((bc+1),n-k)],_MM_HINT_T0);
-         _mm_prefetch((char*)&pv[__bit_set((bc+1),n-k)],_MM_HINT_T0);
-#endif // __OP_PREFETCH__
-#ifdef __AVX__ //NO 
-         xpu::_mm_cmul_add_pd(pv[c1], pv[c2], m.get(r,c1), m.get(r,c2),pr[r]);
-#else
-         // complex_t s; // = 0;
-         //pr[r] = pv[c1]*(m->get(r,c1)) + pv[c2]*(m->get(r,c2));
-         pr[r].xmm = _mm_add_pd((pv[c1]*(m.get(r,c1))).xmm, (pv[c2]*(m.get(r,c2))).xmm);
-#endif
-      }
-      size_t bit2 = qubit;
-      for (size_t j=qubit+1; j<n; ++j)
-      {
-         complex_t  p(cos(QX_PI/(1UL << (j-qubit))), sin(QX_PI/(1UL << (j-qubit))));
-         size_t bit1 = j;
-         size_t step=(1UL << (bit1+1));
-         size_t offset = __bit_set(0,bit1);
-         for (size_t i=is; i<ie; i++)
-         {
-            __shift(pr,bit1,bit2,p,offset+(i*step));
-         }
-      }
-
-      return 0;
-   }
-
-   void qft_nth_fold(uint64_t n, uint64_t qubit, kronecker_iui m, cvector_t& v, cvector_t& res)
-   {
-      uint64_t k = n-qubit;
-      uint64_t rows = (1UL << n);
-      uint64_t z = 0;
-
-      //xpu::task qf_t(qft_fold_worker,0,0,0,n,qubit,m,&v,&res);
-      //xpu::parallel_for process(z,rows,1,&qf_t);
-      //process.run();
-
-      static const uint64_t SIZE = 1000;
-#ifdef USE_OPENMP
-#pragma omp parallel for
-#endif
-      for (int64_t batch = 0; batch <= rows / SIZE; batch++) {
-        qft_nth_fold_worker(batch*SIZE,std::min<uint64_t>((batch+1)*SIZE,rows),1,n,qubit,m,&v,&res);
-      }
-
-   }
-
-
-   int qft_worker(int cs, int ce, int s, size_t n, cvector_t& p_in, cvector_t& p_out, kronecker_ui kr, size_t qubit)
-   {
-      complex_t * in  = p_in.data();
-      complex_t * out = p_out.data();
-      cvector_t & amp = p_out;
-      // xpu::parallel_for fswp(__bit_set(0,b1), (1 << qn), (1 << (b1+1)), &t);
-      size_t b   = cs;
-      size_t e   = ce;
-
-      rw_process_ui(cs, ce, s, n, qubit, kr, &p_in, &p_out); // H 
+            std::vector<uint64_t> r;
+            return r;
+         }
 
-      size_t bit2 = qubit;
-      for (size_t j=qubit+1; j<n; ++j)
-      {
-         complex_t  p(cos(QX_PI/(1UL << (j-qubit))), sin(QX_PI/(1UL << (j- qubit))));
-         size_t bit1 = j;
-         size_t step=(1UL << (bit1+1));
-         size_t offset = __bit_set(0,bit1);
-         for (size_t i=b; i<e; i++)
+         std::vector<uint64_t>  target_qubits()
          {
-            println("i=" << i*step);
-            __shift(amp,bit1,bit2,p,offset+(i*step));
+            std::vector<uint64_t> r;
+            r.push_back(qubit1);
+            r.push_back(qubit2);
+            return r;
          }
-      }
-      return 0;
-   }
 
+         bool get_matrix(cvector_t& r)
+         {
+            r.assign(16, complex_t(0.0, 0.0));
+            r[0*4+0] = complex_t(1.0, 0.0); r[1*4+2] = complex_t(1.0, 0.0);
+            r[2*4+1] = complex_t(1.0, 0.0); r[3*4+3] = complex_t(1.0, 0.0);
+            return true;
+         }
 
-   int qft_worker(int cs, int ce, int s, size_t n, cvector_t& p_in, cvector_t& p_out, kronecker_iui kr, size_t qubit)
-   {
-      complex_t * in  = p_in.data();
-      complex_t * out = p_out.data();
-      cvector_t & amp = p_out;
-      // xpu::parallel_for fswp(__bit_set(0,b1), (1 << qn), (1 << (b1+1)), &t);
-      size_t b   = cs;
-      size_t e   = ce;
-      rw_process_iui(cs, ce, s, n, qubit, kr, &p_in, &p_out); // H 
-      return 0;
-      size_t bit2 = qubit;
-      for (size_t j=qubit+1; j<n; ++j)
-      {
-         complex_t  p(cos(QX_PI/(1UL << (j-qubit))), sin(QX_PI/(1UL << (j- qubit))));
-         size_t bit1 = j;
-         size_t step=(1UL << (bit1+1));
-         size_t offset = __bit_set(0,bit1);
-         for (size_t i=b; i<e; i++)
+         gate_type_t type()
          {
-            __shift(p_out,bit1,bit2,p,offset+(i*step));
+            return __swap_gate__; 
          }
-      }
-      return 0;
-   }
 
+   };
+   
+   
    /**
-    * \brief qft 
-    */ 
-   class qft : public gate
+    * \brief cphase
+    */
+   class cphase : public gate
    {
       private:
 
-         std::vector<uint64_t>     qubit;
-         cmatrix_t                 hm;
+         uint64_t ctrl_qubit;
+         uint64_t target_qubit;
 
       public:
 
-         qft(std::vector<uint64_t> qubit) : qubit(qubit)
+         cphase(uint64_t ctrl_qubit, uint64_t target_qubit) : ctrl_qubit(ctrl_qubit), target_qubit(target_qubit)
          {
-            hm = build_matrix(hadamard_c,2);
          }
 
          int64_t apply(qu_register& qreg)
-         { 
-            size_t n  = qreg.size();
-            size_t s = qreg.states();
-            cvector_t& in  = qreg.get_data();
-            cvector_t& out = qreg.get_aux(); 
-
-            // kronecker_ui kui(hm,2,(1 << (n-1)));
-            kronecker_ui kui(hadamard_c,2,(1 << (n-1)));
-            qft_1st_fold(n, 0, kui, in, out);
-            for (size_t i=1; i<n-1; ++i)
-            {
-               size_t q = qubit[i];
-               // kronecker_iui kiui(hm, 2, (1 << (n-q-1)), (1 << (q)));
-               kronecker_iui kiui(hadamard_c, 2, (1UL << (n-q-1)), (1UL << (q)));
-               qft_nth_fold(n, 0, kiui, in, out);
-            }
-            in.swap(out);
-            return 0;
-#if 0
-            // 1st fold
-            qft_worker(0, s, 1, n, in, out, kronecker_ui(m,2,s-2), 0);
-            return 0;
-            // ith fold
-            for (size_t i=1; i<qubit.size(); ++i)
-            {
-               size_t q = qubit[i];
-               kronecker_iui k(m, 2, (1UL << (n-q-1)), (1UL << (q)));
-               qft_worker(0, qreg.states(), 1, qreg.size(), (qreg.get_data()), (qreg.get_aux()), k, q);
-            }
-            // last fold
-            kronecker_iu k(m,2,(1UL << (n-1)));
-            sparse_mulmv(n,qubit[n-1],k,qreg.get_data(),qreg.get_aux());
-            in.swap(out);
+         {
+            __apply_cz(qreg.size(), ctrl_qubit, target_qubit, qreg.get_data().data());
             return 0;
-#endif
          }
 
          void dump()
          {
-            print("  [-] qft(");
-            for (size_t i=0; i<(qubit.size()-1); ++i)
-               print("q" << qubit[i] << ","); 
-            println("q" << qubit[qubit.size()-1] << ")");
+            println("  [-] cphase(ctrl_qubit=" << ctrl_qubit << ", target_qubit=" << target_qubit << ")");
          }
 
          std::vector<uint64_t>  qubits()
          {
-            return qubit;
+            std::vector<uint64_t> r;
+            r.push_back(ctrl_qubit);
+            r.push_back(target_qubit);
+            return r;
          }
 
          std::vector<uint64_t>  control_qubits()
          {
-            return qubit;
+            std::vector<uint64_t> r;
+            r.push_back(ctrl_qubit);
+            return r;
          }
 
          std::vector<uint64_t>  target_qubits()
          {
-            return qubit;
+            std::vector<uint64_t> r;
+            r.push_back(target_qubit);
+            return r;
+         }
+
+         bool get_matrix(cvector_t& r)
+         {
+            build_ctrl_matrix(r, 1, pauli_z_c);
+            return true;
          }
 
          gate_type_t type()
          {
-            return __qft_gate__; 
+            return __cphase_gate__; 
          }
+
    };
 
    /**
-    * phase shifter
+    * \brief pauli rotation exp(-i*angle*P), P being the tensor product of
+    *  paulis[i] (I, X, Y or Z, in either case) on qubits[i] : e.g.
+    *  pauli_rotation({0,1}, "ZZ", t) is rzz(2t). applied in a single pass,
+    *  without basis changes or cnot ladders.
     */
-   void __apply_cm(complex_t * state, 
-         complex_t m[2][2],
-         std::size_t i11, std::size_t i12, std::size_t i13,
-         std::size_t i21, std::size_t i22, std::size_t i23,
-         std::size_t i31, std::size_t i32, std::size_t ish )
+   class pauli_rotation : public gate
    {
-      complex_t m00 = m[0][0],
-                m01 = m[0][1],
-                m10 = m[1][0],
-                m11 = m[1][1];
+      private:
 
-      for(std::size_t r1 = i11; r1 < i12; r1 += i13)
-      {
-         #ifdef USE_OPENMP
-         // #pragma omp parallel for
-         #endif
-         for(std::size_t r2 = r1 + i21; r2 < r1 + i22; r2 += i23)
+         std::vector<uint64_t> qubits_;
+         std::string           paulis;
+         double                angle;
+         uint64_t              xmask;   // qubits acted on by X or Y
+         uint64_t              zmask;   // qubits acted on by Z or Y
+
+      public:
+
+         pauli_rotation(std::vector<uint64_t> qubits, std::string paulis, double angle) : qubits_(qubits), paulis(paulis), angle(angle), xmask(0), zmask(0)
          {
-            for(std::size_t ind0 = r2 + i31; ind0 < r2 + i32; ind0++)
+            if (qubits_.size() != paulis.size())
+               throw std::invalid_argument("pauli rotation : the pauli string and the qubit list have different sizes");
+            for (size_t i=0; i<qubits_.size(); i++)
             {
-               std::size_t ind1 = ind0 + ish;
-               complex_t    in0 = state[ind0], in1 = state[ind1];
-
-               state[ind0] = m00 * in0 + m01 * in1;
-               state[ind1] = m10 * in0 + m11 * in1;
+               for (size_t j=i+1; j<qubits_.size(); j++)
+                  if (qubits_[i] == qubits_[j])
+                     throw std::invalid_argument("pauli rotation : duplicate qubit");
+               uint64_t b = (1ULL << qubits_[i]);
+               switch (paulis[i])
+               {
+                  case 'i': case 'I': this->paulis[i] = 'I'; break;
+                  case 'x': case 'X': this->paulis[i] = 'X'; xmask |= b; break;
+                  case 'y': case 'Y': this->paulis[i] = 'Y'; xmask |= b; zmask |= b; break;
+                  case 'z': case 'Z': this->paulis[i] = 'Z'; zmask |= b; break;
+                  default :
+                     throw std::invalid_argument("pauli rotation : invalid pauli operator (I, X, Y or Z expected)");
+               }
             }
          }
-      }
-   }
 
+         int64_t apply(qu_register& qreg)
+         {
+            __apply_pauli_rotation(qreg.size(), xmask, zmask, angle, qreg.get_data().data());
+            // the Z part only changes phases
+            for (size_t i=0; i<qubits_.size(); i++)
+               if ((xmask >> qubits_[i]) & 1)
+                  qreg.set_measurement_prediction(qubits_[i],__state_unknown__);
+            return 0;
+         }
 
-   /**
-    * \brief  controlled phase shift by arbitrary phase angle or (2*pi/(2^(k=ctrl-target)))
-    */ 
-   class ctrl_phase_shift : public gate
-   {
-      private:
+         void dump()
+         {
+            print("  [-] pauli_rotation(qubits=");
+            for (size_t i=0; i<qubits_.size(); i++)
+               print((i ? "," : "") << qubits_[i]);
+            println(", paulis=" << paulis << ", angle=" << angle << ")");
+         }
 
-         uint64_t                  ctrl_qubit;
-         uint64_t                  target_qubit;
-         complex_t                 z;
-         complex_t                 m[2][2];
-         double                    phase;
+         std::vector<uint64_t>  qubits()
+         {
+            return qubits_;
+         }
 
-      protected:
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            return r;
+         }
 
-         void build_operator()
+         std::vector<uint64_t>  target_qubits()
          {
-            m[0][0] = complex_t(cos(-phase/2), sin(-phase/2));   m[0][1] = 0.0;
-            m[1][0] = 0.0;                                       m[1][1] =  complex_t(cos(phase/2), sin(phase/2));
+            return qubits_;
+         }
 
-            double n = m[0][0].norm();
-            if (n > 10e-9)
+         /**
+          * cos(angle).I - i.sin(angle).P, up to 6 qubits
+          */
+         bool get_matrix(cvector_t& r)
+         {
+            size_t k = qubits_.size();
+            if (k > 6)
+               return false;
+            size_t d = (1UL << k), lx = 0, lz = 0;
+            for (size_t i=0; i<k; i++)
             {
-               complex_t p(m[0][0].re/n,m[0][0].im/n);
-               m[0][0] /= p;
-               m[0][1] /= p;
-               m[1][0] /= p;
-               m[1][1] /= p;
+               if ((xmask >> qubits_[i]) & 1) lx |= (1UL << i);
+               if ((zmask >> qubits_[i]) & 1) lz |= (1UL << i);
             }
-            else
+            complex_t g = __pauli_factor(QX_POPCOUNT(lx & lz), angle);
+            r.assign(d*d, complex_t(0.0, 0.0));
+            for (size_t c=0; c<d; c++)
             {
-               n = m[0][1].norm();
-               complex_t p(m[0][0].re/n,m[0][0].im/n);
-               m[0][0] /= p;
-               m[0][1] /= p;
-               m[1][0] /= p;
-               m[1][1] /= p;
+               r[c*d+c] = complex_t(cos(angle), 0.0);
+               complex_t& e = r[(c ^ lx)*d+c];
+               e = e + ((QX_POPCOUNT(c & lz) & 1) ? complex_t(-g.re, -g.im) : g);
             }
+            return true;
          }
 
+         gate_type_t type()
+         {
+            return __pauli_rotation_gate__;
+         }
+   };
+
+   /**
+    * \brief diagonal operator on up to 10 qubits given by its 2^k phases,
+    *  bit i of the phase index being qubits[i], applied in a single pass.
+    *  circuit::execute() packs runs of diagonal gates into such operators
+    *  (see circuit::set_diagonal_accumulation()).
+    */
+   class diagonal_gate : public gate
+   {
+      private:
 
+         std::vector<uint64_t> qubits_;
+         cvector_t             phases;
 
       public:
 
          /**
-          * ctor (q)
+          * identity on qubits, to be built up with merge()
           */
-         ctrl_phase_shift(uint64_t ctrl_qubit, uint64_t target_qubit) :    ctrl_qubit(ctrl_qubit), 
-                                                                           target_qubit(target_qubit),
-                                                                           z(0.0, 0.0)
+         diagonal_gate(std::vector<uint64_t> qubits) : qubits_(qubits)
          {
-            phase = 2*QX_PI/(1UL << (ctrl_qubit - target_qubit));
-            build_operator();
+            if (qubits_.size() > 10)
+               throw std::invalid_argument("diagonal gate : at most 10 qubits are supported");
+            for (size_t i=0; i<qubits_.size(); i++)
+               for (size_t j=i+1; j<qubits_.size(); j++)
+                  if (qubits_[i] == qubits_[j])
+                     throw std::invalid_argument("diagonal gate : duplicate qubit");
+            phases.assign(1UL << qubits_.size(), complex_t(1.0, 0.0));
          }
 
-
-         /**
-          * ctor (k)
-          */
-         ctrl_phase_shift(uint64_t ctrl_qubit, uint64_t target_qubit, size_t k) : ctrl_qubit(ctrl_qubit), 
-                                                                                    target_qubit(target_qubit)  
-         {               
-            phase = 2*QX_PI/(1UL << k);
-            build_operator();
+         diagonal_gate(std::vector<uint64_t> qubits, const cvector_t& phases) : diagonal_gate(qubits)
+         {
+            if (phases.size() != this->phases.size())
+               throw std::invalid_argument("diagonal gate : 2^k phases expected");
+            this->phases = phases;
          }
 
-
          /**
-          * ctor (p)
+          * \brief multiply in the diagonal d of an operator on q, q being a
+          *  subset of qubits() (bit i of the index of d being q[i])
           */
-         ctrl_phase_shift(uint64_t ctrl_qubit, uint64_t target_qubit, double angle) : ctrl_qubit(ctrl_qubit), 
-                                                                                      target_qubit(target_qubit) 
+         void merge(const std::vector<uint64_t>& q, const cvector_t& d)
          {
-            phase = angle;
-            build_operator();
+            std::vector<size_t> pos(q.size());
+            for (size_t i=0; i<q.size(); i++)
+            {
+               pos[i] = std::find(qubits_.begin(), qubits_.end(), q[i]) - qubits_.begin();
+               if (pos[i] == qubits_.size())
+                  throw std::invalid_argument("diagonal gate : merged operator acts on other qubits");
+            }
+            for (size_t j=0; j<phases.size(); j++)
+            {
+               size_t s = 0;
+               for (size_t i=0; i<q.size(); i++)
+                  s |= ((j >> pos[i]) & 1) << i;
+               phases[j] *= d[s];
+            }
          }
 
-         
          int64_t apply(qu_register& qreg)
          {
-            uint64_t     n  = qreg.size();
-            complex_t *  s  = qreg.get_data().data();
-            size_t       c  = ctrl_qubit;
-            size_t       t  = target_qubit;
-
-            if (c > t)
-               __apply_cm(qreg.get_data().data(),          
-                     m,                                    
-                     0UL, (1UL << n), 1UL << (c+1l),            
-                     1UL << c, 1UL << (c+1UL), 1UL << (t+1UL),  
-                     0UL,    1UL << t,    1UL << t);          
-            else
-               __apply_cm(qreg.get_data().data(),
-                     m,                          
-                     0UL, (1UL << n), 1UL << (t+1UL),     
-                     0UL,    1UL << t,    1UL << (c+1l),
-                     1UL << c, 1UL<< (c+1UL), 1UL << t);
-
-
-
+            __apply_diag(qreg.size(), qubits_, qreg.get_data().data(), phases.data());
             return 0;
          }
 
          void dump()
          {
-            println("  [-] ctrl_phase_shift(ctrl_qubit=" << ctrl_qubit << ", target_qubit: " << target_qubit << ", phase = (" << z.re << ", i." << z.im << ") )");
+            print("  [-] diagonal(qubits=");
+            for (size_t i=0; i<qubits_.size(); i++)
+               print((i ? "," : "") << qubits_[i]);
+            println(")");
          }
 
          std::vector<uint64_t>  qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(ctrl_qubit);
-            r.push_back(target_qubit);
-            return r;
+            return qubits_;
          }
 
          std::vector<uint64_t>  control_qubits()
          {
             std::vector<uint64_t> r;
-            r.push_back(ctrl_qubit);
             return r;
          }
 
          std::vector<uint64_t>  target_qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(target_qubit);
-            return r;
+            return qubits_;
+         }
+
+         const cvector_t& get_phases()
+         {
+            return phases;
+         }
+
+         /**
+          * dense diagonal matrix, up to 6 qubits
+          */
+         bool get_matrix(cvector_t& r)
+         {
+            if (qubits_.size() > 6)
+               return false;
+            size_t d = phases.size();
+            r.assign(d*d, complex_t(0.0, 0.0));
+            for (size_t j=0; j<d; j++)
+               r[j*d+j] = phases[j];
+            return true;
          }
 
          gate_type_t type()
          {
-            return __ctrl_phase_shift_gate__; 
+            return __diagonal_gate__;
          }
    };
 
-
+   /**
+    * (mask, angle) term of a diagonal hamiltonian : angle * Z(mask), Z(mask)
+    * being the product of Z on the qubits set in mask
+    */
+   typedef std::pair<uint64_t,double> diagonal_term_t;
 
    /**
-    * \brief  swap :
-    *
-    *    | 1  0  0  0 | 
-    *    | 0  0  1  0 |
-    *    | 0  1  0  0 |
-    *    | 0  0  0  1 |  
+    * \brief evolution exp(-i * sum_t angle_t * Z(mask_t)) under a diagonal
+    *  hamiltonian (e.g. the cost layer of a QAOA circuit). the terms are
+    *  packed into groups on at most 10 qubits, each group being applied in
+    *  one pass through a phase table; a term on more than 10 qubits gets a
+    *  pass of its own.
     */
-   class swap : public gate
+   class diagonal_hamiltonian : public gate
    {
       private:
 
-         uint64_t qubit1;
-         uint64_t qubit2;
+         std::vector<diagonal_term_t> terms;
+         std::vector<diagonal_gate>   groups;
+         std::vector<diagonal_term_t> wide;     // terms on more than 10 qubits
+         uint64_t                     mask;     // qubits acted on
 
-         // cmatrix_t m;
+         /**
+          * exp(-i * sum_t angle_t * (-1)^|j & lmask_t|) for every local index j
+          */
+         static cvector_t table(size_t k, const std::vector<diagonal_term_t>& t)
+         {
+            cvector_t r(1UL << k);
+            for (size_t j=0; j<r.size(); j++)
+            {
+               double phi = 0;
+               for (size_t i=0; i<t.size(); i++)
+                  phi += (QX_POPCOUNT(j & t[i].first) & 1) ? -t[i].second : t[i].second;
+               r[j] = complex_t(cos(phi), -sin(phi));
+            }
+            return r;
+         }
+
+         /**
+          * the terms t with their masks renumbered over the qubits q
+          */
+         static std::vector<diagonal_term_t> localize(const std::vector<uint64_t>& q, const std::vector<diagonal_term_t>& t)
+         {
+            std::vector<diagonal_term_t> r;
+            for (size_t i=0; i<t.size(); i++)
+            {
+               uint64_t lm = 0;
+               for (size_t l=0; l<q.size(); l++)
+                  if ((t[i].first >> q[l]) & 1)
+                     lm |= (1ULL << l);
+               r.push_back(diagonal_term_t(lm, t[i].second));
+            }
+            return r;
+         }
 
       public:
 
-         swap(uint64_t qubit1, uint64_t qubit2) : qubit1(qubit1), qubit2(qubit2)
+         diagonal_hamiltonian(const std::vector<diagonal_term_t>& terms) : terms(terms), mask(0)
          {
-            // m =  build_matrix(swap_c,4);
+            // first fit of the terms into groups on at most 10 qubits
+            std::vector<uint64_t>                     gmask;
+            std::vector<std::vector<diagonal_term_t> > gterms;
+            for (size_t i=0; i<terms.size(); i++)
+            {
+               uint64_t m = terms[i].first;
+               mask |= m;
+               if (QX_POPCOUNT(m) > 10)
+               {
+                  wide.push_back(terms[i]);
+                  continue;
+               }
+               size_t g = 0;
+               while ((g < gmask.size()) && (QX_POPCOUNT(gmask[g] | m) > 10))
+                  g++;
+               if (g == gmask.size())
+               {
+                  gmask.push_back(0);
+                  gterms.push_back(std::vector<diagonal_term_t>());
+               }
+               gmask[g] |= m;
+               gterms[g].push_back(terms[i]);
+            }
+            for (size_t g=0; g<gmask.size(); g++)
+            {
+               std::vector<uint64_t> q;
+               for (uint64_t b=0; b<64; b++)
+                  if ((gmask[g] >> b) & 1)
+                     q.push_back(b);
+               groups.push_back(diagonal_gate(q, table(q.size(), localize(q, gterms[g]))));
+            }
          }
 
          int64_t apply(qu_register& qreg)
          {
-            cnot(qubit1,qubit2).apply(qreg);
-            cnot(qubit2,qubit1).apply(qreg);
-            cnot(qubit1,qubit2).apply(qreg);
+            for (size_t g=0; g<groups.size(); g++)
+               groups[g].apply(qreg);
+            for (size_t i=0; i<wide.size(); i++)
+               __apply_pauli_rotation(qreg.size(), 0, wide[i].first, wide[i].second, qreg.get_data().data());
             return 0;
          }
 
-
-         void    dump()
+         void dump()
          {
-            println("  [-] swap(q1=" << qubit1 << ", q2=" << qubit2 << ")");
+            print("  [-] diagonal_hamiltonian(terms=");
+            for (size_t i=0; i<terms.size(); i++)
+            {
+               print((i ? ", " : "") << terms[i].second << "*Z(");
+               for (uint64_t b=0, c=0; b<64; b++)
+                  if ((terms[i].first >> b) & 1)
+                     print((c++ ? "," : "") << b);
+               print(")");
+            }
+            println(")");
          }
 
          std::vector<uint64_t>  qubits()
          {
             std::vector<uint64_t> r;
-            r.push_back(qubit1);
-            r.push_back(qubit2);
+            for (uint64_t b=0; b<64; b++)
+               if ((mask >> b) & 1)
+                  r.push_back(b);
             return r;
          }
 
@@ -2599,346 +5049,641 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          std::vector<uint64_t>  target_qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(qubit1);
-            r.push_back(qubit2);
-            return r;
+            return qubits();
          }
 
-         gate_type_t type()
+         /**
+          * dense diagonal matrix, up to 6 qubits
+          */
+         bool get_matrix(cvector_t& r)
          {
-            return __swap_gate__; 
+            std::vector<uint64_t> q = qubits();
+            if (q.size() > 6)
+               return false;
+            cvector_t p = table(q.size(), localize(q, terms));
+            size_t    d = p.size();
+            r.assign(d*d, complex_t(0.0, 0.0));
+            for (size_t j=0; j<d; j++)
+               r[j*d+j] = p[j];
+            return true;
          }
 
+         gate_type_t type()
+         {
+            return __diagonal_hamiltonian_gate__;
+         }
    };
-   
-   
+
    /**
-    * \brief cphase
+    * \brief  custom matrix gate
+    *     
     */
-   class cphase : public gate
+   class custom : public gate
    {
       private:
 
-         uint64_t ctrl_qubit;
-         uint64_t target_qubit;
+         std::vector<uint64_t> qubits_;
+         uint64_t  qubit;
+         cmatrix_t m;
+         cvector_t dm;   // 2^k x 2^k matrix (row-major), k > 1
 
       public:
 
-         cphase(uint64_t ctrl_qubit, uint64_t target_qubit) : ctrl_qubit(ctrl_qubit), target_qubit(target_qubit)
+         /**
+          * ctor : single-qubit gate
+          */
+         custom(uint64_t  qubit, cmatrix_t m) : qubits_(1, qubit), qubit(qubit), m(m)
          {
          }
 
+         /**
+          * ctor : k-qubit gate (k <= 6), m is the row-major 2^k x 2^k
+          * matrix, bit i of its row/column index being qubits[i]
+          */
+         custom(std::vector<uint64_t> qubits, cvector_t matrix) : qubits_(qubits), qubit(0)
+         {
+            size_t k = qubits_.size();
+            if ((k == 0) || (k > 6))
+               throw std::invalid_argument("custom gate : only 1 to 6 qubits are supported");
+            if (matrix.size() != (1UL << (2*k)))
+               throw std::invalid_argument("custom gate : the matrix size does not match the number of qubits");
+            for (size_t i=0; i<k; i++)
+               for (size_t j=i+1; j<k; j++)
+                  if (qubits_[i] == qubits_[j])
+                     throw std::invalid_argument("custom gate : duplicate qubit");
+            // note: the matrix is not checked for unitarity
+            if (k == 1)
+            {
+               qubit = qubits_[0];
+               m = build_matrix(matrix.data(),2);
+            }
+            else
+               dm = matrix;
+         }
+
+         /**
+          * apply
+          */
          int64_t apply(qu_register& qreg)
          {
-            hadamard(target_qubit).apply(qreg);
-            cnot(ctrl_qubit,target_qubit).apply(qreg);
-            hadamard(target_qubit).apply(qreg);
+            if (qubits_.size() == 1)
+               sqg_apply(m,qubit,qreg);
+            else
+               __apply_dense(qreg.size(), qubits_, qreg.get_data().data(), dm.data());
+            for (size_t i=0; i<qubits_.size(); i++)
+               qreg.set_measurement_prediction(qubits_[i],__state_unknown__);
             return 0;
          }
 
-         void dump()
+         /**
+          * dump
+          */
+         void    dump()
          {
-            println("  [-] cphase(ctrl_qubit=" << ctrl_qubit << ", target_qubit=" << target_qubit << ")");
+            if (qubits_.size() == 1)
+               println("  [-] custom matrix on qubit " << qubit);
+            else
+            {
+               print("  [-] custom matrix on qubits ");
+               for (size_t i=0; i<qubits_.size(); i++)
+                  print((i ? "," : "") << qubits_[i]);
+               println("");
+            }
          }
 
          std::vector<uint64_t>  qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(ctrl_qubit);
-            r.push_back(target_qubit);
-            return r;
+            return qubits_;
          }
 
          std::vector<uint64_t>  control_qubits()
          {
             std::vector<uint64_t> r;
-            r.push_back(ctrl_qubit);
             return r;
          }
 
          std::vector<uint64_t>  target_qubits()
          {
-            std::vector<uint64_t> r;
-            r.push_back(target_qubit);
-            return r;
+            return qubits_;
          }
 
-         gate_type_t type()
+         /**
+          * matrix
+          */
+         bool get_matrix(cvector_t& r)
          {
-            return __cphase_gate__; 
+            if (qubits_.size() == 1)
+               r.assign(m.m, m.m+4);
+            else
+               r = dm;
+            return true;
          }
 
+         /**
+          * type
+          */
+         gate_type_t type()
+         {
+            return __custom_gate__; 
+         }
    };
 
    /**
-    * \brief  custom matrix gate
-    *     
+    * \brief fused gate : product of consecutive unitary gates acting on at
+    *  most a few qubits, applied as a single dense operator (see
+    *  circuit::set_fusion())
     */
-   class custom : public gate
+   class fused_gate : public gate
    {
       private:
 
-         // std::vector<uint64_t> qubits;
-         uint64_t  qubit;
-         cmatrix_t m;
+         std::vector<uint64_t>  qubits_;
+         cvector_t              m;
+         size_t                 count;
 
       public:
 
-         // #ifdef __BUILTIN_LINALG__
-         //	   custom(std::vector<uint64_t>  qubits, qx::linalg::matrix<complex_t> m) : qubits(qubits), m(m)
-         // #else
-         custom(uint64_t  qubit, cmatrix_t m) : qubit(qubit), m(m)
-                                                // #endif 
-         {
-            //		 uint64_t size = 1 << qubits.size();
-            //		 if (size != m.size1() || size != m.size2())
-            //		    println("[x] error: cutom gate : the matrix size do not match the number of qubits !");
-            // verify also that the matrix is unitary
-            // #ifdef __BUILTIN_LINALG__
-            // cmatrix_t ctr(m.size2(),m.size1());
-            // qx::linalg::matrix<complex_t> ctr(m.size2(),m.size1());
-            // for (uint64_t i=0; i<m.size2(); ++i)
-            //    for (uint64_t j=0; j<m.size1(); ++j)
-            //       ctr(i,j) = m(j,i).conj();
-            // // cmatrix_t mxctr = mxm(m,ctr);
-            // qx::linalg::matrix<complex_t> mxctr = mxm(m,ctr);
-            // qx::linalg::identity_matrix<complex_t> id(m.size1());
-            // #else
-            // 		 cmatrix_t mxctr = mxm(m,ublas::trans(conj(m)));
-            // 		 ublas::identity_matrix<complex_t> id(m.size1());
-            // #endif
-
-            // #ifdef __BUILTIN_LINALG__
-            //		 if (qx::linalg::equals(mxctr,id))
-            // #else
-            // 		 if (equals(mxctr,id))
-            // #endif
-            //		    println("[x] error: custom gate : the specified matrix is not unitary !");
+         /**
+          * ctor : identity on the given qubits
+          */
+         fused_gate(std::vector<uint64_t> qubits) : qubits_(qubits), count(0)
+         {
+            if (qubits_.size() > 6)
+               throw std::invalid_argument("fused gate : at most 6 qubits are supported");
+            size_t d = (1UL << qubits_.size());
+            m.assign(d*d, complex_t(0.0, 0.0));
+            for (size_t i=0; i<d; i++)
+               m[i*d+i] = complex_t(1.0, 0.0);
          }
 
          /**
-          * apply
+          * left-multiply by the matrix of g, whose qubits must all be part
+          * of the fused gate. returns false if g has no matrix.
           */
+         bool merge(gate * g)
+         {
+            cvector_t gm;
+            if (!g->get_matrix(gm))
+               return false;
+
+            std::vector<uint64_t> gq = g->qubits();
+            size_t d  = (1UL << qubits_.size());
+            size_t gd = (1UL << gq.size());
+            size_t mask = 0;
+            std::vector<size_t> off(gd, 0);
+            for (size_t i=0; i<gq.size(); i++)
+            {
+               size_t p = std::find(qubits_.begin(), qubits_.end(), gq[i]) - qubits_.begin();
+               assert(p < qubits_.size());
+               mask |= (1UL << p);
+               for (size_t j=0; j<gd; j++)
+                  if ((j >> i) & 1)
+                     off[j] |= (1UL << p);
+            }
+
+            // apply g to every column of m
+            std::vector<complex_t> in(gd);
+            for (size_t c=0; c<d; c++)
+               for (size_t b=0; b<d; b++)
+               {
+                  if (b & mask) continue;
+                  for (size_t j=0; j<gd; j++)
+                     in[j] = m[(b+off[j])*d+c];
+                  for (size_t r=0; r<gd; r++)
+                  {
+                     complex_t acc(0.0, 0.0);
+                     for (size_t j=0; j<gd; j++)
+                        acc += gm[r*gd+j]*in[j];
+                     m[(b+off[r])*d+c] = acc;
+                  }
+               }
+            count++;
+            return true;
+         }
+
          int64_t apply(qu_register& qreg)
          {
-            sqg_apply(m,qubit,qreg);
-            qreg.set_measurement_prediction(qubit,__state_unknown__);
+            uint64_t    n = qreg.size();
+            complex_t * s = qreg.get_data().data();
+            if (qubits_.size() == 1)
+               __apply_m(0, (1UL << n), qubits_[0], s, 0, (1UL << qubits_[0]), m.data());
+            else
+               __apply_dense(n, qubits_, s, m.data());
+            for (size_t i=0; i<qubits_.size(); i++)
+               qreg.set_measurement_prediction(qubits_[i],__state_unknown__);
             return 0;
          }
 
-         /**
-          * dump
-          */
-         void    dump()
+         bool get_matrix(cvector_t& r)
          {
-            println("  [-] custom matrix on qubit " << qubit);
-            // println("  [-] custom(qubits=" << qubits << ", matrix=" << m << ")");
+            r = m;
+            return true;
+         }
+
+         void dump()
+         {
+            print("  [-] fused_gate(gates=" << count << ", qubits=");
+            for (size_t i=0; i<qubits_.size(); i++)
+               print((i ? "," : "") << qubits_[i]);
+            println(")");
+         }
+
+         std::vector<uint64_t>  qubits()
+         {
+            return qubits_;
+         }
+
+         std::vector<uint64_t>  control_qubits()
+         {
+            std::vector<uint64_t> r;
+            return r;
+         }
+
+         std::vector<uint64_t>  target_qubits()
+         {
+            return qubits_;
          }
 
-         /**
-          * type
-          */
          gate_type_t type()
          {
-            return __custom_gate__; 
+            return __fused_gate__;
          }
    };
   
    
 
-   double p1_worker(uint64_t cs, uint64_t ce, uint64_t qubit, cvector_t * p_data)
+   /**
+    * measurement : probability that <qubit> is 1, as a strided reduction over
+    * the half of the state where it is set (the other half is not read).
+    */
+   double __measure_p1_sse(std::size_t n, const std::size_t qubit, const complex_t * state)
    {
-      cvector_t &data = * p_data;
-      double local_p1 = 0;
-      uint64_t ref = 1UL << qubit;
-      uint64_t offset = 0;
-
-      // We need to calculate the "offset_start" in order to maintain the 
-      // correctness of the index calculation in the parallel region
-      uint64_t reminder = cs % ref;
-      uint64_t factor = std::floor((cs - reminder) / ref);
-      uint64_t offset_start = factor * ref;
-
-      offset = offset_start;
-
-      /* ******************************************************************************* */
-      // The following for-loop is a decimal-based representation of the identical binary-
-      // based for-loop:
-      // uint64_t size = qreg.size(); 
-      // uint64_t n = (1 << size);
-      //  std::bitset<MAX_QB_N> b;
-      //  b.reset();
-      //  b.set(qubit);
-      //  for (uint64_t i = b.to_ulong(); i < n; i=b.to_ulong()) {
-      //        p += data[i].norm();
-      //        b = inc(b);
-      //        b.set(qubit);
-      //  }
-      /* ******************************************************************************* */
-      for (uint64_t i = cs; i < ce; ++i) {
-         if (!(i % ref))
-            offset = ref + i;
-         local_p1 += data[i + offset].norm();
+      int64_t half = (int64_t)(1UL << (n-1));
+      size_t  bit  = (1UL << qubit);
+      double  p    = 0;
+#ifdef USE_OPENMP
+#pragma omp parallel reduction(+: p)
+#endif
+      {
+         __m128d acc = _mm_setzero_pd();
+#ifdef USE_OPENMP
+#pragma omp for nowait
+#endif
+         for (int64_t k=0; k<half; ++k)
+         {
+            __m128d v = state[__bit_insert((size_t)k, qubit) | bit].xmm;
+            acc = _mm_add_pd(acc, _mm_mul_pd(v, v));
+         }
+         p += _mm_cvtsd_f64(_mm_hadd_pd(acc, acc));
       }
-
-      return local_p1;
+      return p;
    }
 
-   inline double zero_worker_norm(uint64_t cs, uint64_t ce, cvector_t * p_data)
+   QX_TARGET_AVX2
+   double __measure_p1_avx2(std::size_t n, const std::size_t qubit, const complex_t * state)
    {
-      uint64_t num_elts = ce - cs;
-      uint64_t tile_size = std::min<uint64_t>(num_elts, 32UL);
-      complex_t * vd = p_data->data();
-      double local_length = 0.;
-
-#if defined(__AVX__)
-      __m256d sum = _mm256_set1_pd(0.0);
-      for (uint64_t i=cs; i<ce; i+=tile_size)
+      int64_t half = (int64_t)(1UL << (n-1));
+      size_t  bit  = (1UL << qubit);
+      double  p    = 0;
+#ifdef USE_OPENMP
+#pragma omp parallel reduction(+: p)
+#endif
       {
-         for (uint64_t j=i, end=std::min(ce,tile_size+i); j<end; j+=2)
+         __m256d acc = _mm256_setzero_pd();
+#ifdef USE_OPENMP
+#pragma omp for nowait
+#endif
+         for (int64_t k=0; k<half; k+=2)
          {
-            double * pvd = (double*)&vd[j];
-            sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(pvd), _mm256_load_pd(pvd)));
+            __m256d v = _mm256_load_pd((const double*)&state[__bit_insert((size_t)k, qubit) | bit]);
+            acc = _mm256_fmadd_pd(v, v, acc);
          }
+         __m128d s = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+         p += _mm_cvtsd_f64(_mm_hadd_pd(s, s));
       }
-      __m256d r2 = _mm256_hadd_pd(sum, sum);
-      local_length = _mm_cvtsd_f64(_mm_add_pd(_mm256_extractf128_pd(r2, 1),
-                                              _mm256_castpd256_pd128(r2)));
-#elif defined(__SSE__)
-      __m128d sum = _mm_set1_pd(0.0);
-      for (uint64_t i=cs; i<ce; i+=tile_size)
+      return p;
+   }
+
+   QX_TARGET_AVX512
+   double __measure_p1_avx512(std::size_t n, const std::size_t qubit, const complex_t * state)
+   {
+      int64_t half = (int64_t)(1UL << (n-1));
+      size_t  bit  = (1UL << qubit);
+      double  p    = 0;
+#ifdef USE_OPENMP
+#pragma omp parallel reduction(+: p)
+#endif
       {
-         for (uint64_t j=i, end=std::min(ce,tile_size+i); j<end; ++j)
+         __m512d acc = _mm512_setzero_pd();
+#ifdef USE_OPENMP
+#pragma omp for nowait
+#endif
+         for (int64_t k=0; k<half; k+=4)
          {
-            double * pvd = (double*)&vd[j];
-            sum = _mm_add_pd(sum, _mm_mul_pd(_mm_load_pd(pvd), _mm_load_pd(pvd)));
+            __m512d v = _mm512_load_pd((const double*)&state[__bit_insert((size_t)k, qubit) | bit]);
+            acc = _mm512_fmadd_pd(v, v, acc);
          }
+         __m256d h = _mm256_add_pd(QX_MM512_EXTRACTF64X4_PD(acc, 0), QX_MM512_EXTRACTF64X4_PD(acc, 1));
+         __m128d s = _mm_add_pd(_mm256_castpd256_pd128(h), _mm256_extractf128_pd(h, 1));
+         p += _mm_cvtsd_f64(_mm_hadd_pd(s, s));
       }
-      local_length = _mm_cvtsd_f64(_mm_hadd_pd(sum, sum));
-#else
-      for (uint64_t i=cs; i<ce; i+=tile_size)
+      return p;
+   }
+
+   /**
+    * measurement : collapse and renormalization in a single pass, the half of
+    * the state matching the outcome <value> is scaled by <scale> and the other
+    * half is zeroed.
+    */
+   void __measure_collapse_sse(std::size_t n, const std::size_t qubit, complex_t * state, const bool value, const double scale)
+   {
+      int64_t half = (int64_t)(1UL << (n-1));
+      size_t  keep = (value ? (1UL << qubit) : 0);
+      size_t  drop = (value ? 0 : (1UL << qubit));
+      __m128d s    = _mm_set1_pd(scale);
+      __m128d z    = _mm_setzero_pd();
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k=0; k<half; ++k)
       {
-         for (uint64_t j=i, end=std::min(ce,tile_size+i); j<end; j+=2) 
-         {
-            local_length += data[j].norm() + data[j+1].norm();
-         }
+         size_t i = __bit_insert((size_t)k, qubit);
+         state[i+keep].xmm = _mm_mul_pd(state[i+keep].xmm, s);
+         state[i+drop].xmm = z;
       }
-#endif
-      return local_length;
    }
 
-   inline double zero_worker_true(uint64_t cs, uint64_t ce, uint64_t s, /*double * length,*/ uint64_t qubit, /*xpu::lockable * l, */cvector_t * p_data)
+   QX_TARGET_AVX2
+   void __measure_collapse_avx2(std::size_t n, const std::size_t qubit, complex_t * state, const bool value, const double scale)
    {
-      cvector_t &data = * p_data;
-      uint64_t pos = 1UL << qubit;
-
-      for (uint64_t i=cs; i<ce; i+=2)
+      int64_t half = (int64_t)(1UL << (n-1));
+      size_t  keep = (value ? (1UL << qubit) : 0);
+      size_t  drop = (value ? 0 : (1UL << qubit));
+      __m256d s    = _mm256_set1_pd(scale);
+      __m256d z    = _mm256_setzero_pd();
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k=0; k<half; k+=2)
       {
-         // ((x) & (1<<(pos)))
-         if (i & pos)
-            data[i] = 0.0;
-         if ((i+1) & pos)
-            data[i+1] = 0.0;
+         size_t   i  = __bit_insert((size_t)k, qubit);
+         double * pk = (double*)&state[i+keep];
+         _mm256_store_pd(pk, _mm256_mul_pd(_mm256_load_pd(pk), s));
+         _mm256_store_pd((double*)&state[i+drop], z);
       }
-
-      return zero_worker_norm(cs, ce, p_data);
    }
 
-   inline double zero_worker_false(uint64_t cs, uint64_t ce, uint64_t s, /*double * length,*/ uint64_t qubit, /*xpu::lockable * l, */cvector_t * p_data)
+   QX_TARGET_AVX512
+   void __measure_collapse_avx512(std::size_t n, const std::size_t qubit, complex_t * state, const bool value, const double scale)
    {
-      cvector_t &data = * p_data;
-      uint64_t pos = 1UL << qubit;
-
-      for (uint64_t i=cs; i<ce; i+=2)
+      int64_t half = (int64_t)(1UL << (n-1));
+      size_t  keep = (value ? (1UL << qubit) : 0);
+      size_t  drop = (value ? 0 : (1UL << qubit));
+      __m512d s    = _mm512_set1_pd(scale);
+      __m512d z    = _mm512_setzero_pd();
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k=0; k<half; k+=4)
       {
-         // ((x) & (1<<(pos)))
-         if (!(i & pos)) {
-            data[i] = 0.0;
-         }
-         if (!((i+1) & pos))
-            data[i+1] = 0.0;
+         size_t   i  = __bit_insert((size_t)k, qubit);
+         double * pk = (double*)&state[i+keep];
+         _mm512_store_pd(pk, _mm512_mul_pd(_mm512_load_pd(pk), s));
+         _mm512_store_pd((double*)&state[i+drop], z);
       }
+   }
 
-      return zero_worker_norm(cs, ce, p_data);
+   double __measure_p1(std::size_t n, const std::size_t qubit, const complex_t * state)
+   {
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (qubit >= 2))
+         return __measure_p1_avx512(n, qubit, state);
+      else if ((simd >= xpu::simd_level::avx2) && (qubit >= 1))
+         return __measure_p1_avx2(n, qubit, state);
+      else
+         return __measure_p1_sse(n, qubit, state);
    }
 
-   int renorm_worker(uint64_t cs, uint64_t ce, uint64_t s, double * length, cvector_t * p_data)
+   void __measure_collapse(std::size_t n, const std::size_t qubit, complex_t * state, const bool value, const double scale)
    {
-      cvector_t &data = * p_data;
-      double l = *length;
-      double l_rec = 1./l;
-      uint64_t num_elts = ce - cs;
-      uint64_t tile_size = std::min<uint64_t>(num_elts, 16UL);
-      complex_t * vd = p_data->data();
+      xpu::simd_level simd = xpu::host_simd_level();
+      if ((simd >= xpu::simd_level::avx512) && (qubit >= 2))
+         __measure_collapse_avx512(n, qubit, state, value, scale);
+      else if ((simd >= xpu::simd_level::avx2) && (qubit >= 1))
+         __measure_collapse_avx2(n, qubit, state, value, scale);
+      else
+         __measure_collapse_sse(n, qubit, state, value, scale);
+   }
 
-#ifdef __AVX512F__
-      __m512d vl = _mm512_set1_pd(l_rec);
+   /**
+    * joint measurement of several qubits. up to 10 qubits, the 2^k outcome
+    * probabilities are summed in one pass (one histogram per thread), the
+    * outcome is drawn from them, and the state is collapsed and renormalized
+    * in a second pass. for more qubits the outcome is drawn from the block
+    * partial sums of qu_register::sample(), the state is collapsed in a second
+    * pass, and the 2^(n-k) kept amplitudes are renormalized. returns the
+    * outcome, bit q being the value of qubit q.
+    */
+   inline uint64_t __measure_qubits(qu_register& qreg, std::vector<uint64_t> qubits, bool disable_averaging=false)
+   {
+      std::sort(qubits.begin(), qubits.end());
+      qubits.erase(std::unique(qubits.begin(), qubits.end()), qubits.end());
+      size_t n    = qreg.size();
+      size_t k    = qubits.size();
+      size_t mask = 0;
+      std::vector<size_t> pos(qubits.begin(), qubits.end());
+      for (size_t b=0; b<k; ++b)
+         mask |= (1ULL << pos[b]);
+      const size_t * po     = pos.data();
+      int64_t        groups = (int64_t)(1ULL << (n - k));
+      complex_t *    state  = qreg.get_data().data();
+      uint64_t       value  = 0;
+
+      if (k <= 10)
+      {
+         size_t d = (1ULL << k);
+         std::vector<size_t> off(d, 0);
+         for (size_t j=0; j<d; ++j)
+            for (size_t b=0; b<k; ++b)
+               if ((j >> b) & 1)
+                  off[j] |= (1ULL << pos[b]);
+         const size_t * oo = off.data();
+
+         std::vector<double> p(d, 0.);
 #ifdef USE_OPENMP
-#pragma omp parallel for
+#pragma omp parallel
 #endif
-      for (uint64_t i=cs; i<ce; i+=tile_size)
-      {
-         for (uint64_t j=i, end=std::min(ce,tile_size+i); j<end; j+=4)
          {
-            double * pvd = (double*)&vd[j];
-            _mm512_store_pd(pvd, _mm512_mul_pd(_mm512_load_pd(pvd), vl));
+            std::vector<double> local(d, 0.);
+#ifdef USE_OPENMP
+#pragma omp for nowait
+#endif
+            for (int64_t g=0; g<groups; ++g)
+            {
+               size_t base = __insert_bits((size_t)g, po, k);
+               for (size_t j=0; j<d; ++j)
+                  local[j] += state[base + oo[j]].norm();
+            }
+#ifdef USE_OPENMP
+#pragma omp critical
+#endif
+            for (size_t j=0; j<d; ++j)
+               p[j] += local[j];
+         }
+
+         double total = 0;
+         for (size_t j=0; j<d; ++j)
+            total += p[j];
+         double u    = qreg.rand()*total;
+         double acc  = 0;
+         size_t o    = d;
+         size_t last = 0;   // last outcome of non-zero probability
+         for (size_t j=0; j<d; ++j)
+         {
+            if (p[j] == 0)
+               continue;
+            last = j;
+            acc += p[j];
+            if (u < acc)
+            {
+               o = j;
+               break;
+            }
          }
-      }
-#elif defined(__AVX__)
-      __m256d vl = _mm256_set1_pd(l_rec);
+         if (o == d)
+            o = last;
+         value = off[o];
+
+         double norm = std::sqrt(p[o]);
 #ifdef USE_OPENMP
 #pragma omp parallel for
 #endif
-      for (int64_t i=cs; i<(int64_t)ce; i+=tile_size)
-      {
-         for (uint64_t j=(uint64_t)i, end=std::min(ce,tile_size+(uint64_t)i); j<end; j+=2)
+         for (int64_t g=0; g<groups; ++g)
          {
-            double * pvd = (double*)&vd[j];
-            _mm256_store_pd(pvd, _mm256_mul_pd(_mm256_load_pd(pvd), vl));
+            size_t base = __insert_bits((size_t)g, po, k);
+            for (size_t j=0; j<d; ++j)
+            {
+               if (j == o)
+                  state[base + oo[j]] /= norm;
+               else
+                  state[base + oo[j]] = 0.0;
+            }
          }
       }
-#elif defined(__SSE__)
-      __m128d vl = _mm_set1_pd(l_rec);
+      else
+      {
+         value = qreg.sample(1)[0] & mask;
+         double p = 0;
+         int64_t ns = (int64_t)(1ULL << n);
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(+:p)
+#endif
+         for (int64_t i=0; i<ns; ++i)
+         {
+            if ((i & mask) == value)
+               p += state[i].norm();
+            else
+               state[i] = 0.0;
+         }
+         double norm = std::sqrt(p);
 #ifdef USE_OPENMP
 #pragma omp parallel for
 #endif
-      for (int64_t i=cs; i<(int64_t)ce; i+=tile_size)
+         for (int64_t g=0; g<groups; ++g)
+            state[__insert_bits((size_t)g, po, k) | value] /= norm;
+      }
+
+      for (size_t b=0; b<k; ++b)
       {
-         for (uint64_t j=(uint64_t)i, end=std::min(ce,tile_size+(uint64_t)i); j<end; ++j)
-         {
-            double * pvd = (double*)&vd[j];
-            _mm_store_pd(pvd, _mm_mul_pd(_mm_load_pd(pvd), vl));
+         uint64_t q = pos[b];
+         bool     v = ((value >> q) & 1);
+         qreg.set_measurement_prediction(q,(v ? __state_1__ : __state_0__));
+         qreg.set_measurement(q,v);
+         if (!disable_averaging && qreg.measurement_averaging_enabled)
+         {
+            if (v)
+               qreg.measurement_averaging[q].exited_states++;
+            else
+               qreg.measurement_averaging[q].ground_states++;
          }
       }
-#else
+      return value;
+   }
+
+   /**
+    * measurement in the basis {(|0> + c|1>), (|0> - c|1>)}/sqrt(2) (x : c = 1,
+    * y : c = i) : probability of the outcome 1, i.e. the sum of
+    * |a0 - conj(c).a1|^2 / 2 over the amplitude pairs (a0,a1) of <qubit>.
+    */
+   double __measure_xy_p1(std::size_t n, const std::size_t qubit, const complex_t * state, const complex_t c)
+   {
+      int64_t   half = (int64_t)(1UL << (n-1));
+      size_t    bit  = (1UL << qubit);
+      complex_t u(-c.re, c.im);
+      double    p    = 0;
 #ifdef USE_OPENMP
-#pragma omp parallel for
+#pragma omp parallel reduction(+: p)
 #endif
-      for (int64_t i=cs; i<(int64_t)ce; i+=tile_size)
       {
-         for (uint64_t j=(uint64_t)i, end=std::min(ce,tile_size+(uint64_t)i); j<end; ++j)
+         __m128d acc = _mm_setzero_pd();
+#ifdef USE_OPENMP
+#pragma omp for nowait
+#endif
+         for (int64_t k=0; k<half; ++k)
          {
-            data[j] *= l_rec;
+            size_t    i0 = __bit_insert((size_t)k, qubit);
+            complex_t t  = state[i0] + u*state[i0 | bit];
+            acc = _mm_add_pd(acc, _mm_mul_pd(t.xmm, t.xmm));
          }
+         p += _mm_cvtsd_f64(_mm_hadd_pd(acc, acc));
       }
-#endif
-
-      // // Update the remaining elements if there are any
-      // uint64_t reminder = num_elts % tile_size;
-      // if (reminder) {
-      //    for (uint64_t i=ce-reminder; i<ce; ++i)
-      //    {
-      //       data[i] *= l_rec;
-      //    }
-      // }
+      return 0.5*p;
+   }
 
-      return 0;
+   /**
+    * measurement of <qubit> in the x (c = 1) or y (c = i) basis in two passes
+    * (probability, then projection), instead of basis change, measurement and
+    * basis change back. the measured qubit is left in (|0> + r|1>)/sqrt(2),
+    * r being <r0> or <r1> depending on the outcome (+/-c for a measurement, a
+    * fixed state for a reset). returns the outcome.
+    */
+   inline int64_t __measure_xy(qu_register& qreg, uint64_t qubit, const complex_t c, const complex_t r0, const complex_t r1)
+   {
+      size_t      n     = qreg.size();
+      double      f     = qreg.rand();
+      complex_t * state = qreg.get_data().data();
+      double      p     = __measure_xy_p1(n, qubit, state, c);
+      int64_t     value = (f < p ? 1 : 0);
+
+      // (a0,a1) -> (w, r.w), w = (a0 +/- conj(c).a1) / (2.sqrt(p)) : a rank-one
+      // 2x2 matrix, applied by the single-qubit kernels
+      double    scale = 0.5/std::sqrt(value ? p : 1-p);
+      complex_t m0(scale, 0);
+      complex_t m1 = complex_t(c.re, -c.im)*complex_t(value ? -scale : scale, 0);
+      complex_t r  = (value ? r1 : r0);
+      complex_t m[4] = { m0, m1, r*m0, r*m1 };
+      __apply_m(0, (1UL << n), qubit, state, 0, (1UL << qubit), m);
+      return value;
    }
 
+   /**
+    * measurement register and averaging update after a measurement in the x
+    * or y basis (the qubit is left in a superposition : unknown prediction)
+    */
+   inline void __record_measurement(qu_register& qreg, uint64_t qubit, int64_t value, bool disable_averaging)
+   {
+      qreg.set_measurement_prediction(qubit,__state_unknown__);
+      qreg.set_measurement(qubit,(value == 1));
+      if (!disable_averaging && qreg.measurement_averaging_enabled)
+      {
+         if (value == 1)
+            qreg.measurement_averaging[qubit].exited_states++;
+         else
+            qreg.measurement_averaging[qubit].ground_states++;
+      }
+   }
 
 
-   
    /**
     * measure
     */
@@ -2956,135 +5701,33 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
          {
          }
 
-         measure() : qubit(0), measure_all(true)
+         measure() : qubit(0), measure_all(true), disable_averaging(false)
+         {
+         }
+
+         bool averaging_disabled()
          {
+            return disable_averaging;
          }
 
          int64_t apply(qu_register& qreg)
          {
             if (measure_all)
             {
-               // qreg.measure();
+               std::vector<uint64_t> all(qreg.size());
                for (size_t q=0; q<qreg.size(); q++)
-                  qx::measure(q).apply(qreg);
+                  all[q] = q;
+               __measure_qubits(qreg, all);
                return 0;
             }
 
-            double f = qreg.rand();
-            double p = 0;
-            int64_t value;
-            uint64_t size = qreg.size(); 
-            uint64_t n = (1UL << size);
-            cvector_t& data = qreg.get_data();
-            double length = 0;
-            
-            // Basically, this "if" operator determines what to do if we have more than 64 qubits.
-            // It also determines whether to invoke parallel or sequential computations. As of now,
-            // we set parallel execution as the default one.
-            if (1)//size > 64)
-            // if (size > 64)
-            {
-               // #define PARALLEL_MEASUREMENT
-               // #ifdef PARALLEL_MEASUREMENT
-               
-               /*xpu::lockable * l = new xpu::core::os::mutex();
-               xpu::task p1_worker_t(p1_worker, (uint64_t)0, n, (uint64_t)1, &p, qubit, l, &data); 
-               xpu::parallel_for parallel_p1( (uint64_t)0, n, (uint64_t)1, &p1_worker_t);
-               parallel_p1.run();*/
-               static const uint64_t SIZE = 1000;
-
-               uint64_t ref = 1UL << qubit;
-               uint64_t range = (n >> 1);
-#ifdef USE_OPENMP
-#pragma omp parallel for reduction(+: p)
-#endif
-               for (int64_t batch = 0; batch <= (int64_t)range / SIZE; batch++) {
-                  p += p1_worker(batch*SIZE, std::min<uint64_t>((batch+1)*SIZE, range), qubit, &data);
-               }
-
-               if (f<p) value = 1;
-               else value = 0;
-
-#ifdef USE_OPENMP
-#pragma omp parallel
-{
-#endif
-               if (value) {
-#ifdef USE_OPENMP
-#pragma omp for reduction(+: length)
-#endif
-                  for (int64_t batch = 0; batch <= (int64_t)n / SIZE; batch++) {
-                     length += zero_worker_false(batch*SIZE, std::min<uint64_t>((batch+1)*SIZE,n), (uint64_t)1, qubit, &data);
-                  }
-               }
-               else {
-#ifdef USE_OPENMP
-#pragma omp for reduction(+: length)
-#endif
-                  for (int64_t batch = 0; batch <= (int64_t)n / SIZE; batch++) {
-                     length += zero_worker_true(batch*SIZE, std::min<uint64_t>((batch+1)*SIZE,n), (uint64_t)1, qubit, &data);
-                  }
-               }
-#ifdef USE_OPENMP
-}
-#endif
-
-               length = std::sqrt(length);
-
-               renorm_worker((uint64_t)0, n, (uint64_t)1, &length, &data);
-            }
-            else 
-            {
-               //#else
-
-               int64_t k, l, m;
-               int64_t j = qubit;
-               double  fvalue;
-
-               std::bitset<MAX_QB_N> b;
-               b.reset();
-               b.set(qubit);
-               uint64_t bc = b.to_ulong();
-
-               while (bc < n)
-               {
-                  bc =  b.to_ulong();
-                  p += data[bc].norm();
-                  b = inc(b);
-                  b.set(qubit);  
-                  bc =  b.to_ulong();
-               }
-
-               if (f<p) value = 1;
-               else value = 0;
-
-               if (value)   // 1
-               {  // reset all states where the qubit is 0
-                  for (uint64_t i=0; i<(1UL << size); ++i)
-                  {
-                     if (!__bit_test(i,qubit))
-                        data[i] = 0.0;
-                  }
-               }
-               else
-               {
-                  for (uint64_t i=0; i<(1UL << size); ++i)
-                  {
-                     if (__bit_test(i,qubit))
-                        data[i] = 0.0;
-                  }
-               }
-
-               for (uint64_t k = 0; k < (1UL << size); k++)
-                  length += data[k].norm(); //std::norm(data[k]);
-
-               length = std::sqrt(length);
-
-               for (uint64_t k = 0; k < (1UL << size); k++)
-                  data[k] /= length;
-
-               // #endif // PARALLEL_MEASUREMENT
-            }
+            // probability of 1, then collapse and renormalization in a
+            // single pass (the state is normalized, p(0) = 1-p(1))
+            double      f     = qreg.rand();
+            complex_t * state = qreg.get_data().data();
+            double      p     = __measure_p1(qreg.size(), qubit, state);
+            int64_t     value = (f < p ? 1 : 0);
+            __measure_collapse(qreg.size(), qubit, state, value, 1/std::sqrt(value ? p : 1-p));
 
             // println("  [>] measured value : " << value);
 
@@ -3164,16 +5807,13 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
          bool      measure_all;
          bool      disable_averaging;
 
-         qx::hadamard hg;
-         qx::measure  mg;
-
       public:
 
-         measure_x(uint64_t qubit, bool disable_averaging=false) : qubit(qubit), measure_all(false), hg(qubit), mg(qubit), disable_averaging(disable_averaging)
+         measure_x(uint64_t qubit, bool disable_averaging=false) : qubit(qubit), measure_all(false), disable_averaging(disable_averaging)
          {
          }
 
-         measure_x() : qubit(0), hg(qubit), mg(qubit), measure_all(true)
+         measure_x() : qubit(0), measure_all(true), disable_averaging(false)
          {
          }
 
@@ -3191,10 +5831,8 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
                return 0;
             }
 
-            hg.apply(qreg);
-            r = mg.apply(qreg);
-            hg.apply(qreg);
-
+            r = __measure_xy(qreg, qubit, complex_t(1,0), complex_t(1,0), complex_t(-1,0));
+            __record_measurement(qreg, qubit, r, disable_averaging);
             return r;
          }
 
@@ -3250,24 +5888,16 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
          bool      measure_all;
          bool      disable_averaging;
 
-         qx::phase_shift  sg;
-         qx::pauli_z      zg;
          qx::measure_x    mg;
-         /*
-            S(qubit);
-            Z(qubit);
-            bool b = MeasX(qubit, randint);
-            S(qubit);
-         */
 
 
       public:
 
-         measure_y(uint64_t qubit, bool disable_averaging=false) : qubit(qubit), measure_all(false), sg(qubit), zg(qubit), mg(qubit), disable_averaging(disable_averaging)
+         measure_y(uint64_t qubit, bool disable_averaging=false) : qubit(qubit), measure_all(false), disable_averaging(disable_averaging), mg(qubit)
          {
          }
 
-         measure_y() : qubit(0), sg(qubit), zg(qubit), mg(), measure_all(true)
+         measure_y() : qubit(0), measure_all(true), disable_averaging(false), mg()
          {
          }
 
@@ -3288,11 +5918,8 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
                return 0;
             }
 
-            sg.apply(qreg);
-            zg.apply(qreg);
-            r = mg.apply(qreg);
-            sg.apply(qreg);
-
+            r = __measure_xy(qreg, qubit, complex_t(0,1), complex_t(0,1), complex_t(0,-1));
+            __record_measurement(qreg, qubit, r, disable_averaging);
             return r;
          }
 
@@ -3492,9 +6119,17 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
-            measure(qubit,true).apply(qreg);
-            bin_ctrl_pauli_x(qubit,qubit).apply(qreg);
-            // bin_ctrl_pauli_z(qubit,qubit).apply(qreg);
+            // measurement, then the kept half is moved to |0> while it is
+            // renormalized (two passes)
+            size_t      n     = qreg.size();
+            double      f     = qreg.rand();
+            complex_t * state = qreg.get_data().data();
+            double      p     = __measure_p1(n, qubit, state);
+            bool        value = (f < p);
+            double      scale = 1/std::sqrt(value ? p : 1-p);
+            complex_t   m[4]  = { complex_t(value ? 0 : scale, 0), complex_t(value ? scale : 0, 0), complex_t(0,0), complex_t(0,0) };
+            __apply_m(0, (1UL << n), qubit, state, 0, (1UL << qubit), m);
+            qreg.set_measurement_prediction(qubit,__state_0__);
             qreg.set_measurement(qubit,false);
             return 0; 
          }
@@ -3537,20 +6172,17 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
       private:
 
          uint64_t  qubit;
-         hadamard  h;
 
       public:
 
-         prepx(uint64_t qubit) : qubit(qubit), h(qubit)
+         prepx(uint64_t qubit) : qubit(qubit)
          {
          }
 
          int64_t apply(qu_register& qreg)
          {
-            h.apply(qreg);
-            measure(qubit,true).apply(qreg);
-            h.apply(qreg);
-            bin_ctrl_pauli_z(qubit,qubit).apply(qreg);
+            __measure_xy(qreg, qubit, complex_t(1,0), complex_t(1,0), complex_t(1,0));
+            qreg.set_measurement_prediction(qubit,__state_unknown__);
             qreg.set_measurement(qubit,false);
             return 0; 
          }
@@ -3594,19 +6226,18 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
       private:
 
          uint64_t     qubit;
-         prepx        px;
-         phase_shift  s;
 
       public:
 
-         prepy(uint64_t qubit) : qubit(qubit), px(qubit), s(qubit)
+         prepy(uint64_t qubit) : qubit(qubit)
          {
          }
 
          int64_t apply(qu_register& qreg)
          {
-            px.apply(qreg);
-            s.apply(qreg);
+            // x-basis measurement, as prepx followed by s
+            __measure_xy(qreg, qubit, complex_t(1,0), complex_t(0,1), complex_t(0,1));
+            qreg.set_measurement_prediction(qubit,__state_unknown__);
             qreg.set_measurement(qubit,false);
             return 0; 
          }
@@ -3839,6 +6470,19 @@ pr[bc] = (pv[c1]*(m.get(bc,c1))) + (pv[c2]*(m.get(bc,c2)));
 
          int64_t apply(qu_register& qreg)
          {
+            // parallel measurements (cqasm "measure q[0:k]") are done jointly
+            std::vector<uint64_t> mq;
+            for (uint64_t i=0; i<gates.size(); i++)
+            {
+               if ((gates[i]->type() != __measure_gate__) || ((measure *)gates[i])->averaging_disabled())
+                  break;
+               mq.push_back(gates[i]->qubits()[0]);
+            }
+            if ((mq.size() > 1) && (mq.size() == gates.size()))
+            {
+               __measure_qubits(qreg, mq);
+               return 0;
+            }
             for (uint64_t i=0; i<gates.size(); i++)
                gates[i]->apply(qreg);
             return 0;
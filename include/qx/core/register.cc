@@ -1,4 +1,5 @@
 #include <exception>
+#include <algorithm>
 
 /**
  * set_binary
@@ -81,7 +82,7 @@ std::string  qx::qu_register::to_binary_string(uint64_t state, uint64_t nq)
  */
 // qx::qu_register::qu_register(uint64_t n_qubits) : data(1 << n_qubits), binary(n_qubits), n_qubits(n_qubits), rgenerator(xpu::timer().current()*10e5), udistribution(.0,1)
 //qx::qu_register::qu_register(uint64_t n_qubits) : data(1 << n_qubits), measurement_prediction(n_qubits), measurement_register(n_qubits), n_qubits(n_qubits), rgenerator(xpu::timer().current()*10e5), udistribution(.0,1)
-qx::qu_register::qu_register(uint64_t n_qubits) : data(1ULL << n_qubits), aux(1ULL << n_qubits), measurement_prediction(n_qubits), measurement_register(n_qubits), n_qubits(n_qubits), rgenerator(xpu::timer().current()*10e5), udistribution(.0,1), measurement_averaging_enabled(true), measurement_averaging(n_qubits)
+qx::qu_register::qu_register(uint64_t n_qubits) : data(1ULL << n_qubits), measurement_prediction(n_qubits), measurement_register(n_qubits), n_qubits(n_qubits), qubit_map(n_qubits), qubit_owner(n_qubits), permuted(false), rgenerator(xpu::timer().current()*10e5), udistribution(.0,1), measurement_averaging(n_qubits), measurement_averaging_enabled(true), measurement_shots_enabled(false)
 {
    if(n_qubits>63) {
 	   throw std::invalid_argument("hard limit of 63 qubits exceeded");
@@ -94,7 +95,6 @@ qx::qu_register::qu_register(uint64_t n_qubits) : data(1ULL << n_qubits), aux(1U
 #endif
    for (int64_t i=0; i<(int64_t)num_elts; ++i) {
       data[i] = 0.0;
-      aux[i] = 0.0;
    }
    data[0] = complex_t(1,0);
 
@@ -102,6 +102,8 @@ qx::qu_register::qu_register(uint64_t n_qubits) : data(1ULL << n_qubits), aux(1U
    {
       measurement_prediction[i] = __state_0__;
       measurement_register[i]   = 0;
+      qubit_map[i]   = i;
+      qubit_owner[i] = i;
    }
 
    for (size_t i=0; i<measurement_averaging.size(); ++i)
@@ -132,7 +134,10 @@ void qx::qu_register::reset()
       // binary[i] = __state_0__;
       measurement_prediction[i] = __state_0__;
       measurement_register[i]   = 0;
+      qubit_map[i]   = i;
+      qubit_owner[i] = i;
    }
+   permuted = false;
 }
 
 
@@ -141,12 +146,65 @@ void qx::qu_register::reset()
  */
 cvector_t& qx::qu_register::get_data()
 {
+   restore_layout();
    return data;
 }
 
-cvector_t& qx::qu_register::get_aux()
+cvector_t& qx::qu_register::get_raw_data()
 {
-   return aux;
+   return data;
+}
+
+/**
+ * \brief exchange two physical qubit positions : only the amplitudes where
+ *  the two bits differ move, as contiguous runs of 2^lo
+ */
+void qx::qu_register::swap_physical(uint64_t p0, uint64_t p1)
+{
+   if (p0 == p1)
+      return;
+
+   uint64_t    lo   = std::min(p0,p1);
+   uint64_t    hi   = std::max(p0,p1);
+   int64_t     runs = (int64_t)(1ULL << (n_qubits - 2 - lo));
+   complex_t * s    = data.data();
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+   for (int64_t r=0; r<runs; ++r)
+   {
+      uint64_t x = ((uint64_t)r) << lo;
+      x = ((x >> lo) << (lo+1)) | (x & ((1ULL << lo)-1));
+      x = ((x >> hi) << (hi+1)) | (x & ((1ULL << hi)-1));
+      complex_t * a = s + (x | (1ULL << lo));
+      complex_t * b = s + (x | (1ULL << hi));
+      for (uint64_t i=0; i<(1ULL << lo); ++i)
+         std::swap(a[i],b[i]);
+   }
+
+   uint64_t l0 = qubit_owner[p0];
+   uint64_t l1 = qubit_owner[p1];
+   qubit_owner[p0] = l1;
+   qubit_owner[p1] = l0;
+   qubit_map[l0]   = p1;
+   qubit_map[l1]   = p0;
+
+   permuted = false;
+   for (uint64_t i=0; i<n_qubits; ++i)
+      permuted = permuted || (qubit_map[i] != i);
+}
+
+/**
+ * \brief restore the logical qubit order
+ */
+void qx::qu_register::restore_layout()
+{
+   if (!permuted)
+      return;
+   // positions below p already hold their own qubit, so qubit_map[p] > p
+   for (uint64_t p=0; p<n_qubits; ++p)
+      if (qubit_map[p] != p)
+         swap_physical(p, qubit_map[p]);
 }
 
 /**
@@ -154,6 +212,7 @@ cvector_t& qx::qu_register::get_aux()
  */
 void qx::qu_register::set_data(cvector_t d)
 {
+   restore_layout();
    data = d;
 }
 
@@ -182,6 +241,7 @@ uint64_t qx::qu_register::states()
 cvector_t & qx::qu_register::operator=(cvector_t d)
 { 
    assert(d.size() == data.size());
+   restore_layout();
    data.resize(d.size());
    data = d;
    // data.resize(d.size());
@@ -194,6 +254,7 @@ cvector_t & qx::qu_register::operator=(cvector_t d)
  */
 complex_t& qx::qu_register::operator[](uint64_t i)
 {
+   restore_layout();
    return data[i];
 }
 
@@ -218,7 +279,8 @@ bool qx::qu_register::check()
 
 
 /**
- * \brief measures one qubit
+ * \brief measures the entire register
+ * the outcome is drawn from the block partial sums of sample()
  */
 int64_t qx::qu_register::measure()
 {
@@ -227,21 +289,129 @@ int64_t qx::qu_register::measure()
       return -1;
 #endif // SAFE_MODE
    
-   //srand48(xpu::timer().current());
-   //double r = drand48();
-   double r = this->rand();
-   
-   for (int i=0; i<data.size(); ++i)
+   collapse(sample(1)[0]);
+   return 1;
+}
+
+/**
+ * \brief sample
+ * the state is cut in blocks of 4096 amplitudes : the cumulative block
+ * probabilities are computed once (in parallel), then each draw is a binary
+ * search over the blocks and a scan of a single block.
+ */
+std::vector<uint64_t> qx::qu_register::sample(size_t shots)
+{
+   restore_layout();
+   const uint64_t block = 4096;
+   uint64_t       ns    = data.size();
+   int64_t        nb    = (int64_t)((ns + block - 1)/block);
+   std::vector<double> cdf(nb);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+   for (int64_t b=0; b<nb; ++b)
    {
-      // r -= std::norm(data[i]);
-      r -= data[i].norm();
-      if (r <= 0)
+      double p = 0;
+      for (uint64_t i=b*block; i<std::min<uint64_t>((b+1)*block, ns); ++i)
+         p += data[i].norm();
+      cdf[b] = p;
+   }
+   for (int64_t b=1; b<nb; ++b)
+      cdf[b] += cdf[b-1];
+
+   std::vector<double> u(shots);
+   for (size_t s=0; s<shots; ++s)
+      u[s] = this->rand()*cdf[nb-1];
+
+   std::vector<uint64_t> r(shots);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+   for (int64_t s=0; s<(int64_t)shots; ++s)
+   {
+      int64_t  b    = std::upper_bound(cdf.begin(), cdf.end(), u[s]) - cdf.begin();
+      if (b >= nb)
+         b = nb-1;
+      double   acc  = (b ? cdf[b-1] : 0);
+      uint64_t end  = std::min<uint64_t>((b+1)*block, ns);
+      uint64_t last = b*block;   // last amplitude of non-zero probability
+      uint64_t i    = b*block;
+      for (; i<end; ++i)
       {
-         collapse(i);
-         return 1; 
+         double p = data[i].norm();
+         if (p == 0)
+            continue;
+         last = i;
+         acc += p;
+         if (u[s] < acc)
+            break;
       }
+      r[s] = (i < end ? i : last);
    }
-   return -1;
+   return r;
+}
+
+/**
+ * \brief measure shots
+ */
+void qx::qu_register::measure_shots(size_t shots)
+{
+   if (!shots)
+      return;
+   std::vector<uint64_t> s = sample(shots);
+   if (measurement_averaging_enabled)
+   {
+      for (size_t i=0; i<shots; ++i)
+      {
+         for (uint64_t q=0; q<n_qubits; ++q)
+         {
+            if ((s[i] >> q) & 1)
+               measurement_averaging[q].exited_states++;
+            else
+               measurement_averaging[q].ground_states++;
+         }
+      }
+   }
+   add_shots(s);
+   collapse(s[shots-1]);
+}
+
+/**
+ * \brief add shots
+ * each thread builds its own histogram, the histograms are merged at the end
+ */
+void qx::qu_register::add_shots(const std::vector<uint64_t>& outcomes)
+{
+#ifdef USE_OPENMP
+#pragma omp parallel
+#endif
+   {
+      measurement_counts_t local;
+#ifdef USE_OPENMP
+#pragma omp for nowait
+#endif
+      for (int64_t i=0; i<(int64_t)outcomes.size(); ++i)
+         local[outcomes[i]]++;
+#ifdef USE_OPENMP
+#pragma omp critical
+#endif
+      for (measurement_counts_t::iterator it=local.begin(); it!=local.end(); ++it)
+         measurement_counts[it->first] += it->second;
+   }
+   if (measurement_shots_enabled)
+      measurement_shots.insert(measurement_shots.end(), outcomes.begin(), outcomes.end());
+}
+
+/**
+ * \brief get counts
+ */
+std::map<std::string,size_t> qx::qu_register::get_counts()
+{
+   std::map<std::string,size_t> r;
+   for (measurement_counts_t::iterator it=measurement_counts.begin(); it!=measurement_counts.end(); ++it)
+      r[to_binary_string(it->first,n_qubits)] = it->second;
+   return r;
 }
 
 #define __amp_epsilon__ (0.000001f)
@@ -253,6 +423,7 @@ void qx::qu_register::dump(bool only_binary=false)
 {
     if (!only_binary)
     {
+        restore_layout();
         println("--------------[quantum state]-------------- ");
         std::streamsize stream_size = std::cout.precision();
         // std::cout.precision(std::numeric_limits<double>::digits10);
@@ -299,6 +470,13 @@ void qx::qu_register::dump(bool only_binary=false)
         print(" | " <<  std::setw(9) << (measurement_register[i] ? '1' : '0'));  
     println(" |");
     println("------------------------------------------- ");
+    if (!measurement_counts.empty())
+    {
+        println("[>>] measurement counts                   :");
+        for (measurement_counts_t::iterator it=measurement_counts.begin(); it!=measurement_counts.end(); ++it)
+            println("     " << to_binary_string(it->first,n_qubits) << " : " << it->second);
+        println("------------------------------------------- ");
+    }
 }
 
 /**
@@ -309,6 +487,7 @@ std::string qx::qu_register::get_state(bool only_binary=false)
    std::stringstream ss;
    if (!only_binary)
    {
+      restore_layout();
       std::cout << std::fixed;
       for (int i=0; i<data.size(); ++i)
       {
@@ -380,6 +559,18 @@ bool qx::qu_register::get_measurement(uint64_t q)
    return measurement_register[q];
 }
 
+/**
+ * \brief get measurement register
+ */
+uint64_t qx::qu_register::get_measurement_register()
+{
+   uint64_t r = 0;
+   for (uint64_t q=0; q<n_qubits; ++q)
+      if (measurement_register[q])
+         r |= (1ULL << q);
+   return r;
+}
+
 
 /**
  * \brief test bit <q> of the binary register
@@ -16,6 +16,7 @@
 #include <cfloat>
 #include <cassert>
 #include <ctime>
+#include <map>
 
 #include <random>
 
@@ -55,6 +56,7 @@ namespace qx
    typedef std::vector<state_t>        measurement_prediction_t;
    typedef std::vector<bool>           measurement_register_t;
    typedef std::vector<integration_t>  measurement_averaging_t;
+   typedef std::map<uint64_t,size_t>   measurement_counts_t;
 
    /**
     * \brief quantum register implementation.
@@ -64,13 +66,16 @@ namespace qx
       private:
 
          cvector_t  data;
-         cvector_t  aux;
          measurement_prediction_t  measurement_prediction; 
          measurement_register_t    measurement_register;
 
 
          uint64_t   n_qubits; 
 
+         std::vector<uint64_t>     qubit_map;      // logical -> physical qubit
+         std::vector<uint64_t>     qubit_owner;    // physical -> logical qubit
+         bool                      permuted;
+
          std::default_random_engine             rgenerator;
          std::uniform_real_distribution<double> udistribution;
 
@@ -129,6 +134,32 @@ namespace qx
          }
 
 
+         /**
+          * measurement counts : number of shots per outcome of the entire
+          * register (bit q of an outcome is qubit q), and, when
+          * measurement_shots_enabled, the outcome of every shot in order
+          */
+         measurement_counts_t      measurement_counts;
+         std::vector<uint64_t>     measurement_shots;
+         bool measurement_shots_enabled;
+
+         void reset_measurement_counts()
+         {
+            measurement_counts.clear();
+            measurement_shots.clear();
+         }
+
+         /**
+          * \brief add the outcomes of <outcomes.size()> shots to the counts
+          */
+         void add_shots(const std::vector<uint64_t>& outcomes);
+
+         /**
+          * \brief counts indexed by bitstring (qubit 0 rightmost)
+          */
+         std::map<std::string,size_t> get_counts();
+
+
          void disable_measurement_averaging() 
          {
             measurement_averaging_enabled = true; 
@@ -152,7 +183,40 @@ namespace qx
           */
          cvector_t& get_data();
 
-         cvector_t& get_aux();
+         /**
+          * \brief raw data getter : the state vector in the current physical
+          *  qubit order (see physical()), the layout is not restored
+          */
+         cvector_t& get_raw_data();
+
+         /**
+          * \brief physical position of the logical qubit <q>
+          */
+         uint64_t physical(uint64_t q)
+         {
+            return qubit_map[q];
+         }
+
+         /**
+          * \brief logical qubit stored at the physical position <p>
+          */
+         uint64_t logical(uint64_t p)
+         {
+            return qubit_owner[p];
+         }
+
+         /**
+          * \brief exchange the physical positions <p0> and <p1> : the state
+          *  vector is transposed and the logical qubits stored there are
+          *  swapped in the qubit map
+          */
+         void swap_physical(uint64_t p0, uint64_t p1);
+
+         /**
+          * \brief bring the state vector back to the logical qubit order,
+          *  done implicitly by every accessor except get_raw_data()
+          */
+         void restore_layout();
 
          /**
           * \brief data setter
@@ -200,6 +264,19 @@ namespace qx
           */
          int64_t measure();
 
+         /**
+          * \brief draw <shots> basis states from the probability distribution
+          *  of the state, which is left unchanged
+          */
+         std::vector<uint64_t> sample(size_t shots);
+
+         /**
+          * \brief <shots> measurements of the entire register at once : every
+          *  sampled outcome is added to the measurement averaging and counts,
+          *  and the register is collapsed onto the last one
+          */
+         void measure_shots(size_t shots);
+
          /**
           * \brief dump
           */
@@ -247,6 +324,12 @@ namespace qx
           */
          bool get_measurement(uint64_t q);
 
+         /**
+          * \brief getter
+          * \return the measurement register as an integer (bit q is qubit q)
+          */
+         uint64_t get_measurement_register();
+
          /**
           * \brief test bit <q> of the binary register
           * \return true if bit <q> is 1
@@ -268,6 +351,7 @@ namespace qx
           */
          std::string quantum_state()
          {
+            restore_layout();
             std::stringstream ss;
             ss << std::fixed;
             ss << "START\n";
@@ -0,0 +1,979 @@
+/**
+ * @file		sp_register.h
+ * @date		16-10-26
+ * @brief		single-precision quantum register
+ *
+ */
+
+#ifndef QX_SP_REGISTER_H
+#define QX_SP_REGISTER_H
+
+#include <complex>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include "qx/xpu/aligned_memory_allocator.h"
+#include "qx/core/gate.h"
+
+namespace qx
+{
+   typedef std::complex<float>                                                     complex_f;
+   typedef std::vector<complex_f,xpu::aligned_memory_allocator<complex_f,64> >  cvector_f;
+
+   typedef std::vector<float,xpu::aligned_memory_allocator<float,64> >   fvector_t;
+
+   /**
+    * \brief gate prepared for a single-precision register (see
+    *  sp_register::prepare()) : its matrix in single precision, and its
+    *  plan for registers of <w> amplitudes. a register holds consecutive
+    *  amplitudes : the qubits below log2(w) (inner) are within a register,
+    *  the others (outer) select one of the registers of a group. only the
+    *  registers holding a row of the matrix other than the identity are
+    *  written back, and only those they depend on are read.
+    */
+   struct sp_gate
+   {
+      std::vector<uint64_t>     qubits;
+      std::vector<float>        m;        // (re,im) pairs, row by row
+      std::size_t               w;
+      std::vector<std::size_t>  pos;      // sorted outer qubits
+      std::vector<std::size_t>  off;      // offset of the registers of a group
+      std::vector<uint32_t>     in;       // registers read
+      std::vector<uint32_t>     out;      // registers written
+      std::vector<uint32_t>     term;     // terms of out[i] : term[i] to term[i+1]-1
+      std::vector<uint32_t>     src;      // register of a term
+      std::vector<uint32_t>     lane;     // lane xor of a term (inner qubits)
+      fvector_t                 re;       // coefficients of a term : one, or with inner
+      fvector_t                 im;       // qubits a (re,re) and a (-im,im) pair per lane
+   };
+
+   /**
+    * in place conversion of the <n> amplitudes of a state between double
+    * precision (complex_t) and single precision ((re,im) float pairs, in the
+    * first half of the same memory). narrowing runs upwards and widening
+    * downwards, by blocks [m,2m) : the source and the destination of a block
+    * do not overlap, and the amplitudes its destination overwrites were
+    * converted by a previous block, so each block is converted in parallel.
+    */
+   inline void __sp_narrow(complex_t * s, std::size_t n)
+   {
+      float * f = (float *)s;
+      if (n < 2)
+      {
+         __m128 a = _mm_cvtpd_ps(s[0].xmm);
+         _mm_storel_pi((__m64 *)f, _mm_shuffle_ps(a, a, 0xB1));
+         return;
+      }
+      for (std::size_t lo = 0, hi = 2; lo < n; lo = hi, hi *= 2)
+      {
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+         for (int64_t i = lo; i < (int64_t)hi; i += 2)
+         {
+            __m128 v = _mm_movelh_ps(_mm_cvtpd_ps(s[i].xmm), _mm_cvtpd_ps(s[i+1].xmm));
+            _mm_store_ps(f + 2*i, _mm_shuffle_ps(v, v, 0xB1));
+         }
+      }
+   }
+
+   inline void __sp_widen(complex_t * s, std::size_t n)
+   {
+      float * f = (float *)s;
+      if (n < 2)
+      {
+         __m128 a = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)f);
+         s[0].xmm = _mm_cvtps_pd(_mm_shuffle_ps(a, a, 0xB1));
+         return;
+      }
+      for (std::size_t hi = n, lo; hi > 0; hi = lo)
+      {
+         lo = ((hi > 2) ? hi/2 : 0);
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+         for (int64_t i = lo; i < (int64_t)hi; i += 2)
+         {
+            __m128 v = _mm_load_ps(f + 2*i);
+            v = _mm_shuffle_ps(v, v, 0xB1);
+            s[i].xmm   = _mm_cvtps_pd(v);
+            s[i+1].xmm = _mm_cvtps_pd(_mm_movehl_ps(v, v));
+         }
+      }
+   }
+
+   /**
+    * single-precision kernels on <n> amplitudes stored as (re,im) float
+    * pairs. a product c.v is computed as re(c).v + im(c).w with
+    * w = (-im(v),re(v)) : a swap within each pair and a sign change.
+    *
+    * m     : 2x2 matrix (m00, m01, m10, m11 pairs) on a qubit holding at
+    *         least one register per half
+    * phase : diag(1,p) on such a qubit, only the half where it is set is
+    *         swept
+    * k     : planned gate without inner qubits, a register holds the same
+    *         amplitude of consecutive groups, the coefficients are broadcast
+    * lanes : planned gate with inner qubits, a term reads its register
+    *         through a permutation of the lanes (lane l reads lane
+    *         l ^ sp_gate::lane) and has one coefficient per lane, whose
+    *         imaginary part is stored with the sign of w
+    * inreg : planned gate whose qubits are all inner, each register is a
+    *         group and the coefficients of the terms are kept in registers
+    */
+   inline void __sp_apply_m_sse(std::size_t n, std::size_t q, float * s, const float * m)
+   {
+      __m128 r00 = _mm_set1_ps(m[0]), i00 = _mm_set1_ps(m[1]);
+      __m128 r01 = _mm_set1_ps(m[2]), i01 = _mm_set1_ps(m[3]);
+      __m128 r10 = _mm_set1_ps(m[4]), i10 = _mm_set1_ps(m[5]);
+      __m128 r11 = _mm_set1_ps(m[6]), i11 = _mm_set1_ps(m[7]);
+      __m128 sg  = _mm_set_ps(1, -1, 1, -1);
+      std::size_t d = (1UL << q);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k = 0; k < (int64_t)(n >> 1); k += 2)
+      {
+         float * p0 = s + 2*__bit_insert((std::size_t)k, q);
+         float * p1 = p0 + 2*d;
+         __m128  v0 = _mm_load_ps(p0);
+         __m128  v1 = _mm_load_ps(p1);
+         __m128  w0 = _mm_mul_ps(sg, _mm_shuffle_ps(v0, v0, 0xB1));
+         __m128  w1 = _mm_mul_ps(sg, _mm_shuffle_ps(v1, v1, 0xB1));
+         _mm_store_ps(p0, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r00, v0), _mm_mul_ps(i00, w0)), _mm_add_ps(_mm_mul_ps(r01, v1), _mm_mul_ps(i01, w1))));
+         _mm_store_ps(p1, _mm_add_ps(_mm_add_ps(_mm_mul_ps(r10, v0), _mm_mul_ps(i10, w0)), _mm_add_ps(_mm_mul_ps(r11, v1), _mm_mul_ps(i11, w1))));
+      }
+   }
+
+   inline void __sp_apply_phase_sse(std::size_t n, std::size_t q, float * s, const float * p)
+   {
+      __m128 pr = _mm_set1_ps(p[0]);
+      __m128 pi = _mm_set1_ps(p[1]);
+      __m128 sg = _mm_set_ps(1, -1, 1, -1);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k = 0; k < (int64_t)(n >> 1); k += 2)
+      {
+         float * p1 = s + 2*(__bit_insert((std::size_t)k, q) | (1UL << q));
+         __m128  v  = _mm_load_ps(p1);
+         _mm_store_ps(p1, _mm_add_ps(_mm_mul_ps(pr, v), _mm_mul_ps(pi, _mm_mul_ps(sg, _mm_shuffle_ps(v, v, 0xB1)))));
+      }
+   }
+
+   inline void __sp_apply_k_sse(std::size_t n, const sp_gate& g, float * s)
+   {
+      const std::size_t * pos  = g.pos.data();
+      const std::size_t * off  = g.off.data();
+      const uint32_t *    in   = g.in.data();
+      const uint32_t *    out  = g.out.data();
+      const uint32_t *    term = g.term.data();
+      const uint32_t *    src  = g.src.data();
+      const float *       re   = g.re.data();
+      const float *       im   = g.im.data();
+      std::size_t         k    = g.pos.size();
+      std::size_t         ni   = g.in.size();
+      std::size_t         no   = g.out.size();
+      __m128              sg   = _mm_set_ps(1, -1, 1, -1);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)(n >> k); x += 2)
+      {
+         __m128      v[64], w[64];
+         std::size_t base = __insert_bits((std::size_t)x, pos, k);
+         for (std::size_t j = 0; j < ni; j++)
+         {
+            v[in[j]] = _mm_load_ps(s + 2*(base + off[in[j]]));
+            w[in[j]] = _mm_mul_ps(sg, _mm_shuffle_ps(v[in[j]], v[in[j]], 0xB1));
+         }
+         for (std::size_t i = 0; i < no; i++)
+         {
+            __m128 o = _mm_setzero_ps();
+            for (uint32_t e = term[i]; e < term[i+1]; e++)
+               o = _mm_add_ps(o, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(re[e]), v[src[e]]), _mm_mul_ps(_mm_set1_ps(im[e]), w[src[e]])));
+            _mm_store_ps(s + 2*(base + off[out[i]]), o);
+         }
+      }
+   }
+
+   inline void __sp_apply_lanes_sse(std::size_t n, const sp_gate& g, float * s)
+   {
+      const std::size_t * pos  = g.pos.data();
+      const std::size_t * off  = g.off.data();
+      const uint32_t *    in   = g.in.data();
+      const uint32_t *    out  = g.out.data();
+      const uint32_t *    term = g.term.data();
+      const uint32_t *    src  = g.src.data();
+      const uint32_t *    lane = g.lane.data();
+      const float *       re   = g.re.data();
+      const float *       im   = g.im.data();
+      std::size_t         k    = g.pos.size();
+      std::size_t         ni   = g.in.size();
+      std::size_t         no   = g.out.size();
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)(n >> k); x += 2)
+      {
+         __m128      v[64];
+         std::size_t base = __insert_bits((std::size_t)x, pos, k);
+         for (std::size_t j = 0; j < ni; j++)
+            v[in[j]] = _mm_load_ps(s + 2*(base + off[in[j]]));
+         for (std::size_t i = 0; i < no; i++)
+         {
+            __m128 o = _mm_setzero_ps();
+            for (uint32_t e = term[i]; e < term[i+1]; e++)
+            {
+               __m128 u = (lane[e] ? _mm_shuffle_ps(v[src[e]], v[src[e]], 0x4E) : v[src[e]]);
+               o = _mm_add_ps(o, _mm_mul_ps(_mm_load_ps(re + 4*e), u));
+               o = _mm_add_ps(o, _mm_mul_ps(_mm_load_ps(im + 4*e), _mm_shuffle_ps(u, u, 0xB1)));
+            }
+            _mm_store_ps(s + 2*(base + off[out[i]]), o);
+         }
+      }
+   }
+
+   inline void __sp_apply_inreg_sse(std::size_t n, const sp_gate& g, float * s)
+   {
+      std::size_t nt = g.src.size();
+      __m128      cr[2], ci[2];
+      for (std::size_t e = 0; e < nt; e++)
+      {
+         cr[e] = _mm_load_ps(g.re.data() + 4*e);
+         ci[e] = _mm_load_ps(g.im.data() + 4*e);
+      }
+      bool swap = (g.lane[0] != 0);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)n; x += 2)
+      {
+         __m128 v = _mm_load_ps(s + 2*x);
+         __m128 u = (swap ? _mm_shuffle_ps(v, v, 0x4E) : v);
+         __m128 o = _mm_add_ps(_mm_mul_ps(cr[0], u), _mm_mul_ps(ci[0], _mm_shuffle_ps(u, u, 0xB1)));
+         if (nt > 1)
+         {
+            u = _mm_shuffle_ps(u, u, 0x4E);
+            o = _mm_add_ps(o, _mm_add_ps(_mm_mul_ps(cr[1], u), _mm_mul_ps(ci[1], _mm_shuffle_ps(u, u, 0xB1))));
+         }
+         _mm_store_ps(s + 2*x, o);
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __sp_apply_m_avx2(std::size_t n, std::size_t q, float * s, const float * m)
+   {
+      __m256 r00 = _mm256_set1_ps(m[0]), i00 = _mm256_set1_ps(m[1]);
+      __m256 r01 = _mm256_set1_ps(m[2]), i01 = _mm256_set1_ps(m[3]);
+      __m256 r10 = _mm256_set1_ps(m[4]), i10 = _mm256_set1_ps(m[5]);
+      __m256 r11 = _mm256_set1_ps(m[6]), i11 = _mm256_set1_ps(m[7]);
+      __m256 sg  = _mm256_set_ps(1, -1, 1, -1, 1, -1, 1, -1);
+      std::size_t d = (1UL << q);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k = 0; k < (int64_t)(n >> 1); k += 4)
+      {
+         float * p0 = s + 2*__bit_insert((std::size_t)k, q);
+         float * p1 = p0 + 2*d;
+         __m256  v0 = _mm256_load_ps(p0);
+         __m256  v1 = _mm256_load_ps(p1);
+         __m256  w0 = _mm256_mul_ps(sg, _mm256_permute_ps(v0, 0xB1));
+         __m256  w1 = _mm256_mul_ps(sg, _mm256_permute_ps(v1, 0xB1));
+         __m256  o0 = _mm256_mul_ps(r00, v0);
+         __m256  o1 = _mm256_mul_ps(r10, v0);
+         o0 = _mm256_fmadd_ps(i00, w0, o0);
+         o1 = _mm256_fmadd_ps(i10, w0, o1);
+         o0 = _mm256_fmadd_ps(r01, v1, o0);
+         o1 = _mm256_fmadd_ps(r11, v1, o1);
+         o0 = _mm256_fmadd_ps(i01, w1, o0);
+         o1 = _mm256_fmadd_ps(i11, w1, o1);
+         _mm256_store_ps(p0, o0);
+         _mm256_store_ps(p1, o1);
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __sp_apply_phase_avx2(std::size_t n, std::size_t q, float * s, const float * p)
+   {
+      __m256 pr = _mm256_set1_ps(p[0]);
+      __m256 pi = _mm256_set1_ps(p[1]);
+      __m256 sg = _mm256_set_ps(1, -1, 1, -1, 1, -1, 1, -1);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k = 0; k < (int64_t)(n >> 1); k += 4)
+      {
+         float * p1 = s + 2*(__bit_insert((std::size_t)k, q) | (1UL << q));
+         __m256  v  = _mm256_load_ps(p1);
+         _mm256_store_ps(p1, _mm256_fmadd_ps(pi, _mm256_mul_ps(sg, _mm256_permute_ps(v, 0xB1)), _mm256_mul_ps(pr, v)));
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __sp_apply_k_avx2(std::size_t n, const sp_gate& g, float * s)
+   {
+      const std::size_t * pos  = g.pos.data();
+      const std::size_t * off  = g.off.data();
+      const uint32_t *    in   = g.in.data();
+      const uint32_t *    out  = g.out.data();
+      const uint32_t *    term = g.term.data();
+      const uint32_t *    src  = g.src.data();
+      const float *       re   = g.re.data();
+      const float *       im   = g.im.data();
+      std::size_t         k    = g.pos.size();
+      std::size_t         ni   = g.in.size();
+      std::size_t         no   = g.out.size();
+      __m256              sg   = _mm256_set_ps(1, -1, 1, -1, 1, -1, 1, -1);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)(n >> k); x += 4)
+      {
+         __m256      v[64], w[64];
+         std::size_t base = __insert_bits((std::size_t)x, pos, k);
+         for (std::size_t j = 0; j < ni; j++)
+         {
+            v[in[j]] = _mm256_load_ps(s + 2*(base + off[in[j]]));
+            w[in[j]] = _mm256_mul_ps(sg, _mm256_permute_ps(v[in[j]], 0xB1));
+         }
+         for (std::size_t i = 0; i < no; i++)
+         {
+            __m256 o = _mm256_setzero_ps();
+            for (uint32_t e = term[i]; e < term[i+1]; e++)
+            {
+               o = _mm256_fmadd_ps(_mm256_set1_ps(re[e]), v[src[e]], o);
+               o = _mm256_fmadd_ps(_mm256_set1_ps(im[e]), w[src[e]], o);
+            }
+            _mm256_store_ps(s + 2*(base + off[out[i]]), o);
+         }
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __sp_apply_lanes_avx2(std::size_t n, const sp_gate& g, float * s)
+   {
+      const std::size_t * pos  = g.pos.data();
+      const std::size_t * off  = g.off.data();
+      const uint32_t *    in   = g.in.data();
+      const uint32_t *    out  = g.out.data();
+      const uint32_t *    term = g.term.data();
+      const uint32_t *    src  = g.src.data();
+      const uint32_t *    lane = g.lane.data();
+      const float *       re   = g.re.data();
+      const float *       im   = g.im.data();
+      std::size_t         k    = g.pos.size();
+      std::size_t         ni   = g.in.size();
+      std::size_t         no   = g.out.size();
+      QX_ALIGNED(32) int  idx[4][8];
+      __m256i             pm[4];
+      for (std::size_t t = 0; t < 4; t++)
+      {
+         for (std::size_t l = 0; l < 4; l++)
+         {
+            idx[t][2*l]   = (int)(2*(l ^ t));
+            idx[t][2*l+1] = (int)(2*(l ^ t)+1);
+         }
+         pm[t] = _mm256_load_si256((const __m256i *)idx[t]);
+      }
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)(n >> k); x += 4)
+      {
+         __m256      v[64];
+         std::size_t base = __insert_bits((std::size_t)x, pos, k);
+         for (std::size_t j = 0; j < ni; j++)
+            v[in[j]] = _mm256_load_ps(s + 2*(base + off[in[j]]));
+         for (std::size_t i = 0; i < no; i++)
+         {
+            __m256 o = _mm256_setzero_ps();
+            for (uint32_t e = term[i]; e < term[i+1]; e++)
+            {
+               __m256 u = (lane[e] ? _mm256_permutevar8x32_ps(v[src[e]], pm[lane[e]]) : v[src[e]]);
+               o = _mm256_fmadd_ps(_mm256_load_ps(re + 8*e), u, o);
+               o = _mm256_fmadd_ps(_mm256_load_ps(im + 8*e), _mm256_permute_ps(u, 0xB1), o);
+            }
+            _mm256_store_ps(s + 2*(base + off[out[i]]), o);
+         }
+      }
+   }
+
+   QX_TARGET_AVX2
+   void __sp_apply_inreg_avx2(std::size_t n, const sp_gate& g, float * s)
+   {
+      std::size_t        nt = g.src.size();
+      __m256             cr[4], ci[4];
+      __m256i            pm[4];
+      QX_ALIGNED(32) int idx[8];
+      for (std::size_t e = 0; e < nt; e++)
+      {
+         cr[e] = _mm256_load_ps(g.re.data() + 8*e);
+         ci[e] = _mm256_load_ps(g.im.data() + 8*e);
+         for (std::size_t l = 0; l < 4; l++)
+         {
+            idx[2*l]   = (int)(2*(l ^ g.lane[e]));
+            idx[2*l+1] = (int)(2*(l ^ g.lane[e])+1);
+         }
+         pm[e] = _mm256_load_si256((const __m256i *)idx);
+      }
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)n; x += 4)
+      {
+         __m256 v = _mm256_load_ps(s + 2*x);
+         __m256 o = _mm256_setzero_ps();
+         for (std::size_t e = 0; e < nt; e++)
+         {
+            __m256 u = _mm256_permutevar8x32_ps(v, pm[e]);
+            o = _mm256_fmadd_ps(cr[e], u, o);
+            o = _mm256_fmadd_ps(ci[e], _mm256_permute_ps(u, 0xB1), o);
+         }
+         _mm256_store_ps(s + 2*x, o);
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __sp_apply_m_avx512(std::size_t n, std::size_t q, float * s, const float * m)
+   {
+      __m512 r00 = _mm512_set1_ps(m[0]), i00 = _mm512_set1_ps(m[1]);
+      __m512 r01 = _mm512_set1_ps(m[2]), i01 = _mm512_set1_ps(m[3]);
+      __m512 r10 = _mm512_set1_ps(m[4]), i10 = _mm512_set1_ps(m[5]);
+      __m512 r11 = _mm512_set1_ps(m[6]), i11 = _mm512_set1_ps(m[7]);
+      __m512 sg  = _mm512_set_ps(1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1);
+      std::size_t d = (1UL << q);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k = 0; k < (int64_t)(n >> 1); k += 8)
+      {
+         float * p0 = s + 2*__bit_insert((std::size_t)k, q);
+         float * p1 = p0 + 2*d;
+         __m512  v0 = _mm512_load_ps(p0);
+         __m512  v1 = _mm512_load_ps(p1);
+         __m512  w0 = _mm512_mul_ps(sg, QX_MM512_PERMUTE_PS(v0, 0xB1));
+         __m512  w1 = _mm512_mul_ps(sg, QX_MM512_PERMUTE_PS(v1, 0xB1));
+         __m512  o0 = _mm512_mul_ps(r00, v0);
+         __m512  o1 = _mm512_mul_ps(r10, v0);
+         o0 = _mm512_fmadd_ps(i00, w0, o0);
+         o1 = _mm512_fmadd_ps(i10, w0, o1);
+         o0 = _mm512_fmadd_ps(r01, v1, o0);
+         o1 = _mm512_fmadd_ps(r11, v1, o1);
+         o0 = _mm512_fmadd_ps(i01, w1, o0);
+         o1 = _mm512_fmadd_ps(i11, w1, o1);
+         _mm512_store_ps(p0, o0);
+         _mm512_store_ps(p1, o1);
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __sp_apply_phase_avx512(std::size_t n, std::size_t q, float * s, const float * p)
+   {
+      __m512 pr = _mm512_set1_ps(p[0]);
+      __m512 pi = _mm512_set1_ps(p[1]);
+      __m512 sg = _mm512_set_ps(1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t k = 0; k < (int64_t)(n >> 1); k += 8)
+      {
+         float * p1 = s + 2*(__bit_insert((std::size_t)k, q) | (1UL << q));
+         __m512  v  = _mm512_load_ps(p1);
+         _mm512_store_ps(p1, _mm512_fmadd_ps(pi, _mm512_mul_ps(sg, QX_MM512_PERMUTE_PS(v, 0xB1)), _mm512_mul_ps(pr, v)));
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __sp_apply_k_avx512(std::size_t n, const sp_gate& g, float * s)
+   {
+      const std::size_t * pos  = g.pos.data();
+      const std::size_t * off  = g.off.data();
+      const uint32_t *    in   = g.in.data();
+      const uint32_t *    out  = g.out.data();
+      const uint32_t *    term = g.term.data();
+      const uint32_t *    src  = g.src.data();
+      const float *       re   = g.re.data();
+      const float *       im   = g.im.data();
+      std::size_t         k    = g.pos.size();
+      std::size_t         ni   = g.in.size();
+      std::size_t         no   = g.out.size();
+      __m512              sg   = _mm512_set_ps(1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)(n >> k); x += 8)
+      {
+         __m512      v[64], w[64];
+         std::size_t base = __insert_bits((std::size_t)x, pos, k);
+         for (std::size_t j = 0; j < ni; j++)
+         {
+            v[in[j]] = _mm512_load_ps(s + 2*(base + off[in[j]]));
+            w[in[j]] = _mm512_mul_ps(sg, QX_MM512_PERMUTE_PS(v[in[j]], 0xB1));
+         }
+         for (std::size_t i = 0; i < no; i++)
+         {
+            __m512 o = _mm512_setzero_ps();
+            for (uint32_t e = term[i]; e < term[i+1]; e++)
+            {
+               o = _mm512_fmadd_ps(_mm512_set1_ps(re[e]), v[src[e]], o);
+               o = _mm512_fmadd_ps(_mm512_set1_ps(im[e]), w[src[e]], o);
+            }
+            _mm512_store_ps(s + 2*(base + off[out[i]]), o);
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __sp_apply_lanes_avx512(std::size_t n, const sp_gate& g, float * s)
+   {
+      const std::size_t * pos  = g.pos.data();
+      const std::size_t * off  = g.off.data();
+      const uint32_t *    in   = g.in.data();
+      const uint32_t *    out  = g.out.data();
+      const uint32_t *    term = g.term.data();
+      const uint32_t *    src  = g.src.data();
+      const uint32_t *    lane = g.lane.data();
+      const float *       re   = g.re.data();
+      const float *       im   = g.im.data();
+      std::size_t         k    = g.pos.size();
+      std::size_t         ni   = g.in.size();
+      std::size_t         no   = g.out.size();
+      QX_ALIGNED(64) int  idx[8][16];
+      __m512i             pm[8];
+      for (std::size_t t = 0; t < 8; t++)
+      {
+         for (std::size_t l = 0; l < 8; l++)
+         {
+            idx[t][2*l]   = (int)(2*(l ^ t));
+            idx[t][2*l+1] = (int)(2*(l ^ t)+1);
+         }
+         pm[t] = _mm512_load_si512(idx[t]);
+      }
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)(n >> k); x += 8)
+      {
+         __m512      v[64];
+         std::size_t base = __insert_bits((std::size_t)x, pos, k);
+         for (std::size_t j = 0; j < ni; j++)
+            v[in[j]] = _mm512_load_ps(s + 2*(base + off[in[j]]));
+         for (std::size_t i = 0; i < no; i++)
+         {
+            __m512 o = _mm512_setzero_ps();
+            for (uint32_t e = term[i]; e < term[i+1]; e++)
+            {
+               __m512 u = (lane[e] ? QX_MM512_PERMUTEXVAR_PS(pm[lane[e]], v[src[e]]) : v[src[e]]);
+               o = _mm512_fmadd_ps(_mm512_load_ps(re + 16*e), u, o);
+               o = _mm512_fmadd_ps(_mm512_load_ps(im + 16*e), QX_MM512_PERMUTE_PS(u, 0xB1), o);
+            }
+            _mm512_store_ps(s + 2*(base + off[out[i]]), o);
+         }
+      }
+   }
+
+   QX_TARGET_AVX512
+   void __sp_apply_inreg_avx512(std::size_t n, const sp_gate& g, float * s)
+   {
+      std::size_t        nt = g.src.size();
+      __m512             cr[8], ci[8];
+      __m512i            pm[8];
+      QX_ALIGNED(64) int idx[16];
+      for (std::size_t e = 0; e < nt; e++)
+      {
+         cr[e] = _mm512_load_ps(g.re.data() + 16*e);
+         ci[e] = _mm512_load_ps(g.im.data() + 16*e);
+         for (std::size_t l = 0; l < 8; l++)
+         {
+            idx[2*l]   = (int)(2*(l ^ g.lane[e]));
+            idx[2*l+1] = (int)(2*(l ^ g.lane[e])+1);
+         }
+         pm[e] = _mm512_load_si512(idx);
+      }
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+      for (int64_t x = 0; x < (int64_t)n; x += 8)
+      {
+         __m512 v = _mm512_load_ps(s + 2*x);
+         __m512 o = _mm512_setzero_ps();
+         for (std::size_t e = 0; e < nt; e++)
+         {
+            __m512 u = QX_MM512_PERMUTEXVAR_PS(pm[e], v);
+            o = _mm512_fmadd_ps(cr[e], u, o);
+            o = _mm512_fmadd_ps(ci[e], QX_MM512_PERMUTE_PS(u, 0xB1), o);
+         }
+         _mm512_store_ps(s + 2*x, o);
+      }
+   }
+
+   /**
+    * \brief quantum register storing the state in single precision (8 bytes
+    *  per amplitude instead of 16), for half the memory and bandwidth of
+    *  qu_register, at the cost of precision (see
+    *  tests/qxelarator/test_precision.cc). it either owns its state or
+    *  runs in the memory of a qu_register (see sp_register(qu_register&)).
+    *
+    *  only unitary gates, i.e. gates providing their matrix through
+    *  gate::get_matrix(), can be applied. measurements and classical
+    *  control need a qu_register.
+    */
+   class sp_register
+   {
+      private:
+
+         cvector_f      own;
+         complex_f *    data;
+         qu_register *  host;
+         uint64_t       n_qubits;
+
+         // a register lent by its host is not copied
+         sp_register(const sp_register&);
+         sp_register& operator=(const sp_register&);
+
+      public:
+
+         /**
+          * \brief single-precision register of n_qubits, in state |0...0>
+          */
+         sp_register(uint64_t n_qubits) : own(1ULL << n_qubits), data(own.data()), host(0), n_qubits(n_qubits)
+         {
+            if (n_qubits > 63)
+               throw std::invalid_argument("hard limit of 63 qubits exceeded");
+            reset();
+         }
+
+         /**
+          * \brief single-precision register running in the memory of <reg> :
+          *  the state of reg is converted in place, without any allocation,
+          *  and written back by release() (or the destructor). reg must not
+          *  be used in between.
+          */
+         sp_register(qu_register& reg) : data(0), host(&reg), n_qubits(reg.size())
+         {
+            cvector_t& d = reg.get_data();
+            __sp_narrow(d.data(), d.size());
+            data = (complex_f *)d.data();
+         }
+
+         ~sp_register()
+         {
+            release();
+         }
+
+         /**
+          * \brief write the state back, in double precision, to the register
+          *  lent to the constructor, which can be used again. the sp_register
+          *  is left empty.
+          */
+         void release()
+         {
+            if (!host)
+               return;
+            __sp_widen(host->get_raw_data().data(), host->states());
+            host = 0;
+            data = 0;
+         }
+
+         /**
+          * \brief reset to |0...0>
+          */
+         void reset()
+         {
+            int64_t n = (int64_t)states();
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+            for (int64_t i=0; i<n; ++i)
+               data[i] = 0.f;
+            data[0] = 1.f;
+         }
+
+         /**
+          * \brief the matrix of g in single precision, planned for the
+          *  widest register of the host cpu, for apply(const sp_gate&) : g
+          *  must provide its matrix, on at most 6 qubits
+          */
+         static sp_gate prepare(gate * g)
+         {
+            cvector_t m;
+            if (!g->get_matrix(m))
+               throw std::invalid_argument("single-precision register : only unitary gates are supported");
+            sp_gate p;
+            p.qubits = g->qubits();
+            if (p.qubits.size() > 6)
+               throw std::invalid_argument("single-precision register : gates on more than 6 qubits are not supported");
+            for (size_t i=0; i<m.size(); ++i)
+            {
+               p.m.push_back((float)m[i].re);
+               p.m.push_back((float)m[i].im);
+            }
+            plan(p, width(xpu::host_simd_level()));
+            return p;
+         }
+
+         /**
+          * \brief plan the gate p for registers of w amplitudes (see sp_gate)
+          */
+         static void plan(sp_gate& p, size_t w)
+         {
+            size_t k = p.qubits.size();
+            size_t d = (1ULL << k);
+            size_t l2w = 0;
+            while ((1ULL << l2w) < w)
+               l2w++;
+            std::vector<size_t> inner, outer;
+            for (size_t i=0; i<k; ++i)
+               (p.qubits[i] < l2w ? inner : outer).push_back(i);
+            size_t ng = (1ULL << outer.size());
+            size_t nt = (1ULL << inner.size());
+
+            p.w = w;
+            p.pos.clear();
+            for (size_t j=0; j<outer.size(); ++j)
+               p.pos.push_back(p.qubits[outer[j]]);
+            std::sort(p.pos.begin(), p.pos.end());
+
+            // row of the matrix of register a, lane l : ra[a] | rl[l]
+            std::vector<size_t> ra(ng, 0), rl(w, 0), tmask(nt, 0);
+            p.off.assign(ng, 0);
+            for (size_t a=0; a<ng; ++a)
+               for (size_t j=0; j<outer.size(); ++j)
+                  if ((a >> j) & 1)
+                  {
+                     p.off[a] |= (1ULL << p.qubits[outer[j]]);
+                     ra[a]    |= (1ULL << outer[j]);
+                  }
+            for (size_t l=0; l<w; ++l)
+               for (size_t i=0; i<inner.size(); ++i)
+                  rl[l] |= ((l >> p.qubits[inner[i]]) & 1) << inner[i];
+            for (size_t t=0; t<nt; ++t)
+               for (size_t i=0; i<inner.size(); ++i)
+                  if ((t >> i) & 1)
+                     tmask[t] |= (1ULL << p.qubits[inner[i]]);
+
+            p.in.clear(); p.out.clear(); p.term.clear();
+            p.src.clear(); p.lane.clear(); p.re.clear(); p.im.clear();
+            std::vector<bool> used(ng, false);
+            const float * m = p.m.data();
+            for (size_t a=0; a<ng; ++a)
+            {
+               bool identity = true;
+               for (size_t l=0; l<w && identity; ++l)
+               {
+                  size_t r = ra[a] | rl[l];
+                  for (size_t c=0; c<d; ++c)
+                     if ((m[2*(r*d+c)] != (c == r ? 1.f : 0.f)) || (m[2*(r*d+c)+1] != 0))
+                        identity = false;
+               }
+               if (identity)
+                  continue;
+               p.out.push_back((uint32_t)a);
+               p.term.push_back((uint32_t)p.src.size());
+               for (size_t b=0; b<ng; ++b)
+                  for (size_t t=0; t<nt; ++t)
+                  {
+                     bool zero = true;
+                     for (size_t l=0; l<w; ++l)
+                     {
+                        size_t z = 2*((ra[a] | rl[l])*d + (ra[b] | rl[l ^ tmask[t]]));
+                        if ((m[z] != 0) || (m[z+1] != 0))
+                           zero = false;
+                     }
+                     if (zero)
+                        continue;
+                     used[b] = true;
+                     p.src.push_back((uint32_t)b);
+                     p.lane.push_back((uint32_t)tmask[t]);
+                     for (size_t l=0; l<(inner.empty() ? 1 : w); ++l)
+                     {
+                        size_t z = 2*((ra[a] | rl[l])*d + (ra[b] | rl[l ^ tmask[t]]));
+                        p.re.push_back(m[z]);
+                        p.im.push_back(inner.empty() ? m[z+1] : -m[z+1]);
+                        if (!inner.empty())
+                        {
+                           p.re.push_back(m[z]);
+                           p.im.push_back(m[z+1]);
+                        }
+                     }
+                  }
+            }
+            p.term.push_back((uint32_t)p.src.size());
+            for (size_t b=0; b<ng; ++b)
+               if (used[b])
+                  p.in.push_back((uint32_t)b);
+         }
+
+         /**
+          * \brief number of amplitudes of a register at the given simd level
+          */
+         static size_t width(xpu::simd_level simd)
+         {
+            if (simd >= xpu::simd_level::avx512)
+               return 8;
+            if (simd >= xpu::simd_level::avx2)
+               return 4;
+            return 2;
+         }
+
+         /**
+          * \brief apply the gate g, which must provide its matrix
+          */
+         void apply(gate * g)
+         {
+            apply(prepare(g));
+         }
+
+         /**
+          * \brief apply a prepared gate, with the widest kernel of the host
+          *  cpu (see xpu::host_simd_level()) whose register fits the state.
+          *  the gate is planned again if it was for another width.
+          */
+         void apply(const sp_gate& g)
+         {
+            size_t  n = states();
+            size_t  w = width(xpu::host_simd_level());
+            float * s = (float *)data;
+            while (w > n)
+               w /= 2;
+            if (w < 2)
+               return;
+            if (g.w != w)
+            {
+               sp_gate p(g);
+               plan(p, w);
+               apply(p);
+               return;
+            }
+            if ((g.qubits.size() == 1) && (g.pos.size() == 1))
+            {
+               size_t        q = g.qubits[0];
+               const float * m = g.m.data();
+               bool phase = (m[0] == 1) && (m[1] == 0) && (m[2] == 0) && (m[3] == 0) && (m[4] == 0) && (m[5] == 0);
+               if (w == 8)
+               {
+                  if (phase)         __sp_apply_phase_avx512(n, q, s, m+6);
+                  else               __sp_apply_m_avx512(n, q, s, m);
+               }
+               else if (w == 4)
+               {
+                  if (phase)         __sp_apply_phase_avx2(n, q, s, m+6);
+                  else               __sp_apply_m_avx2(n, q, s, m);
+               }
+               else
+               {
+                  if (phase)         __sp_apply_phase_sse(n, q, s, m+6);
+                  else               __sp_apply_m_sse(n, q, s, m);
+               }
+               return;
+            }
+            if (g.out.empty())
+               return;
+            bool lanes = (g.pos.size() < g.qubits.size());
+            if (w == 8)
+            {
+               if (g.pos.empty())    __sp_apply_inreg_avx512(n, g, s);
+               else if (lanes)            __sp_apply_lanes_avx512(n, g, s);
+               else                  __sp_apply_k_avx512(n, g, s);
+            }
+            else if (w == 4)
+            {
+               if (g.pos.empty())    __sp_apply_inreg_avx2(n, g, s);
+               else if (lanes)            __sp_apply_lanes_avx2(n, g, s);
+               else                  __sp_apply_k_avx2(n, g, s);
+            }
+            else
+            {
+               if (g.pos.empty())    __sp_apply_inreg_sse(n, g, s);
+               else if (lanes)            __sp_apply_lanes_sse(n, g, s);
+               else                  __sp_apply_k_sse(n, g, s);
+            }
+         }
+
+         /**
+          * \brief data getter
+          */
+         complex_f * get_data()
+         {
+            return data;
+         }
+
+         /**
+          * \brief size getter
+          */
+         uint64_t size()
+         {
+            return n_qubits;
+         }
+
+         /**
+          * \brief get states
+          */
+         uint64_t states()
+         {
+            return (1ULL << n_qubits);
+         }
+
+         /**
+          * \brief dump
+          */
+         void dump()
+         {
+            println("--------------[quantum state (single precision)]-------------- ");
+            for (size_t i=0; i<states(); ++i)
+            {
+               if ((std::abs(data[i].real()) > __amp_epsilon__) || (std::abs(data[i].imag()) > __amp_epsilon__))
+               {
+                  print("  [p = " << std::norm(data[i]) << "]");
+                  print("  " << data[i] << " |");
+                  for (uint64_t q=n_qubits; q--; )
+                     print(((i >> q) & 1));
+                  println("> +");
+               }
+            }
+            println("------------------------------------------- ");
+         }
+   };
+
+   /**
+    * \brief state fidelity |<s1|s2>|^2 between a double- and a
+    *  single-precision register (unlike fidelity(qu_register&,qu_register&)
+    *  this is sensitive to relative phases)
+    */
+   inline double fidelity(qu_register& s1, sp_register& s2)
+   {
+      if (s1.size() != s2.size())
+      {
+         println("[x] error : the specified registers have different sizes !");
+         return -1;
+      }
+      cvector_t&  a = s1.get_data();
+      complex_f * b = s2.get_data();
+      double re = 0, im = 0;
+      for (size_t i=0; i<a.size(); ++i)
+      {
+         re += a[i].re*b[i].real() + a[i].im*b[i].imag();
+         im += a[i].re*b[i].imag() - a[i].im*b[i].real();
+      }
+      return re*re + im*im;
+   }
+}
+
+#endif // QX_SP_REGISTER_H
@@ -624,7 +624,8 @@ namespace qx
 	 } 
 
 	 /**
-	  * controlled phase shift
+	  * controlled phase shift : cr q1,q2 shifts by 2.pi/2^(q1-q2) (the
+	  * legacy form, e.g. tests/benchmark/qft_*q.qc), cr q1,q2,angle by angle
 	  */
 	 else if (words[0] == "cr") 
 	 {
@@ -634,10 +635,11 @@ namespace qx
 	    if ((q1 > (qubits_count-1)) || (q1 > (qubits_count-1)))
 	       print_semantic_error(" target qubit out of range !");
 	    // println(" => controlled phase shift gate : ctrl_qubit=" << q1 << ", target_qubit=" << q2); 
+	    qx::gate * g = (params.size() > 2) ? new qx::ctrl_phase_shift(q1,q2,(double)atof(params[2].c_str())) : new qx::ctrl_phase_shift(q1,q2);
 	    if (pg) 
-	       pg->add(new qx::ctrl_phase_shift(q1,q2));
+	       pg->add(g);
 	    else
-	    current_sub_circuit(qubits_count)->add(new qx::ctrl_phase_shift(q1,q2));
+	    current_sub_circuit(qubits_count)->add(g);
 	 } 
 	 /**
 	  * cphase 
@@ -914,6 +916,33 @@ namespace qx
 	    else
 	    current_sub_circuit(qubits_count)->add(new qx::rz(q,atof(params[1].c_str())));
 	 }
+	 else if (words[0] == "pauli_rotation")   // exp(-i*angle*P) : pauli_rotation q0,q1,...,xzy,angle
+	 {
+	    strings params = word_list(words[1],",");
+	    if (params.size() < 3)
+	       print_semantic_error(" pauli_rotation requires qubits, a pauli string and an angle !");
+	    std::vector<uint64_t> qv;
+	    for (size_t i=0; i<params.size()-2; ++i)
+	    {
+	       size_t q = qubit_id(params[i]);
+	       if (q > (qubits_count-1))
+		  print_semantic_error(" target qubit out of range !");
+	       qv.push_back(q);
+	    }
+	    qx::gate * g = NULL;
+	    try
+	    {
+	       g = new qx::pauli_rotation(qv, params[params.size()-2], atof(params.back().c_str()));
+	    }
+	    catch (std::invalid_argument& e)
+	    {
+	       print_semantic_error(" " << e.what());
+	    }
+	    if (pg) 
+	       pg->add(g);
+	    else
+	       current_sub_circuit(qubits_count)->add(g);
+	 }
 
 	 /**
 	  * phase 
@@ -52,6 +52,26 @@ public:
         return qx_sim->get_state();
     }
 
+    void set_shot_recording(bool enabled)
+    {
+        qx_sim->set_shot_recording(enabled);
+    }
+
+    void set_single_precision(bool enabled)
+    {
+        qx_sim->set_single_precision(enabled);
+    }
+
+    std::map<std::string,size_t> get_counts()
+    {
+        return qx_sim->get_counts();
+    }
+
+    std::vector<uint64_t> get_shots()
+    {
+        return qx_sim->get_shots();
+    }
+
 };
 
 #endif
@@ -44,9 +44,11 @@ protected:
     qx::qu_register * reg;
     compiler::QasmRepresentation ast;
     std::string file_path;
+    bool record_shots;
+    bool single_precision;
 
 public:
-    simulator() : reg(nullptr) { /*xpu::init();*/ }
+    simulator() : reg(nullptr), record_shots(false), single_precision(false) { /*xpu::init();*/ }
     ~simulator() { /*xpu::clean();*/ }
 
     void set(std::string fp)
@@ -54,6 +56,25 @@ public:
         file_path = fp;
     }
 
+    /**
+     * keep the outcome of every shot of execute(navg), see get_shots()
+     */
+    void set_shot_recording(bool enabled)
+    {
+        record_shots = enabled;
+    }
+
+    /**
+     * run noise-free circuits on a single-precision state vector (half the
+     * memory traffic, at the cost of float rounding errors), see
+     * qx::execute_single_precision(). circuits which do not qualify run in
+     * double precision.
+     */
+    void set_single_precision(bool enabled)
+    {
+        single_precision = enabled;
+    }
+
     void parse_file() // private
     {
         FILE * qasm_file = fopen(file_path.c_str(), "r");
@@ -113,6 +134,8 @@ public:
             std::cerr << "Unexpected exception (" << exception.what() << "), aborting" << std::endl;
             // xpu::clean();
         }
+        if (reg)
+            reg->measurement_shots_enabled = record_shots;
 
         // convert libqasm ast to qx internal representation
         std::vector<compiler::SubCircuit> subcircuits = ast.getSubCircuits().getAllSubCircuits();
@@ -138,12 +161,39 @@ public:
             error_model       = qx::__depolarizing_channel__;
         }
 
+        // noise-free : single precision on request
+        if (single_precision)
+        {
+            if (error_model == qx::__depolarizing_channel__)
+                println("Single precision is not supported with an error model, using double precision.");
+            else
+            {
+                reg->reset();
+                if (qx::execute_single_precision(perfect_circuits,*reg,navg))
+                {
+                    if (navg)
+                    {
+                        println("Average measurement after " << navg << " shots (single precision):");
+                        reg->dump(true);
+                    }
+                    return;
+                }
+                println("Circuits not supported in single precision (non-unitary gate or mid-circuit measurement), using double precision.");
+            }
+        }
+
+        // noise-free : textbook qft circuits run on the native qft kernel
+        if (error_model != qx::__depolarizing_channel__)
+            for (size_t i=0; i<perfect_circuits.size(); i++)
+                perfect_circuits[i]->detect_qft();
+
         // measurement averaging
         if (navg)
         {
             if (error_model == qx::__depolarizing_channel__)
             {
                 qx::measure m;
+                std::vector<uint64_t> outcomes;
                 for (size_t s=0; s<navg; ++s)
                 {
                     reg->reset();
@@ -163,17 +213,27 @@ public:
                             qx::noisy_dep_ch(perfect_circuits[i],error_probability,total_errors)->execute(*reg,false,true);
                     }
                     m.apply(*reg);
+                    outcomes.push_back(reg->get_measurement_register());
                 }
+                reg->add_shots(outcomes);
             }
             else
             {
-                qx::measure m;
-                for (size_t s=0; s<navg; ++s)
+                // without noise, a circuit measured only at the end is simulated once
+                reg->reset();
+                if (!qx::sample_shots(perfect_circuits,*reg,navg))
                 {
-                    reg->reset();
-                    for (size_t i=0; i<perfect_circuits.size(); i++)
-                        perfect_circuits[i]->execute(*reg,false,true);
-                    m.apply(*reg);
+                    qx::measure m;
+                    std::vector<uint64_t> outcomes;
+                    for (size_t s=0; s<navg; ++s)
+                    {
+                        reg->reset();
+                        for (size_t i=0; i<perfect_circuits.size(); i++)
+                            perfect_circuits[i]->execute(*reg,false,true);
+                        m.apply(*reg);
+                        outcomes.push_back(reg->get_measurement_register());
+                    }
+                    reg->add_shots(outcomes);
                 }
             }
 
@@ -222,6 +282,24 @@ public:
     {
         return reg->get_state();
     }
+
+    /**
+     * number of shots of the last execute(navg) per measured bitstring
+     * (qubit 0 rightmost)
+     */
+    std::map<std::string,size_t> get_counts()
+    {
+        return reg->get_counts();
+    }
+
+    /**
+     * outcome of every shot of the last execute(navg), bit q being qubit q
+     * (empty unless set_shot_recording(true))
+     */
+    std::vector<uint64_t> get_shots()
+    {
+        return reg->measurement_shots;
+    }
 };
 }
 
@@ -0,0 +1,111 @@
+/**
+ * @file    cpuid.h
+ * @date    16-10-2026
+ * @brief   Runtime detection of the vector instruction sets of the host CPU
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace xpu {
+
+/**
+ * Instruction set levels that the simulation kernels are specialized for, in
+ * increasing order of capability. SSE3 is the baseline that every build of QX
+ * assumes.
+ */
+enum class simd_level {
+    sse = 0,
+    avx2 = 1,
+    avx512 = 2
+};
+
+namespace detail {
+
+#if defined(_MSC_VER)
+
+/**
+ * Queries cpuid and the OS-enabled register state (xgetbv) directly, since
+ * MSVC has no equivalent of __builtin_cpu_supports().
+ */
+inline simd_level probe_simd_level() {
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return simd_level::sse;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    if (!osxsave) {
+        return simd_level::sse;
+    }
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    bool avx2 = (info[1] & (1 << 5)) != 0;
+    bool avx512f = (info[1] & (1 << 16)) != 0;
+    if (avx512f && ((xcr0 & 0xE6) == 0xE6)) {
+        return simd_level::avx512;
+    }
+    if (avx2 && fma && ((xcr0 & 0x6) == 0x6)) {
+        return simd_level::avx2;
+    }
+    return simd_level::sse;
+}
+
+#else
+
+inline simd_level probe_simd_level() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return simd_level::avx512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return simd_level::avx2;
+    }
+    return simd_level::sse;
+}
+
+#endif
+
+/**
+ * Probes the CPU and applies the QX_SIMD environment variable, which may
+ * lower (but never raise) the detected level.
+ */
+inline simd_level detect_simd_level() {
+    simd_level level = probe_simd_level();
+    const char *env = std::getenv("QX_SIMD");
+    if (env) {
+        simd_level requested = level;
+        if (!std::strcmp(env, "sse")) {
+            requested = simd_level::sse;
+        } else if (!std::strcmp(env, "avx2")) {
+            requested = simd_level::avx2;
+        } else if (!std::strcmp(env, "avx512")) {
+            requested = simd_level::avx512;
+        }
+        if (requested < level) {
+            level = requested;
+        }
+    }
+    return level;
+}
+
+} // namespace detail
+
+/**
+ * Returns the widest kernel family the host CPU can run. The CPU is only
+ * probed on the first call.
+ */
+inline simd_level host_simd_level() {
+    static const simd_level level = detail::detect_simd_level();
+    return level;
+}
+
+} // namespace xpu
@@ -10,6 +10,12 @@
 %module(docstring=DOCSTRING) qxelarator
 
 %include "std_string.i"
+%include "std_map.i"
+%include "std_vector.i"
+%include "stdint.i"
+
+%template(map_string_size_t) std::map<std::string,size_t>;
+%template(vector_uint64_t) std::vector<uint64_t>;
 
 %{
 #include "qx/qxelarator.h"
@@ -177,6 +177,113 @@ namespace qx
                }
                continue;
             } 
+            else if (words[0] == "reset_measurement_counts")
+            {
+               if (qubits_count == 0)
+               {
+                  std::string error_code = "E"+int_to_str(QX_ERROR_QUBITS_NOT_YET_DEFINED)+"\n";
+                  sock->send(error_code.c_str(), error_code.length()+1);
+               }
+               else if (words.size() != 1)
+               {
+                  std::string error_code = "E"+int_to_str(QX_ERROR_MALFORMED_CMD)+"\n";
+                  sock->send(error_code.c_str(), error_code.length()+1);
+               }
+               else
+               {
+                  reg->reset_measurement_counts();
+                  sock->send("OK\n", 3);
+               }
+               continue;
+            }
+            else if ((words[0] == "measurement_counts") || (words[0] == "measurement_shots"))
+            {
+               // one "<bitstring> <count>" line per outcome, or one bitstring per shot
+               if (qubits_count == 0)
+               {
+                  std::string error_code = "E"+int_to_str(QX_ERROR_QUBITS_NOT_YET_DEFINED)+"\n";
+                  sock->send(error_code.c_str(), error_code.length()+1);
+               }
+               else if (words.size() != 1)
+               {
+                  std::string error_code = "E"+int_to_str(QX_ERROR_MALFORMED_CMD)+"\n";
+                  sock->send(error_code.c_str(), error_code.length()+1);
+               }
+               else
+               {
+                  qx::qu_register& r = *reg;
+                  std::stringstream ss;
+                  if (words[0] == "measurement_counts")
+                  {
+                     for (qx::measurement_counts_t::iterator it=r.measurement_counts.begin(); it!=r.measurement_counts.end(); ++it)
+                        ss << r.to_binary_string(it->first,r.size()) << ' ' << it->second << '\n';
+                  }
+                  else
+                  {
+                     for (size_t i=0; i<r.measurement_shots.size(); ++i)
+                        ss << r.to_binary_string(r.measurement_shots[i],r.size()) << '\n';
+                  }
+                  std::string s = ss.str();
+                  sock->send(s.c_str(),s.length());
+                  sock->send("OK\n", 3);
+               }
+               continue;
+            }
+            else if (words[0] == "run_shots")
+            {
+               // run_shots <circuit> <shots> [record] : <shots> runs from |0...0>,
+               // each followed by a measurement of the register
+               if (qubits_count == 0)
+               {
+                  std::string error_code = "E"+int_to_str(QX_ERROR_QUBITS_NOT_YET_DEFINED)+"\n";
+                  sock->send(error_code.c_str(), error_code.length()+1);
+               }
+               else if ((words.size() != 3) && !((words.size() == 4) && (words[3] == "record")))
+               {
+                  std::string error_code = "E"+int_to_str(QX_ERROR_MALFORMED_CMD)+"\n";
+                  sock->send(error_code.c_str(), error_code.length()+1);
+               }
+               else
+               {
+                  qx::circuit * c = 0;
+                  size_t shots = atoi(words[2].c_str());
+                  for (int i=0; i<circuits.size(); ++i)
+                  {
+                     if (words[1] == circuits[i]->id())
+                        c = circuits[i];
+                  }
+                  if (c)
+                  {
+                     println("[+] executing '" << words[1] << "' (" << shots << " shots)...");
+                     qx::qu_register& r = *reg;
+                     r.measurement_shots_enabled = (words.size() == 4);
+                     std::vector<qx::circuit *> cs(1, c);
+                     r.reset();
+                     if (!qx::sample_shots(cs, r, shots))
+                     {
+                        qx::measure m;
+                        std::vector<uint64_t> outcomes;
+                        for (size_t s=0; s<shots; ++s)
+                        {
+                           r.reset();
+                           c->execute(r,false,true);
+                           m.apply(r);
+                           outcomes.push_back(r.get_measurement_register());
+                        }
+                        r.add_shots(outcomes);
+                     }
+                     println("[+] done.");
+                     sock->send("OK\n", 3);
+                  }
+                  else
+                  {
+                     println("[!] circuit not found !");
+                     std::string error_code = "E"+int_to_str(QX_ERROR_CIRCUIT_NOT_FOUND)+"\n";
+                     sock->send(error_code.c_str(), error_code.length()+1);
+                  }
+               }
+               continue;
+            }
             else if (words[0] == "run")
             {
                if (qubits_count == 0)
@@ -713,6 +820,28 @@ namespace qx
             // println(" => rz gate on " << process_qubit(params[0]) << " (angle=" << params[1] << ")");
             pg->add(new qx::rz(q,atof(params[1].c_str())));
          }
+         else if (words[0] == "pauli_rotation")   // exp(-i*angle*P) : pauli_rotation q0,q1,...,xzy,angle
+         {
+            strings params = word_list(words[1],",");
+            if (params.size() < 3)
+               print_semantic_error(" pauli_rotation requires qubits, a pauli string and an angle !", QX_ERROR_MALFORMED_CMD);
+            std::vector<uint64_t> qv;
+            for (size_t i=0; i<params.size()-2; ++i)
+            {
+               uint32_t q = qubit_id(params[i]);
+               if (q > (qubits_count-1))
+                  print_semantic_error(" target qubit out of range !", QX_ERROR_QUBIT_OUT_OF_RANGE);
+               qv.push_back(q);
+            }
+            try
+            {
+               pg->add(new qx::pauli_rotation(qv, params[params.size()-2], atof(params.back().c_str())));
+            }
+            catch (std::invalid_argument& e)
+            {
+               print_semantic_error(" " << e.what(), QX_ERROR_MALFORMED_CMD);
+            }
+         }
 
          /**
           * phase 
@@ -112,7 +112,12 @@ int main(int argc, char **argv)
 
    }
    else 
+   {
       circuits = qcp.get_circuits();
+      // noise-free : textbook qft circuits run on the native qft kernel
+      for (uint32_t i=0; i<circuits.size(); i++)
+         circuits[i]->detect_qft();
+   }
   
   
    // qcp.execute(reg);
@@ -39,19 +39,30 @@ int main(int argc, char **argv)
    std::string file_path;
    size_t ncpu = 0;
    size_t navg = 0;
+   bool   single_precision = false;
    print_banner();
 
-   if (!(argc == 2 || argc == 3 || argc == 4))
+   // options may appear anywhere, the remaining arguments are positional
+   std::vector<char *> args;
+   for (int i=0; i<argc; ++i)
+   {
+      if (std::string(argv[i]) == "--single-precision")
+         single_precision = true;
+      else
+         args.push_back(argv[i]);
+   }
+
+   if (!(args.size() == 2 || args.size() == 3 || args.size() == 4))
    {
       println("error : you must specify a circuit file !");
-      println("usage: \n   " << argv[0] << " file.qc [iterations] [num_cpu]");
+      println("usage: \n   " << argv[0] << " [--single-precision] file.qc [iterations] [num_cpu]");
       return -1;
    }
 
    // parse arguments and initialise xpu cores
-   file_path = argv[1];
-   if (argc > 2) navg = (atoi(argv[2]));
-   if (argc > 3) ncpu = (atoi(argv[3]));
+   file_path = args[1];
+   if (args.size() > 2) navg = (atoi(args[2]));
+   if (args.size() > 3) ncpu = (atoi(args[3]));
    //if (ncpu && ncpu < 128) xpu::init(ncpu);
    //else xpu::init();
 
@@ -133,6 +144,32 @@ int main(int argc, char **argv)
       error_model       = qx::__depolarizing_channel__;
    }
 
+   // noise-free : single precision on request
+   if (single_precision)
+   {
+      if (error_model == qx::__depolarizing_channel__)
+         println("[!] single precision is not supported with an error model, using double precision.");
+      else
+      {
+         reg->reset();
+         if (qx::execute_single_precision(perfect_circuits,*reg,navg))
+         {
+            if (navg)
+            {
+               println("[+] average measurement after " << navg << " shots (single precision):");
+               reg->dump(true);
+            }
+            return 0;
+         }
+         println("[!] circuits not supported in single precision (non-unitary gate or mid-circuit measurement), using double precision.");
+      }
+   }
+
+   // noise-free : textbook qft circuits run on the native qft kernel
+   if (error_model != qx::__depolarizing_channel__)
+      for (size_t i=0; i<perfect_circuits.size(); i++)
+         perfect_circuits[i]->detect_qft();
+
    // measurement averaging
    if (navg)
    {
@@ -142,6 +179,7 @@ int main(int argc, char **argv)
       if (error_model == qx::__depolarizing_channel__)
       {
          qx::measure m;
+         std::vector<uint64_t> outcomes;
          for (size_t s=0; s<navg; ++s)
          {
             reg->reset();
@@ -160,17 +198,27 @@ int main(int argc, char **argv)
                      qx::noisy_dep_ch(perfect_circuits[i],error_probability,total_errors)->execute(*reg,false,true);
             }
             m.apply(*reg);
+            outcomes.push_back(reg->get_measurement_register());
          }
+         reg->add_shots(outcomes);
       }
       else
       {
-         qx::measure m;
-         for (size_t s=0; s<navg; ++s)
+         // without noise, a circuit measured only at the end is simulated once
+         reg->reset();
+         if (!qx::sample_shots(perfect_circuits,*reg,navg))
          {
-            reg->reset();
-            for (size_t i=0; i<perfect_circuits.size(); i++)
-               perfect_circuits[i]->execute(*reg,false,true);
-            m.apply(*reg);
+            qx::measure m;
+            std::vector<uint64_t> outcomes;
+            for (size_t s=0; s<navg; ++s)
+            {
+               reg->reset();
+               for (size_t i=0; i<perfect_circuits.size(); i++)
+                  perfect_circuits[i]->execute(*reg,false,true);
+               m.apply(*reg);
+               outcomes.push_back(reg->get_measurement_register());
+            }
+            reg->add_shots(outcomes);
          }
       }
 #ifdef USE_GPERFTOOLS
@@ -0,0 +1,10 @@
+version 1.0
+
+qubits 3
+
+.bell
+    h q[0]
+    cnot q[0], q[2]
+    x q[1]
+    measure q[0]
+    measure q[2]
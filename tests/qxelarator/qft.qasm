@@ -0,0 +1,41 @@
+version 1.0
+
+qubits 4
+
+.init
+	prep_z q[0:3]
+	x q[0]
+	x q[2]
+
+# textbook qft (run on the native qft kernel)
+.qft
+	h q[0]
+	crk q[1], q[0], 2
+	crk q[2], q[0], 3
+	crk q[3], q[0], 4
+	h q[1]
+	crk q[2], q[1], 2
+	crk q[3], q[1], 3
+	h q[2]
+	crk q[3], q[2], 2
+	h q[3]
+	swap q[0], q[3]
+	swap q[1], q[2]
+
+# inverse qft, gate by gate
+.iqft
+	swap q[1], q[2]
+	swap q[0], q[3]
+	h q[3]
+	cr q[3], q[2], -1.5707963267948966
+	h q[2]
+	cr q[3], q[1], -0.7853981633974483
+	cr q[2], q[1], -1.5707963267948966
+	h q[1]
+	cr q[3], q[0], -0.39269908169744830
+	cr q[2], q[0], -0.7853981633974483
+	cr q[1], q[0], -1.5707963267948966
+	h q[0]
+
+.result
+	measure q[0:3]
@@ -0,0 +1,124 @@
+/**
+ * @file   reference.h
+ * @brief  naive state vector simulation used as a reference by the core
+ *         tests : a gate is applied through its matrix, one group of
+ *         amplitudes at a time, without any of the optimized kernels
+ */
+#ifndef QX_TEST_REFERENCE_H
+#define QX_TEST_REFERENCE_H
+
+#include <complex>
+#include <vector>
+#include <random>
+#include <string>
+#include <iostream>
+#include <cstdlib>
+
+#include "qx/core/circuit.h"
+
+namespace reference
+{
+   typedef std::complex<double>     amplitude_t;
+   typedef std::vector<amplitude_t> state_t;
+
+   /**
+    * number of failed checks
+    */
+   inline size_t& failures()
+   {
+      static size_t f = 0;
+      return f;
+   }
+
+   inline void check(bool ok, const std::string& what)
+   {
+      if (!ok)
+      {
+         std::cout << "[x] failed : " << what << std::endl;
+         failures()++;
+      }
+   }
+
+   /**
+    * random normalized state of n qubits
+    */
+   inline state_t random_state(size_t n, unsigned seed)
+   {
+      std::mt19937                     g(seed);
+      std::normal_distribution<double> d;
+      state_t                          s(1ULL << n);
+      double                           norm = 0;
+      for (size_t i=0; i<s.size(); ++i)
+      {
+         s[i] = amplitude_t(d(g), d(g));
+         norm += std::norm(s[i]);
+      }
+      for (size_t i=0; i<s.size(); ++i)
+         s[i] /= std::sqrt(norm);
+      return s;
+   }
+
+   /**
+    * apply the matrix of g (bit i of its index being g->qubits()[i])
+    */
+   inline void apply(state_t& s, qx::gate * g)
+   {
+      cvector_t             m;
+      std::vector<uint64_t> q = g->qubits();
+      if (!g->get_matrix(m))
+      {
+         std::cout << "[x] reference : gate without matrix" << std::endl;
+         std::exit(1);
+      }
+      size_t   d = (1ULL << q.size());
+      uint64_t mask = 0;
+      for (size_t i=0; i<q.size(); ++i)
+         mask |= (1ULL << q[i]);
+      state_t in(d);
+      for (size_t base=0; base<s.size(); ++base)
+      {
+         if (base & mask)
+            continue;
+         std::vector<size_t> idx(d, base);
+         for (size_t j=0; j<d; ++j)
+            for (size_t i=0; i<q.size(); ++i)
+               if ((j >> i) & 1)
+                  idx[j] |= (1ULL << q[i]);
+         for (size_t j=0; j<d; ++j)
+            in[j] = s[idx[j]];
+         for (size_t r=0; r<d; ++r)
+         {
+            amplitude_t acc = 0;
+            for (size_t c=0; c<d; ++c)
+               acc += amplitude_t(m[r*d+c].re, m[r*d+c].im)*in[c];
+            s[idx[r]] = acc;
+         }
+      }
+   }
+
+   inline void load(qx::qu_register& reg, const state_t& s)
+   {
+      cvector_t& d = reg.get_data();
+      for (size_t i=0; i<s.size(); ++i)
+         d[i] = complex_t(s[i].real(), s[i].imag());
+   }
+
+   /**
+    * largest amplitude difference between reg and s
+    */
+   inline double distance(qx::qu_register& reg, const state_t& s)
+   {
+      cvector_t& d = reg.get_data();
+      double     r = 0;
+      for (size_t i=0; i<s.size(); ++i)
+         r = std::max(r, std::abs(amplitude_t(d[i].re, d[i].im) - s[i]));
+      return r;
+   }
+
+   inline void check_state(qx::qu_register& reg, const state_t& s, const std::string& what)
+   {
+      check(distance(reg, s) < 1e-9, what);
+   }
+}
+
+#endif // QX_TEST_REFERENCE_H
@@ -0,0 +1,23 @@
+version 1.0
+
+qubits 5
+
+.kernel
+    h q[0]
+    h q[3]
+    t q[0]
+    cnot q[0], q[1]
+    y q[2]
+    s q[3]
+    toffoli q[0], q[3], q[4]
+    cz q[1], q[3]
+    swap q[0], q[2]
+    h q[1]
+    tdag q[4]
+    cnot q[4], q[0]
+    sdag q[1]
+    z q[0]
+    rx q[2], 0.5
+    rz q[1], 1.2
+    cnot q[2], q[4]
+    swap q[3], q[4]
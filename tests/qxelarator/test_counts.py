@@ -0,0 +1,25 @@
+import unittest
+import os
+
+def test_counts():
+    import qxelarator
+
+    qx = qxelarator.QX()
+    qx.set(os.path.join(os.path.dirname(os.path.realpath(__file__)), 'counts.qasm'))
+    qx.set_shot_recording(True)
+
+    NShots = 1000
+    qx.execute(NShots)
+    counts = dict(qx.get_counts())
+    shots = list(qx.get_shots())
+
+    # q[0] and q[2] are entangled, q[1] is always 1
+    assert set(counts.keys()) <= {'010', '111'}
+    assert sum(counts.values()) == NShots
+    assert len(shots) == NShots
+    assert sorted(set(shots)) == sorted(int(k, 2) for k in counts)
+    for k in counts:
+        assert shots.count(int(k, 2)) == counts[k]
+
+if __name__ == '__main__':
+    test_counts()
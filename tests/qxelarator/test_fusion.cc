@@ -0,0 +1,124 @@
+/**
+ * gate fusion (circuit::set_fusion()) against the gate by gate reference
+ */
+#include <iostream>
+#include <stdexcept>
+#include "reference.h"
+
+using reference::check;
+
+/**
+ * random circuit of single- and two-qubit unitary gates
+ */
+static void build(qx::circuit& c, size_t n, size_t gates, unsigned seed)
+{
+   std::mt19937 g(seed);
+   for (size_t i=0; i<gates; ++i)
+   {
+      uint64_t a = g() % n;
+      uint64_t b = (a + 1 + g() % (n-1)) % n;
+      double   t = (g() % 1000)/150.0;
+      switch (g() % 7)
+      {
+         case 0 : c.add(new qx::hadamard(a)); break;
+         case 1 : c.add(new qx::rx(a, t)); break;
+         case 2 : c.add(new qx::ry(a, t)); break;
+         case 3 : c.add(new qx::rz(a, t)); break;
+         case 4 : c.add(new qx::cnot(a, b)); break;
+         case 5 : c.add(new qx::cphase(a, b)); break;
+         default: c.add(new qx::swap(a, b));
+      }
+   }
+}
+
+int main()
+{
+   // fused gates are limited to 6 qubits (dense kernel)
+   {
+      qx::circuit c(8);
+      bool thrown = false;
+      try { c.set_fusion(7); } catch (std::invalid_argument&) { thrown = true; }
+      check(thrown, "set_fusion(7) is rejected");
+      check(c.get_fusion() == 0, "rejected fusion size is not kept");
+   }
+
+   // widest fusion : 8 hadamards followed by a cnot chain
+   {
+      size_t      n = 8;
+      qx::circuit c(n);
+      for (uint64_t q=0; q<n; ++q)
+         c.add(new qx::hadamard(q));
+      for (uint64_t q=0; q+1<n; ++q)
+         c.add(new qx::cnot(q, q+1));
+      c.set_fusion(6);
+
+      reference::state_t s = reference::random_state(n, 1);
+      qx::qu_register    reg(n);
+      reference::load(reg, s);
+      for (size_t i=0; i<c.size(); ++i)
+         reference::apply(s, c.get(i));
+      c.execute(reg, false, true);
+      reference::check_state(reg, s, "fusion(6) of hadamards and a cnot chain");
+   }
+
+   // gates wider than the fusion limit are left out without building their
+   // matrix (a 12-qubit multi-controlled gate has none)
+   {
+      size_t                n = 13;
+      std::vector<uint64_t> ctrls;
+      for (uint64_t q=0; q<11; ++q)
+         ctrls.push_back(q);
+      qx::linalg::cmatrix_t m;
+      m(0,0) = 0; m(0,1) = 1;
+      m(1,0) = 1; m(1,1) = 0;
+      qx::multi_ctrl_gate * mc = new qx::multi_ctrl_gate(ctrls, 12, m);
+      cvector_t             mm;
+      check(!mc->get_matrix(mm), "no dense matrix above 6 qubits");
+
+      qx::circuit c(n), r(n);
+      for (uint64_t q=0; q<n; ++q)
+      {
+         c.add(new qx::hadamard(q));
+         r.add(new qx::hadamard(q));
+      }
+      c.add(mc);
+      r.add(new qx::multi_ctrl_gate(ctrls, 12, m));
+      c.add(new qx::rz(12, 0.3));
+      r.add(new qx::rz(12, 0.3));
+      c.set_fusion(4);
+
+      reference::state_t s = reference::random_state(n, 2);
+      qx::qu_register    reg(n), ref(n);
+      reference::load(reg, s);
+      reference::load(ref, s);
+      c.execute(reg, false, true);
+      r.execute(ref, false, true);
+      cvector_t& d = ref.get_data();
+      for (size_t i=0; i<s.size(); ++i)
+         s[i] = reference::amplitude_t(d[i].re, d[i].im);
+      reference::check_state(reg, s, "fusion(4) around a 12-qubit multi-controlled gate");
+   }
+
+   // every fusion size on random circuits, the fused circuit being cached
+   for (size_t k=0; k<=6; ++k)
+   {
+      size_t      n = 9;
+      qx::circuit c(n);
+      build(c, n, 120, (unsigned)k);
+      c.set_fusion(k);
+
+      reference::state_t s = reference::random_state(n, 10+k);
+      qx::qu_register    reg(n);
+      reference::load(reg, s);
+      for (size_t it=0; it<2; ++it)
+      {
+         for (size_t i=0; i<c.size(); ++i)
+            reference::apply(s, c.get(i));
+         c.execute(reg, false, true);
+         reference::check_state(reg, s, "fusion(" + std::to_string(k) + "), run " + std::to_string(it));
+      }
+   }
+
+   std::cout << (reference::failures() ? "[x] fusion tests failed" : "[+] fusion tests passed") << std::endl;
+   return reference::failures() ? 1 : 0;
+}
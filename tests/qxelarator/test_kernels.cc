@@ -0,0 +1,336 @@
+/**
+ * gate kernels against the gate by gate reference (reference.h), at the simd
+ * level selected by QX_SIMD (the tests are registered once per level), on
+ * every target qubit of small registers so that the low-qubit branches of
+ * the avx2 and avx-512 kernels are covered, the qft gate against the textbook
+ * circuit (and its detection by circuit::detect_qft()), then the execution
+ * modes of a circuit (fusion, diagonal accumulation, blocking and remapping)
+ */
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "reference.h"
+
+using reference::check;
+
+/**
+ * gate kinds : name and number of qubits
+ */
+static const char * kind_name[] = { "h", "x", "y", "z", "s", "sdag", "t", "tdag", "rx", "ry", "rz", "custom1",
+                                    "cnot", "cz", "swap", "cr", "cy", "custom2", "custom_diag2", "pauli_rotation2", "diagonal_gate2",
+                                    "toffoli", "fredkin", "mc2", "custom3", "pauli_rotation3", "diagonal_gate3", "diagonal_hamiltonian",
+                                    "mc3", "custom4", "diagonal_gate4", "custom5", "pauli_rotation5" };
+static const size_t kind_qubits[] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+                                      2, 2, 2, 2, 2, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 3, 3, 3,
+                                      4, 4, 4, 5, 5 };
+static const size_t kinds = sizeof(kind_qubits)/sizeof(size_t);
+
+static double random_angle(std::mt19937& g)
+{
+   return (g() % 10000)/1591.0;
+}
+
+/**
+ * random (dense or diagonal) d x d matrix, not necessarily unitary
+ */
+static cvector_t random_matrix(size_t d, std::mt19937& g, bool diagonal=false)
+{
+   std::uniform_real_distribution<double> u(-1, 1);
+   cvector_t m(d*d, complex_t(0,0));
+   for (size_t r=0; r<d; ++r)
+      for (size_t c=0; c<d; ++c)
+         if (!diagonal || (r == c))
+            m[r*d+c] = complex_t(u(g)/std::sqrt(d), u(g)/std::sqrt(d));
+   return m;
+}
+
+static cvector_t random_phases(size_t d, std::mt19937& g)
+{
+   cvector_t p(d);
+   for (size_t i=0; i<d; ++i)
+   {
+      double t = random_angle(g);
+      p[i] = complex_t(cos(t), sin(t));
+   }
+   return p;
+}
+
+static qx::gate * make(size_t kind, const std::vector<uint64_t>& q, std::mt19937& g)
+{
+   qx::linalg::cmatrix_t m;
+   switch (kind)
+   {
+      case 0  : return new qx::hadamard(q[0]);
+      case 1  : return new qx::pauli_x(q[0]);
+      case 2  : return new qx::pauli_y(q[0]);
+      case 3  : return new qx::pauli_z(q[0]);
+      case 4  : return new qx::phase_shift(q[0]);
+      case 5  : return new qx::s_dag_gate(q[0]);
+      case 6  : return new qx::t_gate(q[0]);
+      case 7  : return new qx::t_dag_gate(q[0]);
+      case 8  : return new qx::rx(q[0], random_angle(g));
+      case 9  : return new qx::ry(q[0], random_angle(g));
+      case 10 : return new qx::rz(q[0], random_angle(g));
+      case 11 : return new qx::custom(q, random_matrix(2, g));
+      case 12 : return new qx::cnot(q[0], q[1]);
+      case 13 : return new qx::cphase(q[0], q[1]);
+      case 14 : return new qx::swap(q[0], q[1]);
+      case 15 : return new qx::ctrl_phase_shift(q[0], q[1], random_angle(g));
+      case 16 : return new qx::ctrl_pauli_y(q[0], q[1]);
+      case 17 : return new qx::custom(q, random_matrix(4, g));
+      case 18 : return new qx::custom(q, random_matrix(4, g, true));
+      case 19 : return new qx::pauli_rotation(q, "XY", random_angle(g));
+      case 20 : return new qx::diagonal_gate(q, random_phases(4, g));
+      case 21 : return new qx::toffoli(q[0], q[1], q[2]);
+      case 22 : return new qx::fredkin(q[0], q[1], q[2]);
+      case 23 :
+      case 28 :
+      {
+         double t = random_angle(g);
+         m(0,0) = cos(t); m(0,1) = -sin(t);
+         m(1,0) = sin(t); m(1,1) = qx::linalg::complex_t(0.2, 0.5);
+         return new qx::multi_ctrl_gate(std::vector<uint64_t>(q.begin(), q.end()-1), q.back(), m);
+      }
+      case 24 : return new qx::custom(q, random_matrix(8, g));
+      case 25 : return new qx::pauli_rotation(q, "XYZ", random_angle(g));
+      case 26 : return new qx::diagonal_gate(q, random_phases(8, g));
+      case 27 :
+      {
+         std::vector<qx::diagonal_term_t> terms;
+         terms.push_back(qx::diagonal_term_t(1ULL << q[0], random_angle(g)));
+         terms.push_back(qx::diagonal_term_t((1ULL << q[0]) | (1ULL << q[2]), random_angle(g)));
+         terms.push_back(qx::diagonal_term_t((1ULL << q[0]) | (1ULL << q[1]) | (1ULL << q[2]), random_angle(g)));
+         return new qx::diagonal_hamiltonian(terms);
+      }
+      case 29 : return new qx::custom(q, random_matrix(16, g));
+      case 30 : return new qx::diagonal_gate(q, random_phases(16, g));
+      case 31 : return new qx::custom(q, random_matrix(32, g));
+      default : return new qx::pauli_rotation(q, "XZYXZ", random_angle(g));
+   }
+}
+
+/**
+ * <k> distinct random qubits of <n>, the first (or the last) one being <t>
+ */
+static std::vector<uint64_t> pick(size_t n, size_t k, uint64_t t, bool last, std::mt19937& g)
+{
+   std::vector<uint64_t> others;
+   for (uint64_t q=0; q<n; ++q)
+      if (q != t)
+         others.push_back(q);
+   std::shuffle(others.begin(), others.end(), g);
+   std::vector<uint64_t> q(others.begin(), others.begin()+(k-1));
+   q.insert(last ? q.end() : q.begin(), t);
+   return q;
+}
+
+/**
+ * textbook qft circuit on the qubits <q> : a hadamard and a controlled phase
+ * ladder per qubit, then the closing swaps. the inverse is the reversed
+ * circuit with opposite phases.
+ */
+static std::vector<qx::gate*> textbook_qft(const std::vector<uint64_t>& q, bool inverse, bool swaps)
+{
+   std::vector<qx::gate*> c;
+   size_t k = q.size();
+   for (size_t i=0; i<k; ++i)
+   {
+      c.push_back(new qx::hadamard(q[i]));
+      for (size_t d=1; i+d<k; ++d)
+         c.push_back(new qx::ctrl_phase_shift(q[i+d], q[i], (double)((inverse ? -QX_PI : QX_PI)/(1UL << d))));
+   }
+   if (swaps)
+      for (size_t s=0; s<k/2; ++s)
+         c.push_back(new qx::swap(q[s], q[k-1-s]));
+   if (inverse)
+      std::reverse(c.begin(), c.end());
+   return c;
+}
+
+static std::string qubits_str(const std::vector<uint64_t>& q)
+{
+   std::string s;
+   for (size_t i=0; i<q.size(); ++i)
+      s += (i ? "," : "") + std::to_string(q[i]);
+   return s;
+}
+
+int main()
+{
+   // QX_SIMD may only lower the detected level
+   const char *         env = std::getenv("QX_SIMD");
+   xpu::simd_level      level = xpu::host_simd_level();
+   const char *         level_name[] = { "sse", "avx2", "avx512" };
+   std::cout << "[+] simd level : " << level_name[(int)level] << " (QX_SIMD=" << (env ? env : "") << ")" << std::endl;
+   if (env && !strcmp(env, "sse"))
+      check(level == xpu::simd_level::sse, "QX_SIMD=sse selects the sse kernels");
+   if (env && !strcmp(env, "avx2"))
+      check(level <= xpu::simd_level::avx2, "QX_SIMD=avx2 does not select the avx-512 kernels");
+
+   // every gate kind on every target qubit, as first or last operand
+   std::mt19937 g(5);
+   size_t       sizes[] = { 1, 2, 3, 4, 5, 6, 9 };
+   unsigned     seed = 0;
+   for (size_t n : sizes)
+      for (size_t kind=0; kind<kinds; ++kind)
+      {
+         if (kind_qubits[kind] > n)
+            continue;
+         for (uint64_t t=0; t<n; ++t)
+            for (size_t last=0; last<2; ++last)
+            {
+               std::vector<uint64_t> q = pick(n, kind_qubits[kind], t, last, g);
+               qx::gate *            x = make(kind, q, g);
+               reference::state_t    s = reference::random_state(n, seed++);
+               qx::qu_register       reg(n);
+               reference::load(reg, s);
+               reference::apply(s, x);
+               x->apply(reg);
+               reference::check_state(reg, s, std::string(kind_name[kind]) + " on (" + qubits_str(q) + ") of " + std::to_string(n) + " qubits");
+               delete x;
+            }
+      }
+
+   // multi-controlled gates reject duplicate and overlapping qubits
+   {
+      qx::linalg::cmatrix_t m;
+      std::vector<uint64_t> dup   = { 0, 2, 0 };
+      std::vector<uint64_t> ctrls = { 0, 1 };
+      bool thrown = false;
+      try { qx::multi_ctrl_gate(dup, 3, m); } catch (std::invalid_argument&) { thrown = true; }
+      check(thrown, "multi-controlled gate with a duplicate control qubit is rejected");
+      thrown = false;
+      try { qx::multi_ctrl_gate(ctrls, 1, m); } catch (std::invalid_argument&) { thrown = true; }
+      check(thrown, "multi-controlled gate controlled by its target is rejected");
+   }
+
+   // qft gate against the textbook circuit, on every contiguous range of
+   // qubits, increasing and decreasing, inverse or not, with or without swaps.
+   // the hadamard gate uses R_SQRT_2, a single precision constant, which
+   // shrinks the textbook state by about 1.7e-8 per hadamard.
+   for (size_t n : sizes)
+      for (size_t k=1; k<=n; ++k)
+         for (uint64_t lo=0; lo+k<=n; ++lo)
+            for (size_t v=0; v<8; ++v)
+            {
+               bool                  down = v & 1;
+               bool                  inverse = v & 2;
+               bool                  swaps = v & 4;
+               std::vector<uint64_t> q;
+               for (size_t i=0; i<k; ++i)
+                  q.push_back(down ? lo+k-1-i : lo+i);
+               std::vector<qx::gate*> c = textbook_qft(q, inverse, swaps);
+               reference::state_t     s = reference::random_state(n, seed++);
+               qx::qu_register        reg(n);
+               reference::load(reg, s);
+               for (size_t i=0; i<c.size(); ++i)
+               {
+                  reference::apply(s, c[i]);
+                  delete c[i];
+               }
+               qx::qft(q, inverse, swaps).apply(reg);
+               check(reference::distance(reg, s) < 1e-7*k, std::string(inverse ? "inverse qft" : "qft") + " on (" + qubits_str(q) + ") of "
+                                                           + std::to_string(n) + " qubits" + (swaps ? "" : ", no swaps"));
+            }
+
+   // the qft gate rejects empty and non-contiguous qubit lists
+   {
+      std::vector<uint64_t> gap = { 0, 2, 3 };
+      bool thrown = false;
+      try { qx::qft x((std::vector<uint64_t>())); } catch (std::invalid_argument&) { thrown = true; }
+      check(thrown, "qft on no qubit is rejected");
+      thrown = false;
+      try { qx::qft x(gap); } catch (std::invalid_argument&) { thrown = true; }
+      check(thrown, "qft on non-contiguous qubits is rejected");
+   }
+
+   // detect_qft replaces exactly the textbook circuit, between other gates,
+   // and keeps the inverse circuit and the gates around it
+   for (size_t v=0; v<4; ++v)
+   {
+      size_t                n = 7;
+      bool                  down = v & 1;
+      bool                  swaps = v & 2;
+      std::vector<uint64_t> q;
+      for (size_t i=0; i<5; ++i)
+         q.push_back(down ? 5-i : 1+i);
+      qx::circuit c(n);
+      c.add(new qx::hadamard(2));
+      c.add(new qx::swap(0, 6));
+      std::vector<qx::gate*> t = textbook_qft(q, false, swaps);
+      for (size_t i=0; i<t.size(); ++i)
+         c.add(t[i]);
+      c.add(new qx::swap(q[0], q[4]));
+      c.add(new qx::rx(q[2], 0.3));
+      std::vector<qx::gate*> it = textbook_qft(q, true, true);
+      for (size_t i=0; i<it.size(); ++i)
+         c.add(it[i]);
+      size_t             size = c.size();
+      reference::state_t s = reference::random_state(n, seed++);
+      qx::qu_register    reg(n);
+      reference::load(reg, s);
+      for (size_t i=0; i<c.size(); ++i)
+         reference::apply(s, c.get(i));
+
+      std::string what = std::string("detect_qft on (") + qubits_str(q) + ")" + (swaps ? "" : ", no swaps");
+      check(c.detect_qft() == 1, what + " finds one qft");
+      check(c.size() == size-t.size()+1, what + " replaces the whole circuit");
+      check((c.get(2)->type() == qx::__qft_gate__) && (c.get(2)->qubits() == q), what + " qft qubits");
+      check(c.get(3)->type() == qx::__swap_gate__, what + " keeps the following swap");
+      c.execute(reg, false, true);
+      check(reference::distance(reg, s) < 1e-6, what + " state");
+   }
+
+   // swap exchanges the measurement predictions of its qubits
+   {
+      qx::qu_register reg(3);
+      reg.set_measurement_prediction(0, qx::__state_1__);
+      reg.set_measurement_prediction(2, qx::__state_0__);
+      qx::swap(0, 2).apply(reg);
+      check((reg.get_measurement_prediction(0) == qx::__state_0__) && (reg.get_measurement_prediction(2) == qx::__state_1__), "swap of measurement predictions");
+   }
+
+   // execution modes : fusion, diagonal accumulation, blocking, remapping
+   {
+      size_t      n = 10;
+      qx::circuit c(n);
+      for (size_t i=0; i<300; ++i)
+      {
+         size_t kind = g() % kinds;
+         c.add(make(kind, pick(n, kind_qubits[kind], g() % n, false, g), g));
+      }
+      reference::state_t s0 = reference::random_state(n, 1000);
+      reference::state_t s  = s0;
+      for (size_t it=0; it<2; ++it)
+         for (size_t i=0; i<c.size(); ++i)
+            reference::apply(s, c.get(i));
+
+      //                      fusion  diag  blocking  remapping
+      size_t modes[][4] = { { 0,      0,    0,        0 },
+                            { 0,      1,    0,        0 },
+                            { 4,      0,    0,        0 },
+                            { 4,      1,    0,        0 },
+                            { 0,      1,    6,        0 },
+                            { 0,      0,    6,        6 },
+                            { 4,      1,    6,        6 },
+                            { 5,      1,    7,        5 } };
+      for (size_t m=0; m<sizeof(modes)/sizeof(modes[0]); ++m)
+      {
+         c.set_fusion(modes[m][0]);
+         c.set_diagonal_accumulation(modes[m][1]);
+         c.set_blocking(modes[m][2]);
+         c.set_remapping(modes[m][3]);
+         qx::qu_register reg(n);
+         reference::load(reg, s0);
+         c.execute(reg, false, true);
+         c.execute(reg, false, true);
+         reference::check_state(reg, s, "fusion " + std::to_string(modes[m][0]) + ", diagonal accumulation " + std::to_string(modes[m][1])
+                                + ", blocking " + std::to_string(modes[m][2]) + ", remapping " + std::to_string(modes[m][3]));
+      }
+   }
+
+   std::cout << (reference::failures() ? "[x] kernel tests failed" : "[+] kernel tests passed") << std::endl;
+   return reference::failures() ? 1 : 0;
+}
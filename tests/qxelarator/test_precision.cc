@@ -0,0 +1,192 @@
+/**
+ * single vs double precision : drift of the sp_register on the benchmark
+ * circuits (tests/benchmark : qft, entangle, hadamard) at reduced size,
+ * repeated to emulate deep circuits, the single-precision kernels against
+ * the gate by gate reference (reference.h) on every qubit of small registers,
+ * at the simd level selected by QX_SIMD (the tests are registered once per
+ * level), and the single-precision execution of noise-free circuits
+ * (qx::execute_single_precision())
+ *
+ * usage : test_precision [max_depth]   (default 1000)
+ */
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include "reference.h"
+
+using reference::check;
+
+/**
+ * bound on the drift (1-fidelity) per gate : float rounding makes it grow
+ * linearly with the gate count, by 1e-8 to 4e-8 per gate on 12 qubits
+ */
+#define __max_drift_per_gate__ 1e-7
+
+/**
+ * gate on the qubits <q> (1 to 6) : the kernels depend on the matrix
+ * pattern (1q, phase, permutation, sparse, dense) and on which qubits fall
+ * within a simd register
+ */
+static qx::gate * make(size_t kind, const std::vector<uint64_t>& q, std::mt19937& g)
+{
+   std::uniform_real_distribution<double> u(-1, 1);
+   size_t    d = (1ULL << q.size());
+   cvector_t m(d*d, complex_t(0,0));
+   switch (q.size()*10 + kind)
+   {
+      case 10 : return new qx::hadamard(q[0]);
+      case 11 : return new qx::rx(q[0], u(g)*3);
+      case 12 : return new qx::t_gate(q[0]);
+      case 20 : return new qx::cnot(q[0], q[1]);
+      case 21 : return new qx::ctrl_phase_shift(q[0], q[1], u(g)*3);
+      case 22 : return new qx::swap(q[0], q[1]);
+      case 30 : return new qx::toffoli(q[0], q[1], q[2]);
+      case 31 : return new qx::fredkin(q[0], q[1], q[2]);
+      default :
+         for (size_t r=0; r<d; ++r)
+            for (size_t c=0; c<d; ++c)
+               if ((kind != 3) || (r == c))
+                  m[r*d+c] = complex_t(u(g)/std::sqrt(d), u(g)/std::sqrt(d));
+         return new qx::custom(q, m);
+   }
+}
+
+int main(int argc, char ** argv)
+{
+   size_t max_depth = (argc > 1) ? (size_t)atol(argv[1]) : 1000;
+
+   uint64_t                  qn = 12;
+   std::vector<qx::circuit*> bench;
+
+   qx::circuit * qft = new qx::circuit(qn, "qft");
+   qft->add(new qx::pauli_x(0));
+   for (uint64_t t=qn; t--; )
+   {
+      qft->add(new qx::hadamard(t));
+      for (uint64_t c=t; c--; )
+         qft->add(new qx::ctrl_phase_shift(c, t, (size_t)(t-c+1)));
+   }
+   bench.push_back(qft);
+
+   qx::circuit * entangle = new qx::circuit(qn, "entangle");
+   entangle->add(new qx::hadamard(0));
+   for (uint64_t q=1; q<qn; q++)
+      entangle->add(new qx::cnot(q-1, q));
+   for (uint64_t q=qn; --q; )
+      entangle->add(new qx::cnot(q-1, q));
+   entangle->add(new qx::hadamard(0));
+   bench.push_back(entangle);
+
+   qx::circuit * hadamard = new qx::circuit(qn, "hadamard");
+   for (uint64_t q=0; q<qn; q++)
+   {
+      hadamard->add(new qx::hadamard(q));
+      hadamard->add(new qx::rz(q, 0.1234*(q+1)));
+   }
+   bench.push_back(hadamard);
+
+   std::cout << "[+] single vs double precision state vector (" << qn << " qubits) :" << std::endl;
+   for (size_t b=0; b<bench.size(); b++)
+   {
+      qx::qu_register dreg(qn);
+      qx::sp_register freg(qn);
+      size_t done = 0;
+      for (size_t depth=1; depth<=max_depth; depth *= 10)
+      {
+         bench[b]->set_iterations(depth - done);
+         bench[b]->execute(dreg, false, true);
+         bench[b]->execute(freg, true);
+         done = depth;
+         double f = qx::fidelity(dreg, freg);
+         size_t gates = depth*bench[b]->size();
+         std::cout << " |- " << bench[b]->id() << " x " << depth << " (" << gates
+                   << " gates) : fidelity = " << f << " , drift = " << (1-f) << std::endl;
+         check(std::abs(1-f) < __max_drift_per_gate__*gates, bench[b]->id() + " x " + std::to_string(depth) + " drift");
+      }
+      delete bench[b];
+   }
+
+   // every kind of gate on every qubit, the others being drawn at random, in
+   // a register lent by a qu_register (as in execute_single_precision())
+   std::cout << "[+] single-precision kernels :" << std::endl;
+   std::mt19937 g(11);
+   for (size_t n=1; n<=9; ++n)
+   {
+      for (size_t k=1; k<=std::min(n, (size_t)6); ++k)
+      {
+         for (size_t kind=0; kind<4; ++kind)
+         {
+            double err = 0;
+            for (uint64_t t=0; t<n; ++t)
+            {
+               std::vector<uint64_t> q;
+               for (uint64_t i=0; i<n; ++i)
+                  if (i != t)
+                     q.push_back(i);
+               std::shuffle(q.begin(), q.end(), g);
+               q.resize(k-1);
+               q.insert(q.begin() + (g() % k), t);
+
+               reference::state_t s = reference::random_state(n, (unsigned)g());
+               qx::qu_register    reg(n);
+               qx::gate *         gt = make(kind, q, g);
+               reference::load(reg, s);
+               reference::apply(s, gt);
+               {
+                  qx::sp_register sp(reg);
+                  sp.apply(gt);
+               }
+               err = std::max(err, reference::distance(reg, s));
+               delete gt;
+            }
+            check(err < 1e-6, std::to_string(n) + " qubits, gate kind " + std::to_string(kind) + " on " + std::to_string(k) + " qubits");
+         }
+      }
+      std::cout << " |- " << n << " qubits" << std::endl;
+   }
+
+   // preparation, unitary gates and a final (deterministic) measurement
+   {
+      size_t      n = 6;
+      qx::circuit c(n);
+      c.add(new qx::prepx(2));
+      c.add(new qx::hadamard(0));
+      c.add(new qx::cnot(0, 1));
+      c.add(new qx::rx(3, 0.3));
+      c.add(new qx::toffoli(0, 3, 4));
+      c.add(new qx::measure(5));
+      c.add(new qx::cphase(1, 2));
+      std::vector<qx::circuit*> circuits(1, &c);
+
+      qx::qu_register dreg(n);
+      qx::qu_register freg(n);
+      for (size_t i=0; i<c.size(); ++i)
+         c.get(i)->apply(dreg);
+      check(qx::execute_single_precision(circuits, freg), "single precision run of a measured circuit");
+      check(dreg.get_measurement_prediction(5) == freg.get_measurement_prediction(5), "single precision final measurement");
+      check(std::abs(qx::fidelity(dreg, freg) - 1) < 1e-6, "single precision final state");
+
+      qx::qu_register sreg(n);
+      check(qx::execute_single_precision(circuits, sreg, 100), "single precision shots");
+      size_t shots = 0;
+      std::map<std::string,size_t> counts = sreg.get_counts();
+      for (std::map<std::string,size_t>::iterator it=counts.begin(); it!=counts.end(); ++it)
+         shots += it->second;
+      check(shots == 100, "single precision shot count");
+   }
+
+   // a gate after a measurement keeps the circuit in double precision
+   {
+      qx::circuit c(2);
+      c.add(new qx::hadamard(0));
+      c.add(new qx::measure(0));
+      c.add(new qx::cnot(0, 1));
+      std::vector<qx::circuit*> circuits(1, &c);
+      qx::qu_register reg(2);
+      check(!qx::execute_single_precision(circuits, reg), "mid-circuit measurement is rejected");
+      check(std::abs(reg.get_data()[0].re - 1) < 1e-12, "rejected circuit leaves the register untouched");
+   }
+
+   std::cout << (reference::failures() ? "[x] precision tests failed" : "[+] precision tests passed") << std::endl;
+   return reference::failures() ? 1 : 0;
+}
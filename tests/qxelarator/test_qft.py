@@ -0,0 +1,19 @@
+import unittest
+import os
+
+def test_qft():
+    import qxelarator
+
+    qx = qxelarator.QX()
+
+    qx.set(os.path.join(os.path.dirname(os.path.realpath(__file__)), 'qft.qasm'))
+    qx.execute()
+
+    # the inverse qft undoes the qft : the initial state |0101> is measured
+    c = [qx.get_measurement_outcome(i) for i in range(4)]
+
+    print(c)
+    assert c == [True, False, True, False]
+
+if __name__ == '__main__':
+    test_qft()
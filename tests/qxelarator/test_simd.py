@@ -0,0 +1,49 @@
+import unittest
+import os
+import re
+import subprocess
+import sys
+
+# final state of simd.qasm (qubit 0 rightmost), rz being diag(1, e^(i*angle))
+EXPECTED = {
+    '00001': complex(-0.061851, -0.404413),
+    '00011': complex(-0.044070, -0.284046),
+    '01101': complex( 0.154758, -0.242228),
+    '01111': complex(-0.219519,  0.345235),
+    '10001': complex( 0.342562,  0.000000),
+    '10011': complex( 0.319281, -0.124130),
+    '10100': complex( 0.342562,  0.000000),
+    '10110': complex(-0.319281,  0.124130),
+    '11000': complex( 0.000000, -0.087471),
+    '11010': complex( 0.031696,  0.081526),
+    '11101': complex( 0.000000, -0.087471),
+    '11111': complex(-0.031696, -0.081526),
+}
+
+# the simd level is selected once per process, each level runs in its own
+RUN = '''
+import sys
+import qxelarator
+qx = qxelarator.QX()
+qx.set(sys.argv[1])
+qx.execute()
+print(qx.get_state())
+'''
+
+def get_state(level):
+    qasm = os.path.join(os.path.dirname(os.path.realpath(__file__)), 'simd.qasm')
+    env = dict(os.environ, QX_SIMD=level)
+    out = subprocess.check_output([sys.executable, '-c', RUN, qasm], env=env).decode()
+    state = {}
+    for re_, im, bits in re.findall(r'\(([-+0-9.e]+),([-+0-9.e]+)\)\s*\|([01]+)>', out):
+        state[bits] = complex(float(re_), float(im))
+    return state
+
+def test_simd():
+    for level in ['sse', 'avx2', 'avx512']:
+        state = get_state(level)
+        for bits in set(state) | set(EXPECTED):
+            assert abs(state.get(bits, 0) - EXPECTED.get(bits, 0)) < 1e-5, (level, bits)
+
+if __name__ == '__main__':
+    test_simd()
@@ -0,0 +1,24 @@
+import unittest
+import os
+
+def test_single_precision():
+    import qxelarator
+
+    qx = qxelarator.QX()
+    qx.set(os.path.join(os.path.dirname(os.path.realpath(__file__)), 'counts.qasm'))
+    qx.set_single_precision(True)
+
+    NShots = 1000
+    qx.execute(NShots)
+    counts = dict(qx.get_counts())
+
+    # q[0] and q[2] are entangled, q[1] is always 1
+    assert set(counts.keys()) <= {'010', '111'}
+    assert sum(counts.values()) == NShots
+
+    qx.execute()
+    assert qx.get_measurement_outcome(1) == 1
+    assert qx.get_measurement_outcome(0) == qx.get_measurement_outcome(2)
+
+if __name__ == '__main__':
+    test_single_precision()